@@ -17,6 +17,8 @@
 #include "model/rategamma.h"
 #include "gsl/mygsl.h"
 #include "utils/gzstream.h"
+#include "nexusscanner.h"
+#include "utils/hammingdistance.h"
 #include "utils/timeutil.h" //for getRealTime()
 #include "utils/progress.h" //for progress_display
 #include "alignmentsummary.h"
@@ -340,87 +342,108 @@ void Alignment::checkSeqName() {
     delete [] count_per_seq;
 }
 
+/** number of sequences hashed together in one pass over the patterns */
+const int SEQ_HASH_BLOCK = 256;
+
+void Alignment::computeSeqHashes(vector<size_t> &hashes) {
+    int nseq = getNSeq();
+    int nblock = (nseq + SEQ_HASH_BLOCK - 1) / SEQ_HASH_BLOCK;
+    hashes.assign(nseq, 0);
+    // pattern-major, so that every pattern is read once per block of sequences
+    #ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+    #endif
+    for (int block = 0; block < nblock; ++block) {
+        int first = block*SEQ_HASH_BLOCK;
+        int last = min(first + SEQ_HASH_BLOCK, nseq);
+        for (iterator it = begin(); it != end(); ++it)
+            for (int seq = first; seq < last; ++seq)
+                adjustHash((*it)[seq], hashes[seq]);
+    }
+}
+
+bool Alignment::isIdenticalSeq(int seq1, int seq2) {
+    for (iterator it = begin(); it != end(); it++)
+        if ((*it)[seq1] != (*it)[seq2])
+            return false;
+    return true;
+}
+
+void Alignment::groupIdenticalSeq(vector<IntVector> &groups, IntVector &seq_group, progress_display *progress) {
+    int nseq = getNSeq();
+    auto startHash = getRealTime();
+    vector<size_t> hashes;
+    computeSeqHashes(hashes);
+    if (progress)
+        (*progress) += nseq;
+    if (verbose_mode >= VB_MED && !progress_display::getProgressDisplay()) {
+        cout << "Hashing sequences took " << getRealTime() - startHash << " wall-clock seconds" << endl;
+    }
+
+    // groups of each hash value, a sequence is only compared to the groups in its bucket
+    unordered_map<size_t, IntVector> buckets;
+    groups.clear();
+    seq_group.resize(nseq);
+    for (int seq = 0; seq < nseq; ++seq) {
+        IntVector &bucket = buckets[hashes[seq]];
+        int group = -1;
+        for (int candidate : bucket)
+            if (isIdenticalSeq(groups[candidate][0], seq)) {
+                group = candidate;
+                break;
+            }
+        if (group < 0) {
+            group = groups.size();
+            groups.push_back(IntVector());
+            bucket.push_back(group);
+        }
+        groups[group].push_back(seq);
+        seq_group[seq] = group;
+    }
+}
+
 int Alignment::checkIdenticalSeq()
 {
-    //Todo: This should use sequence hashing.
 	int num_identical = 0;
-    IntVector checked;
-    checked.resize(getNSeq(), 0);
-	for (size_t seq1 = 0; seq1 < getNSeq(); ++seq1) {
-        if (checked[seq1]) continue;
-		bool first = true;
-		for (size_t seq2 = seq1+1; seq2 < getNSeq(); ++seq2) {
-			bool equal_seq = true;
-			for (iterator it = begin(); it != end(); it++)
-				if  ((*it)[seq1] != (*it)[seq2]) {
-					equal_seq = false;
-					break;
-				}
-			if (equal_seq) {
-				if (first)
-					cout << "WARNING: Identical sequences " << getSeqName(seq1);
-				cout << ", " << getSeqName(seq2);
-				num_identical++;
-				checked[seq2] = 1;
-				first = false;
-			}
-		}
-		checked[seq1] = 1;
-		if (!first) cout << endl;
-	}
+    vector<IntVector> groups;
+    IntVector seq_group;
+    groupIdenticalSeq(groups, seq_group);
+    for (auto &group : groups) {
+        if (group.size() < 2) continue;
+        cout << "WARNING: Identical sequences " << getSeqName(group[0]);
+        for (size_t i = 1; i < group.size(); ++i)
+            cout << ", " << getSeqName(group[i]);
+        cout << endl;
+        num_identical += group.size()-1;
+    }
 	if (num_identical)
 		outWarning("Some identical sequences found that should be discarded before the analysis");
 	return num_identical;
 }
 
-Alignment *Alignment::removeIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs)
+void Alignment::findIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs,
+                                 vector<bool> &removed)
 {
     auto n = getNSeq();
     IntVector checked;
-    vector<bool> removed;
     checked.resize(n, 0);
     removed.resize(n, false);
 
-    //JB2020-06-17 Begin : Determine hashes for all the sequences
-    auto startHash = getRealTime();
-    vector<size_t> hashes;
-    hashes.resize(n, 0);
     progress_display progress(n*2, "Checking for duplicate sequences");
-    #ifdef _OPENMP
-        #pragma omp parallel for schedule(static,100)
-    #endif
-    for (int seq1=0; seq1<n; ++seq1) {
-        size_t hash = 0;
-        for (iterator it = begin(); it != end(); ++it) {
-            adjustHash((*it)[seq1], hash);
-        }
-        hashes[seq1] = hash;
-        ++progress;
-    }
-    if (verbose_mode >= VB_MED && !progress_display::getProgressDisplay()) {
-        auto hashTime = getRealTime() - startHash;
-        cout << "Hashing sequences took " << hashTime << " wall-clock seconds" << endl;
-    }
-    //JB2020-06-17 Finish
+    vector<IntVector> groups;
+    IntVector seq_group;
+    groupIdenticalSeq(groups, seq_group, &progress);
 
     bool listIdentical = !Params::getInstance().suppress_duplicate_sequence_warnings;
 
     auto startCheck = getRealTime();
-	for (size_t seq1 = 0; seq1 < getNSeq(); ++seq1) {
+	for (size_t seq1 = 0; seq1 < n; ++seq1) {
         if (checked[seq1]) continue;
         bool first_ident_seq = true;
-		for (size_t seq2 = seq1+1; seq2 < getNSeq(); ++seq2) {
+        for (int seq2 : groups[seq_group[seq1]]) {
+            if (seq2 <= seq1) continue;
 			if (getSeqName(seq2) == not_remove || removed[seq2]) continue;
-            if (hashes[seq1] != hashes[seq2]) continue; //JB2020-06-17
-			bool equal_seq = true;
-            for (iterator it = begin(); it != end(); it++) {
-                if  ((*it)[seq1] != (*it)[seq2]) {
-                    equal_seq = false;
-                    break;
-                }
-            }
-			if (!equal_seq) continue;
-            if (removed_seqs.size()+3 < getNSeq() && (!keep_two || !first_ident_seq)) {
+            if (removed_seqs.size()+3 < n && (!keep_two || !first_ident_seq)) {
                 removed_seqs.push_back(getSeqName(seq2));
                 target_seqs.push_back(getSeqName(seq1));
                 removed[seq2] = true;
@@ -441,6 +464,105 @@ Alignment *Alignment::removeIdenticalSeq(string not_remove, bool keep_two, StrVe
             << " wall-clock seconds" << endl;
     }
     progress.done();
+}
+
+/** number of most variable patterns indexed by state to find near-identical sequences */
+const int NEAR_IDENT_INDEX_PATTERNS = 8;
+
+void Alignment::findNearIdenticalSeq(string not_remove, StrVector &removed_seqs, StrVector &target_seqs,
+                                     vector<bool> &removed)
+{
+    int nseq = getNSeq();
+    size_t nptn = getNPattern();
+    auto startCheck = getRealTime();
+
+    // number of patterns with gap/ambiguity of each sequence, a target must have fewer
+    IntVector num_unknown(nseq, 0);
+    for (iterator it = begin(); it != end(); ++it)
+        for (int seq = 0; seq < nseq; ++seq)
+            if ((*it)[seq] >= num_states)
+                num_unknown[seq]++;
+
+    // the most variable patterns, each indexed by state, to shortlist the candidate targets
+    IntVector index_ptns(nptn);
+    std::iota(index_ptns.begin(), index_ptns.end(), 0);
+    int nindex = min((size_t)NEAR_IDENT_INDEX_PATTERNS, nptn);
+    partial_sort(index_ptns.begin(), index_ptns.begin()+nindex, index_ptns.end(),
+                 [&](int a, int b) { return at(a).num_chars > at(b).num_chars; });
+    index_ptns.resize(nindex);
+    vector<vector<IntVector> > state_index(nindex, vector<IntVector>(num_states));
+    for (int i = 0; i < nindex; ++i) {
+        Pattern &pat = at(index_ptns[i]);
+        for (int seq = 0; seq < nseq; ++seq)
+            if (!removed[seq] && pat[seq] < num_states)
+                state_index[i][pat[seq]].push_back(seq);
+    }
+    IntVector all_seqs(nseq);
+    std::iota(all_seqs.begin(), all_seqs.end(), 0);
+
+    // most complete sequences first, so that targets are never removed afterwards
+    IntVector order;
+    for (int seq = 0; seq < nseq; ++seq)
+        if (!removed[seq] && num_unknown[seq] > 0 && getSeqName(seq) != not_remove)
+            order.push_back(seq);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return num_unknown[a] < num_unknown[b]; });
+
+    bool listIdentical = !Params::getInstance().suppress_duplicate_sequence_warnings;
+    int num_near_ident = 0;
+    IntVector known_ptns;
+    for (int seq : order) {
+        if (removed_seqs.size()+3 >= nseq)
+            break;
+        IntVector *candidates = &all_seqs;
+        for (int i = 0; i < nindex; ++i) {
+            StateType state = at(index_ptns[i])[seq];
+            if (state < num_states && state_index[i][state].size() < candidates->size())
+                candidates = &state_index[i][state];
+        }
+        known_ptns.clear();
+        for (size_t ptn = 0; ptn < nptn; ++ptn)
+            if (at(ptn)[seq] < num_states)
+                known_ptns.push_back(ptn);
+        int target = -1;
+        for (int cand : *candidates) {
+            if (removed[cand] || num_unknown[cand] >= num_unknown[seq])
+                continue;
+            bool match = true;
+            for (int ptn : known_ptns)
+                if (at(ptn)[cand] != at(ptn)[seq]) {
+                    match = false;
+                    break;
+                }
+            if (match) {
+                target = cand;
+                break;
+            }
+        }
+        if (target < 0)
+            continue;
+        // sequences identical to this one are re-inserted next to its target instead
+        for (auto &name : target_seqs)
+            if (name == getSeqName(seq))
+                name = getSeqName(target);
+        removed_seqs.push_back(getSeqName(seq));
+        target_seqs.push_back(getSeqName(target));
+        removed[seq] = true;
+        num_near_ident++;
+        if (listIdentical)
+            cout << "NOTE: " << getSeqName(seq) << " differs from " << getSeqName(target) << " only by gaps/ambiguity" << endl;
+    }
+    if (verbose_mode >= VB_MED) {
+        cout << "Checking for " << num_near_ident << " near-identical sequences took "
+            << getRealTime() - startCheck << " wall-clock seconds" << endl;
+    }
+}
+
+Alignment *Alignment::removeIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs)
+{
+    vector<bool> removed;
+    findIdenticalSeq(not_remove, keep_two, removed_seqs, target_seqs, removed);
+    if (Params::getInstance().remove_near_identical_seqs)
+        findNearIdenticalSeq(not_remove, removed_seqs, target_seqs, removed);
     if (removed_seqs.size() > 0) {
         double removeDupeStart = getRealTime();
         if (removed_seqs.size() + 3 >= getNSeq()) {
@@ -778,7 +900,8 @@ Alignment::Alignment(char *filename, char *sequence_type, InputType &intype, str
     try {
         if (intype == IN_NEXUS) {
             cout << "Nexus format detected" << endl;
-            readNexus(filename);
+            if (!readNexusFast(filename, sequence_type))
+                readNexus(filename);
         } else if (intype == IN_FASTA) {
             cout << "Fasta format detected" << endl;
             readFasta(filename, sequence_type);
@@ -849,7 +972,7 @@ Alignment::Alignment(char *filename, char *sequence_type, InputType &intype, str
 
 }
 
-Alignment::Alignment(NxsDataBlock *data_block, char *sequence_type, string model) : vector<Pattern>() {
+void Alignment::initNexusAlignment(char *sequence_type, string model) {
     name = "Noname";
     this->model_name = model;
     if (sequence_type)
@@ -863,11 +986,9 @@ Alignment::Alignment(NxsDataBlock *data_block, char *sequence_type, string model
     seq_type = SEQ_UNKNOWN;
     STATE_UNKNOWN = 126;
     pars_lower_bound = NULL;
-    
-    extractDataBlock(data_block);
-    if (verbose_mode >= VB_DEBUG)
-        data_block->Report(cout);
+}
 
+void Alignment::finishNexusAlignment() {
     if (getNSeq() < 3)
         outError("Alignment must have at least 3 sequences");
     
@@ -898,7 +1019,30 @@ Alignment::Alignment(NxsDataBlock *data_block, char *sequence_type, string model
     //cout << "Number of character states is " << num_states << endl;
     //cout << "Number of patterns = " << size() << endl;
     //cout << "Fraction of constant sites: " << frac_const_sites << endl;
+}
+
+Alignment::Alignment(NxsDataBlock *data_block, char *sequence_type, string model) : vector<Pattern>() {
+    initNexusAlignment(sequence_type, model);
     
+    extractDataBlock(data_block);
+    if (verbose_mode >= VB_DEBUG)
+        data_block->Report(cout);
+
+    finishNexusAlignment();
+}
+
+Alignment::Alignment(NexusScanner &scanner, char *sequence_type, string model) : vector<Pattern>() {
+    initNexusAlignment(sequence_type, model);
+
+    try {
+        extractNexusMatrix(scanner, sequence_type);
+    } catch (const char *str) {
+        outError(str);
+    } catch (string str) {
+        outError(str);
+    }
+
+    finishNexusAlignment();
 }
 
 Alignment::Alignment(StrVector& names, StrVector& seqs, char *sequence_type, string model) : vector<Pattern>() {
@@ -1061,6 +1205,28 @@ int Alignment::readNexus(char *filename) {
     return 1;
 }
 
+int Alignment::readNexusFast(char *filename, char *sequence_type) {
+    NexusScanner scanner(filename);
+    if (!scanner.scan() || !scanner.has_matrix) {
+        if (verbose_mode >= VB_MED)
+            cout << "Reading NEXUS file with NCL (" << (scanner.unsupported.empty() ? "no matrix found" : scanner.unsupported) << ")" << endl;
+        return 0;
+    }
+    return extractNexusMatrix(scanner, sequence_type);
+}
+
+int Alignment::extractNexusMatrix(NexusScanner &scanner, char *sequence_type) {
+    // without -st, the DATATYPE of the matrix decides the sequence type like in extractDataBlock()
+    char seq_type_dna[] = "DNA";
+    char seq_type_aa[] = "AA";
+    if (!sequence_type)
+        sequence_type = (scanner.datatype == "PROTEIN") ? seq_type_aa : seq_type_dna;
+    int nseq = scanner.sequences.size();
+    int nsite = scanner.sequences[0].length();
+    seq_names.swap(scanner.seq_names);
+    return buildPattern(scanner.sequences, sequence_type, nseq, nsite);
+}
+
 void Alignment::computeUnknownState() {
     switch (seq_type) {
     case SEQ_DNA: STATE_UNKNOWN = 18; break;
@@ -1437,18 +1603,17 @@ bool Alignment::addPatternLazy(Pattern &pat, int site, int freq, bool& gaps_only
             cout << "Site " << site << " contains only gaps or ambiguous characters" << endl;
         }
     }
-    PatternIntMap::iterator pat_it = pattern_index.find(pat);
-    if (pat_it == pattern_index.end()) { // not found
+    int index = pattern_index.find(*this, pat);
+    if (index < 0) { // not found
         pat.frequency = freq;
         //We don't do computeConst(pat); here, that's why
         //there's a "Lazy" in this member function's name!
         //We do that in addPattern...
         push_back(pat);
-        pattern_index[back()] = size()-1;
+        pattern_index.insert(*this, size()-1);
         site_pattern[site] = size()-1;
         return true;
     } else {
-        int index = pat_it->second;
         at(index).frequency += freq;
         site_pattern[site] = index;
         return false;
@@ -1578,6 +1743,26 @@ void Alignment::orderPatternByNumChars(int pat_type) {
     delete [] ptn_order;
     delete [] num_chars;
 //    cout << ordered_pattern.size() << " ordered_pattern" << endl;
+    buildOrderedTipStates();
+}
+
+void Alignment::buildOrderedTipStates() {
+    ordered_tip_states.clear();
+    size_t nptn = ordered_pattern.size();
+    size_t nseq = getNSeq();
+    for (auto &pat : ordered_pattern)
+        for (auto state : pat)
+            if (state > UINT8_MAX)
+                return;
+    ordered_tip_states.resize(nseq*nptn);
+    for (size_t ptn = 0; ptn < nptn; ptn++) {
+        Pattern &pat = ordered_pattern[ptn];
+        for (size_t seq = 0; seq < nseq; seq++)
+            ordered_tip_states[seq*nptn + ptn] = pat[seq];
+        // ordered_tip_states is now the only copy of the states
+        pat.clear();
+        pat.shrink_to_fit();
+    }
 }
 
 void Alignment::ungroupSitePattern()
@@ -4572,7 +4757,8 @@ void Alignment::generateUninfPatterns(StateType repeat, vector<StateType> &singl
     }
 }
 
-void Alignment::getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &unobserved_ptns) {
+void Alignment::getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &unobserved_ptns, IntVector &ptn_layout) {
+    ptn_layout.clear();
     switch (ASC_type) {
         case ASC_NONE: break;
         case ASC_VARIANT: {
@@ -4582,7 +4768,7 @@ void Alignment::getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &un
                 if (!isStopCodon(state)) {
                     Pattern pat;
                     pat.resize(getNSeq(), state);
-                    if (pattern_index.find(pat) == pattern_index.end()) {
+                    if (pattern_index.find(*this, pat) < 0) {
                         // constant pattern is unobserved
                         unobserved_ptns.push_back(pat);
                     }
@@ -4591,25 +4777,34 @@ void Alignment::getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &un
             break;
         }
         case ASC_VARIANT_MISSING: {
-            // Holder's correction for variant sites with missing data
+            // Holder's correction for variant sites with missing data:
+            // the constant patterns only depend on which sequences are observed,
+            // so patterns sharing the same missing-data layout share them
             size_t orig_nptn = getNPattern();
-            size_t max_orig_nptn = get_safe_upper_limit(orig_nptn);
-            unobserved_ptns.reserve(max_orig_nptn*num_states);
             int nseq = getNSeq();
+            PatternIndex layout_index;
+            vector<Pattern> layouts;
+            ptn_layout.resize(orig_nptn);
+            for (size_t ptn = 0; ptn < orig_nptn; ptn++) {
+                Pattern layout;
+                layout.reserve(nseq);
+                for (auto state_ptn: at(ptn))
+                    layout.push_back(state_ptn < num_states ? 0 : STATE_UNKNOWN);
+                int index = layout_index.find(layouts, layout);
+                if (index < 0) {
+                    ptn_layout[ptn] = layouts.size();
+                    layouts.push_back(layout);
+                    layout_index.insert(layouts, layouts.size()-1);
+                } else
+                    ptn_layout[ptn] = index;
+            }
+            unobserved_ptns.reserve(layouts.size()*num_states);
             for (StateType state = 0; state < num_states; state++)
-                for (size_t ptn = 0; ptn < max_orig_nptn; ptn++) {
-                    Pattern new_ptn;
-                    if (ptn < orig_nptn) {
-                        new_ptn.reserve(nseq);
-                        for (auto state_ptn: at(ptn)) {
-                            if (state_ptn < num_states)
-                                new_ptn.push_back(state);
-                            else
-                                new_ptn.push_back(STATE_UNKNOWN);
-                        }
-                    } else
-                        new_ptn.resize(nseq, STATE_UNKNOWN);
-                    unobserved_ptns.push_back(new_ptn);
+                for (auto layout : layouts) {
+                    for (auto &state_ptn : layout)
+                        if (state_ptn != STATE_UNKNOWN)
+                            state_ptn = state;
+                    unobserved_ptns.push_back(layout);
                 }
             break;
         }
@@ -5639,6 +5834,65 @@ std::ostream& operator<<(std::ostream& stream, const SymTestResult& res) {
     return stream;
 }
 
+/**
+    compute the matched-pair tests of symmetry for one pair of sequences
+    @param pair_freq divergence matrix of the pair
+    @param num_states number of states
+    @param[out] stat test statistics, a NaN p-value marks a test that is not applicable
+*/
+static void computeSymTestStat(MatrixXd &pair_freq, int num_states, SymTestStat &stat) {
+    // performing test of symmetry
+    int i, j;
+    stat.pval_sym = nan("");
+    stat.pval_marsym = nan("");
+    stat.pval_intsym = nan("");
+
+    int df_sym = num_states*(num_states-1)/2;
+    bool applicable = true;
+    MatrixXd sum = (pair_freq + pair_freq.transpose());
+    ArrayXXd res = (pair_freq - pair_freq.transpose()).array().square() / sum.array();
+
+    for (i = 0; i < num_states; i++)
+        for (j = i+1; j < num_states; j++) {
+            if (!std::isnan(res(i,j))) {
+                stat.chi2_sym += res(i,j);
+            } else {
+                if (Params::getInstance().symtest_keep_zero)
+                    applicable = false;
+                df_sym--;
+            }
+        }
+    if (df_sym == 0)
+        applicable = false;
+
+    if (applicable)
+        stat.pval_sym = chi2prob(df_sym, stat.chi2_sym);
+
+    // performing test of marginal symmetry
+    VectorXd row_sum = pair_freq.rowwise().sum().head(num_states-1);
+    VectorXd col_sum = pair_freq.colwise().sum().head(num_states-1);
+    VectorXd U = (row_sum - col_sum);
+    MatrixXd V = (row_sum + col_sum).asDiagonal();
+    V -= sum.topLeftCorner(num_states-1, num_states-1);
+
+    FullPivLU<MatrixXd> lu(V);
+
+    if (lu.isInvertible()) {
+        stat.chi2_marsym = U.transpose() * lu.inverse() * U;
+        int df_marsym = num_states-1;
+        stat.pval_marsym = chi2prob(df_marsym, stat.chi2_marsym);
+
+        // internal symmetry
+        stat.chi2_intsym = stat.chi2_sym - stat.chi2_marsym;
+        int df_intsym = df_sym - df_marsym;
+        if (df_intsym > 0 && applicable)
+            stat.pval_intsym = chi2prob(df_intsym, stat.chi2_intsym);
+    }
+}
+
+/** number of sequence pairs whose statistics are kept in memory at once by doSymTest */
+const size_t SYMTEST_PAIR_BLOCK = 1 << 16;
+
 void Alignment::doSymTest(size_t vecid, vector<SymTestResult> &vec_sym, vector<SymTestResult> &vec_marsym,
                        vector<SymTestResult> &vec_intsym, int *rstream, vector<SymTestStat> *stats)
 {
@@ -5654,72 +5908,105 @@ void Alignment::doSymTest(size_t vecid, vector<SymTestResult> &vec_sym, vector<S
     marsym.pvalue_maxdiv = 1.0;
     intsym.pvalue_maxdiv = 1.0;
     
-    vector<Pattern> ptn_shuffled;
-    
+    // states of each sequence, sequence-major: the patterns weighted by their
+    // frequencies, or the randomly shuffled alignment columns
+    size_t ncol = rstream ? getNSite() : getNPattern();
+    vector<StateType> seq_states(nseq*ncol);
+    IntVector col_freq(ncol, 1);
     if (rstream) {
-        // random shuffle alignment columns
-        int nsite = getNSite();
-        for (int site = 0; site < nsite; site++) {
+        for (size_t site = 0; site < ncol; site++) {
             Pattern ptn = getPattern(site);
             my_random_shuffle(ptn.begin(), ptn.end(), rstream);
-            ptn_shuffled.push_back(ptn);
+            for (size_t seq = 0; seq < nseq; seq++)
+                seq_states[seq*ncol + site] = ptn[seq];
         }
+    } else {
+        for (size_t ptn = 0; ptn < ncol; ptn++) {
+            for (size_t seq = 0; seq < nseq; seq++)
+                seq_states[seq*ncol + ptn] = at(ptn)[seq];
+            col_freq[ptn] = at(ptn).frequency;
+        }
+    }
+
+    // for few states, count pairs on bit-sliced sequences with one bit per site
+    bool bit_sliced = (num_states <= PAIR_COUNT_BITSLICE_STATES);
+    size_t nwords = 0;
+    vector<uint64_t> seq_bits;
+    if (bit_sliced) {
+        size_t nsite = 0;
+        for (auto freq : col_freq)
+            nsite += freq;
+        nwords = (nsite + 63) / 64;
+        seq_bits.resize(nseq*num_states*nwords, 0);
+        for (size_t seq = 0; seq < nseq; seq++) {
+            uint64_t *bits = &seq_bits[seq*num_states*nwords];
+            size_t site = 0;
+            for (size_t col = 0; col < ncol; col++) {
+                StateType state = seq_states[seq*ncol + col];
+                for (int k = 0; k < col_freq[col]; k++, site++)
+                    if (state < num_states)
+                        bits[state*nwords + site/64] |= (uint64_t)1 << (site%64);
+            }
+        }
+        seq_states.clear();
+        seq_states.shrink_to_fit();
     }
+
     if (stats)
     {
         stats->reserve(nseq*(nseq-1)/2);
     }
     double max_divergence = 0.0;
-    
-    for (int seq1 = 0; seq1 < nseq; seq1++) {
-        for (int seq2 = seq1+1; seq2 < nseq; seq2++) {
-            MatrixXd pair_freq = MatrixXd::Zero(num_states, num_states);
-            if (rstream) {
-                for (auto it = ptn_shuffled.begin(); it != ptn_shuffled.end(); it++)
-                    if (it->at(seq1) < num_states && it->at(seq2) < num_states)
-                        pair_freq(it->at(seq1), it->at(seq2))++;
 
-            } else {
-                for (auto it = begin(); it != end(); it++) {
-                    if (it->at(seq1) < num_states && it->at(seq2) < num_states)
-                        pair_freq(it->at(seq1), it->at(seq2)) += it->frequency;
+    // pairs are computed in parallel in blocks of rows, then summarized in the
+    // original pair order so that results do not depend on the number of threads
+    vector<SymTestStat> block_stat;
+    DoubleVector block_div;
+    for (size_t first_seq = 0; first_seq < nseq; ) {
+        size_t last_seq = first_seq;
+        size_t npairs = 0;
+        vector<size_t> row_offset;
+        while (last_seq < nseq && (npairs == 0 || npairs + nseq-last_seq-1 <= SYMTEST_PAIR_BLOCK)) {
+            row_offset.push_back(npairs);
+            npairs += nseq-last_seq-1;
+            last_seq++;
+        }
+        block_stat.assign(npairs, SymTestStat());
+        block_div.resize(npairs);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (size_t seq1 = first_seq; seq1 < last_seq; seq1++) {
+            MatrixXd pair_freq(num_states, num_states);
+            for (size_t seq2 = seq1+1; seq2 < nseq; seq2++) {
+                pair_freq.setZero();
+                if (bit_sliced) {
+                    countStatePairs(&seq_bits[seq1*num_states*nwords], &seq_bits[seq2*num_states*nwords],
+                                    num_states, nwords, pair_freq.data());
+                    // countStatePairs fills row-major, Eigen is column-major
+                    pair_freq.transposeInPlace();
+                } else {
+                    const StateType *states1 = &seq_states[seq1*ncol];
+                    const StateType *states2 = &seq_states[seq2*ncol];
+                    for (size_t col = 0; col < ncol; col++)
+                        if (states1[col] < num_states && states2[col] < num_states)
+                            pair_freq(states1[col], states2[col]) += col_freq[col];
                 }
+                size_t pair = row_offset[seq1-first_seq] + seq2-seq1-1;
+                // 2020-06-03: Bug fix found by Peter Foster
+                double sum_elems = pair_freq.sum();
+                block_div[pair] = (sum_elems == 0.0) ? 0.0 : (sum_elems - pair_freq.diagonal().sum()) / sum_elems;
+                SymTestStat &stat = block_stat[pair];
+                stat.seq1 = seq1;
+                stat.seq2 = seq2;
+                computeSymTestStat(pair_freq, num_states, stat);
             }
-            
-            // 2020-06-03: Bug fix found by Peter Foster
-            double sum_elems = pair_freq.sum();
-            double divergence = (sum_elems == 0.0) ? 0.0 : (sum_elems - pair_freq.diagonal().sum()) / sum_elems;
-            
-            // performing test of symmetry
-            int i, j;
-            
-            SymTestStat stat;
-            stat.seq1 = seq1;
-            stat.seq2 = seq2;
-            stat.pval_sym = nan("");
-            stat.pval_marsym = nan("");
-            stat.pval_intsym = nan("");
-            
-            int df_sym = num_states*(num_states-1)/2;
-            bool applicable = true;
-            MatrixXd sum = (pair_freq + pair_freq.transpose());
-            ArrayXXd res = (pair_freq - pair_freq.transpose()).array().square() / sum.array();
+        }
 
-            for (i = 0; i < num_states; i++)
-                for (j = i+1; j < num_states; j++) {
-                    if (!std::isnan(res(i,j))) {
-                        stat.chi2_sym += res(i,j);
-                    } else {
-                        if (Params::getInstance().symtest_keep_zero)
-                            applicable = false;
-                        df_sym--;
-                    }
-                }
-            if (df_sym == 0)
-                applicable = false;
-            
-            if (applicable) {
-                stat.pval_sym = chi2prob(df_sym, stat.chi2_sym);
+        for (size_t pair = 0; pair < npairs; pair++) {
+            SymTestStat &stat = block_stat[pair];
+            double divergence = block_div[pair];
+            if (!std::isnan(stat.pval_sym)) {
                 if (stat.pval_sym < chi2_cutoff)
                     sym.significant_pairs++;
                 sym.included_pairs++;
@@ -5728,31 +6015,13 @@ void Alignment::doSymTest(size_t vecid, vector<SymTestResult> &vec_sym, vector<S
             } else {
                 sym.excluded_pairs++;
             }
-
-            // performing test of marginal symmetry
-            VectorXd row_sum = pair_freq.rowwise().sum().head(num_states-1);
-            VectorXd col_sum = pair_freq.colwise().sum().head(num_states-1);
-            VectorXd U = (row_sum - col_sum);
-            MatrixXd V = (row_sum + col_sum).asDiagonal();
-            V -= sum.topLeftCorner(num_states-1, num_states-1);
-                
-            FullPivLU<MatrixXd> lu(V);
-
-            if (lu.isInvertible()) {
-                stat.chi2_marsym = U.transpose() * lu.inverse() * U;
-                int df_marsym = num_states-1;
-                stat.pval_marsym = chi2prob(df_marsym, stat.chi2_marsym);
+            if (!std::isnan(stat.pval_marsym)) {
                 if (stat.pval_marsym < chi2_cutoff)
                     marsym.significant_pairs++;
                 marsym.included_pairs++;
                 if (marsym.max_stat < stat.chi2_marsym)
                     marsym.max_stat = stat.chi2_marsym;
-
-                // internal symmetry
-                stat.chi2_intsym = stat.chi2_sym - stat.chi2_marsym;
-                int df_intsym = df_sym - df_marsym;
-                if (df_intsym > 0 && applicable) {
-                    stat.pval_intsym = chi2prob(df_intsym, stat.chi2_intsym);
+                if (!std::isnan(stat.pval_intsym)) {
                     if (stat.pval_intsym < chi2_cutoff)
                         intsym.significant_pairs++;
                     intsym.included_pairs++;
@@ -5777,6 +6046,7 @@ void Alignment::doSymTest(size_t vecid, vector<SymTestResult> &vec_sym, vector<S
                 marsym.pvalue_maxdiv = stat.pval_marsym;
             }
         }
+        first_seq = last_seq;
     }
     sym.computePvalue();
     marsym.computePvalue();
@@ -5891,11 +6161,10 @@ void Alignment::multinomialProb(Alignment refAlign, double &prob)
     double fac = logFac(nsite);
     int index;
     for ( iterator it = begin(); it != end() ; it++) {
-        PatternIntMap::iterator pat_it = refAlign.pattern_index.find((*it));
-        if ( pat_it == refAlign.pattern_index.end() ) //not found ==> error
+        index = refAlign.pattern_index.find(refAlign, (*it));
+        if ( index < 0 ) //not found ==> error
             outError("Pattern in the current alignment is not found in the reference alignment!");
         sumFac += logFac((*it).frequency);
-        index = pat_it->second;
         sumProb += (double)(*it).frequency*log((double)refAlign.at(index).frequency/(double)nsite);
     }
     prob = fac - sumFac + sumProb;
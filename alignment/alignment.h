@@ -16,6 +16,7 @@
 #include <vector>
 #include <bitset>
 #include "pattern.h"
+#include "patternindex.h"
 #include "ncl/ncl.h"
 
 const double MIN_FREQUENCY          = 0.0001;
@@ -24,6 +25,9 @@ const double MIN_FREQUENCY_DIFF     = 0.00001;
 const int NUM_CHAR = 256;
 typedef bitset<NUM_CHAR> StateBitset;
 
+class NexusScanner;
+class progress_display;
+
 /** class storing results of symmetry tests */
 class SymTestResult {
 public:
@@ -70,20 +74,6 @@ public:
 
 std::ostream& operator<< (std::ostream& stream, const SymTestResult& res);
 
-#ifdef USE_HASH_MAP
-struct hashPattern {
-    size_t operator()(const vector<StateType> &sp) const {
-        size_t sum = 0;
-        for (Pattern::const_iterator it = sp.begin(); it != sp.end(); it++)
-            sum = (*it) + (sum << 6) + (sum << 16) - sum;
-        return sum;
-    }
-};
-typedef unordered_map<vector<StateType>, int, hashPattern> PatternIntMap;
-#else
-typedef map<vector<StateType>, int> PatternIntMap;
-#endif
-
 
 constexpr int EXCLUDE_GAP   = 1; // exclude gaps
 constexpr int EXCLUDE_INVAR = 2; // exclude invariant sites
@@ -120,6 +110,13 @@ public:
      */
     Alignment(NxsDataBlock *data_block, char *sequence_type, string model);
 
+    /**
+     constructor
+     @param scanner NEXUS file read by NexusScanner, containing a matrix
+     @param sequence_type type of the sequence, either "BIN", "DNA", "AA", or NULL
+     */
+    Alignment(NexusScanner &scanner, char *sequence_type, string model);
+
     /**
      constructor
      @param names names of sequences
@@ -207,6 +204,22 @@ public:
      */
     int readNexus(char *filename);
 
+    /**
+            read the alignment in NEXUS format without NCL, for DNA/RNA/protein
+            DATA or CHARACTERS matrices without ambiguity sets or custom symbols
+            @param filename file name
+            @param sequence_type type of the sequence, either "BIN", "DNA", "AA", or NULL
+            @return 1 on success, 0 if the file has to be read by readNexus()
+     */
+    int readNexusFast(char *filename, char *sequence_type);
+
+    /**
+            build patterns from the matrix of a NEXUS file, called by readNexusFast()
+            @param scanner NEXUS file read by NexusScanner
+            @param sequence_type type of the sequence, NULL to take it from the DATATYPE of the matrix
+     */
+    int extractNexusMatrix(NexusScanner &scanner, char *sequence_type);
+
     int buildPattern(StrVector &sequences, char *sequence_type, int nseq, int nsite);
     
     /**
@@ -310,6 +323,19 @@ public:
      */
     int readMSF(char *filename, char *sequence_type);
 
+    /**
+            initialise members, shared by the constructors from a NEXUS data block or NexusScanner
+            @param sequence_type type of the sequence, either "BIN", "DNA", "AA", or NULL
+            @param model model name
+     */
+    void initNexusAlignment(char *sequence_type, string model);
+
+    /**
+            check the number of sequences, count constant sites and check sequence names
+            after the matrix of a NEXUS data block or NexusScanner was extracted
+     */
+    void finishNexusAlignment();
+
     /**
             extract the alignment from a nexus data block, called by readNexus()
             @param data_block data block of nexus file
@@ -325,7 +351,32 @@ public:
     void extractSequences(char *filename, char *sequence_type, StrVector &sequences, int &nseq, int &nsite);
 
 
+    /**
+        patterns ordered by number of characters, for parsimony. The states are moved into
+        ordered_tip_states, the patterns keep frequency and counts; read states by getOrderedTipState
+    */
     vector<Pattern> ordered_pattern;
+
+    /**
+        states of ordered_pattern in one contiguous block of one byte per state, sequence-major
+        so that the tip states of a sequence are adjacent; empty if some state needs more than a byte,
+        then ordered_pattern keeps its states
+    */
+    vector<uint8_t> ordered_tip_states;
+
+    /** move the states of ordered_pattern into ordered_tip_states */
+    void buildOrderedTipStates();
+
+    /**
+        @param seq sequence index
+        @param ptn index in ordered_pattern
+        @return state of the sequence in the ordered pattern
+    */
+    inline StateType getOrderedTipState(int seq, size_t ptn) const {
+        if (ordered_tip_states.empty())
+            return ordered_pattern[ptn][seq];
+        return ordered_tip_states[seq*ordered_pattern.size() + ptn];
+    }
     
     /** lower bound of sum parsimony scores for remaining pattern in ordered_pattern */
     UINT *pars_lower_bound;
@@ -511,12 +562,49 @@ public:
      */
     void checkSeqName();
 
+    /**
+     * compute a hash value for each sequence, identical sequences have the same hash
+     * @param[out] hashes hash value of each sequence
+     */
+    virtual void computeSeqHashes(vector<size_t> &hashes);
+
+    /**
+     * @return TRUE if seq1 and seq2 are identical
+     */
+    virtual bool isIdenticalSeq(int seq1, int seq2);
+
+    /**
+     * group identical sequences: sequences are bucketed by their hash values and
+     * only compared within a bucket
+     * @param[out] groups groups of identical sequences, each in increasing order, ordered by their first sequence
+     * @param[out] seq_group group index of each sequence
+     * @param progress progress display advanced by the number of sequences, NULL if none
+     */
+    void groupIdenticalSeq(vector<IntVector> &groups, IntVector &seq_group, progress_display *progress = NULL);
+
     /**
      * check identical sequences
      * @return the number of sequences that are identical to one of the sequences
      */
     int checkIdenticalSeq();
 
+    /**
+     * find identical sequences to be removed, see removeIdenticalSeq()
+     * @param[out] removed TRUE for each sequence to be removed
+     */
+    void findIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs,
+                          vector<bool> &removed);
+
+    /**
+     * find near-identical sequences to be removed: those that agree with a kept sequence
+     * with fewer gaps/ambiguous characters at all their unambiguous sites
+     * @param not_remove name of sequence where removal is avoided
+     * @param removed_seqs (IN/OUT) name of removed sequences
+     * @param target_seqs (IN/OUT) corresponding name of kept sequence next to which the removed sequences are re-inserted
+     * @param removed (IN/OUT) TRUE for each sequence to be removed
+     */
+    void findNearIdenticalSeq(string not_remove, StrVector &removed_seqs, StrVector &target_seqs, vector<bool> &removed);
+
     /**
      * remove identical sequences from alignment
      * @param not_remove name of sequence where removal is avoided
@@ -854,8 +942,10 @@ public:
     /**
      * @param missing_data TRUE for missing data aware correction (for Mark Holder)
      * @param[out] unobserved_ptns unobserved constant patterns, each entry encoding for one constant character
+     * @param[out] ptn_layout for Holder's correction: index of the missing-data layout of each pattern;
+     *             unobserved_ptns then holds one block of layouts per state
      */
-    void getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &unobserved_ptns);
+    void getUnobservedConstPatterns(ASCType ASC_type, vector<Pattern> &unobserved_ptns, IntVector &ptn_layout);
 
     /**
             @return the number of ungappy and unambiguous characters from a sequence
@@ -1083,9 +1173,9 @@ protected:
     IntVector site_pattern;
 
     /**
-            hash map from pattern to index in the vector of patterns (the alignment)
+            hash index from pattern to index in the vector of patterns (the alignment)
      */
-    PatternIntMap pattern_index;
+    PatternIndex pattern_index;
     
     /**
             alisim: caching ntfreq if it has already randomly initialized
@@ -0,0 +1,392 @@
+//
+//  nexusscanner.cpp
+//  alignment
+//
+
+#include "nexusscanner.h"
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+/** NEXUS punctuation, each forms a token of its own */
+static const char *NEXUS_PUNCTUATION = "()[]{}/\\,;:=*\"`+-<>";
+
+static bool isNexusPunctuation(int ch) {
+    return ch != 0 && strchr(NEXUS_PUNCTUATION, ch) != NULL;
+}
+
+static bool equalsNoCase(const string &str, const char *other) {
+    if (str.length() != strlen(other))
+        return false;
+    for (size_t i = 0; i < str.length(); i++)
+        if (toupper(str[i]) != toupper(other[i]))
+            return false;
+    return true;
+}
+
+NexusScanner::NexusScanner(const char *filename) {
+    has_matrix = false;
+    has_sets = false;
+    in_sets = false;
+    last_quoted = false;
+    ntax_taxa = 0;
+    interleave = false;
+    gap_char = '-';
+    missing_char = '?';
+    match_char = 0;
+    in.open(filename);
+    if (!in.good())
+        outError(ERR_READ_INPUT, filename);
+}
+
+int NexusScanner::getChar() {
+    int ch = in.get();
+    if (ch == EOF)
+        return EOF;
+    if (in_sets)
+        sets_text += (char)ch;
+    else if (ch == '\n')
+        sets_text += '\n';
+    return ch;
+}
+
+void NexusScanner::skipComment() {
+    int depth = 1;
+    int ch;
+    while (depth > 0 && (ch = getChar()) != EOF) {
+        if (ch == '[')
+            depth++;
+        else if (ch == ']')
+            depth--;
+    }
+}
+
+int NexusScanner::skipSpace() {
+    int ch;
+    while ((ch = in.peek()) != EOF) {
+        if (ch == '[') {
+            getChar();
+            skipComment();
+        } else if (isspace(ch))
+            getChar();
+        else
+            break;
+    }
+    return ch;
+}
+
+bool NexusScanner::nextToken(string &token) {
+    token.clear();
+    last_quoted = false;
+    int ch = skipSpace();
+    if (ch == EOF)
+        return false;
+    getChar();
+    if (ch == '\'') {
+        // quoted word, '' stands for a single quote
+        last_quoted = true;
+        while ((ch = getChar()) != EOF) {
+            if (ch == '\'') {
+                if (in.peek() != '\'')
+                    break;
+                getChar();
+            }
+            token += (char)ch;
+        }
+        return true;
+    }
+    token += (char)ch;
+    if (isNexusPunctuation(ch))
+        return true;
+    while ((ch = in.peek()) != EOF && !isspace(ch) && !isNexusPunctuation(ch) && ch != '\'') {
+        token += (char)ch;
+        getChar();
+    }
+    return true;
+}
+
+bool NexusScanner::expectToken(const char *expected) {
+    string token;
+    return nextToken(token) && equalsNoCase(token, expected);
+}
+
+bool NexusScanner::skipCommand() {
+    string token;
+    while (nextToken(token))
+        if (token == ";" && !last_quoted)
+            return true;
+    return false;
+}
+
+bool NexusScanner::skipBlock() {
+    string token;
+    while (nextToken(token)) {
+        if (equalsNoCase(token, "END") || equalsNoCase(token, "ENDBLOCK"))
+            return skipCommand();
+        if (token == ";" && !last_quoted)
+            continue;
+        if (!skipCommand())
+            return false;
+    }
+    return false;
+}
+
+bool NexusScanner::scan(bool read_matrix) {
+    string token;
+    if (!nextToken(token) || !equalsNoCase(token, "#NEXUS"))
+        return fail("missing #NEXUS header");
+    // line 1 of sets_text stands for the header line
+    sets_text = "#NEXUS";
+    while (nextToken(token)) {
+        if (!equalsNoCase(token, "BEGIN")) {
+            // commands between blocks
+            if (token != ";" && !skipCommand())
+                return fail("unterminated command " + token);
+            continue;
+        }
+        string block;
+        if (!nextToken(block))
+            return fail("unexpected end of file");
+        if (equalsNoCase(block, "SETS")) {
+            has_sets = true;
+            if (!readSetsBlock())
+                return fail("unterminated SETS block");
+        } else if (read_matrix && (equalsNoCase(block, "DATA") || equalsNoCase(block, "CHARACTERS"))) {
+            if (has_matrix)
+                return fail("more than one DATA/CHARACTERS block");
+            if (!expectToken(";") || !readDataBlock())
+                return false;
+        } else if (read_matrix && equalsNoCase(block, "TAXA")) {
+            if (!expectToken(";") || !readTaxaBlock())
+                return false;
+        } else {
+            if (verbose_mode >= VB_MED)
+                cout << "Skipping " << block << " block..." << endl;
+            if (!skipCommand() || !skipBlock())
+                return fail("unterminated " + block + " block");
+        }
+    }
+    if (!has_matrix || taxlabels.empty())
+        return true;
+
+    // rows follow TAXLABELS order, as with NCL
+    if (taxlabels.size() != seq_names.size())
+        return fail("TAXLABELS differ from matrix rows");
+    unordered_map<string, int> row_index;
+    for (int i = 0; i < seq_names.size(); i++)
+        row_index[seq_names[i]] = i;
+    StrVector ordered;
+    for (auto name : taxlabels) {
+        auto it = row_index.find(name);
+        if (it == row_index.end())
+            return fail("taxon " + name + " has no matrix row");
+        ordered.push_back(std::move(sequences[it->second]));
+    }
+    sequences.swap(ordered);
+    seq_names = taxlabels;
+    return true;
+}
+
+bool NexusScanner::readTaxaBlock() {
+    string token;
+    while (nextToken(token)) {
+        if (equalsNoCase(token, "END") || equalsNoCase(token, "ENDBLOCK"))
+            return skipCommand();
+        if (equalsNoCase(token, "DIMENSIONS")) {
+            int nchar = 0;
+            if (!readDimensions(ntax_taxa, nchar))
+                return false;
+        } else if (equalsNoCase(token, "TAXLABELS")) {
+            while (nextToken(token) && (token != ";" || last_quoted)) {
+                if (!last_quoted)
+                    replace(token.begin(), token.end(), '_', ' ');
+                taxlabels.push_back(token);
+            }
+        } else if (!skipCommand())
+            return fail("unterminated TAXA block");
+    }
+    return fail("unterminated TAXA block");
+}
+
+bool NexusScanner::readDataBlock() {
+    string token;
+    int ntax = ntax_taxa, nchar = 0;
+    while (nextToken(token)) {
+        if (equalsNoCase(token, "END") || equalsNoCase(token, "ENDBLOCK"))
+            return skipCommand();
+        if (equalsNoCase(token, "DIMENSIONS")) {
+            if (!readDimensions(ntax, nchar))
+                return false;
+        } else if (equalsNoCase(token, "FORMAT")) {
+            if (!readFormat())
+                return false;
+        } else if (equalsNoCase(token, "MATRIX")) {
+            if (ntax <= 0 || nchar <= 0)
+                return fail("MATRIX without NTAX/NCHAR");
+            if (!readMatrix(ntax, nchar))
+                return false;
+        } else if (equalsNoCase(token, "CHARLABELS") || equalsNoCase(token, "CHARSTATELABELS") ||
+                   equalsNoCase(token, "STATELABELS") || equalsNoCase(token, "TITLE") ||
+                   equalsNoCase(token, "LINK") || equalsNoCase(token, "OPTIONS")) {
+            // labels do not change the matrix
+            if (!skipCommand())
+                return fail("unterminated " + token + " command");
+        } else
+            return fail(token + " command in DATA block");
+    }
+    return fail("unterminated DATA block");
+}
+
+bool NexusScanner::readDimensions(int &ntax, int &nchar) {
+    string key, value;
+    while (nextToken(key) && key != ";") {
+        if (equalsNoCase(key, "NEWTAXA"))
+            continue;
+        if (!expectToken("=") || !nextToken(value))
+            return fail("invalid DIMENSIONS command");
+        if (equalsNoCase(key, "NTAX"))
+            ntax = convert_int(value.c_str());
+        else if (equalsNoCase(key, "NCHAR"))
+            nchar = convert_int(value.c_str());
+        else
+            return fail("DIMENSIONS " + key);
+    }
+    return true;
+}
+
+bool NexusScanner::readFormat() {
+    string key, value;
+    while (nextToken(key) && key != ";") {
+        if (equalsNoCase(key, "INTERLEAVE")) {
+            interleave = true;
+            if (skipSpace() == '=') {
+                nextToken(value);
+                nextToken(value);
+                interleave = !equalsNoCase(value, "NO");
+            }
+            continue;
+        }
+        if (!expectToken("=") || !nextToken(value))
+            return fail("invalid FORMAT command");
+        if (equalsNoCase(key, "DATATYPE")) {
+            for (auto &ch : value)
+                ch = toupper(ch);
+            datatype = value;
+            if (datatype != "DNA" && datatype != "RNA" && datatype != "NUCLEOTIDE" && datatype != "PROTEIN")
+                return fail("DATATYPE=" + datatype);
+        } else if (equalsNoCase(key, "GAP") && value.length() == 1) {
+            gap_char = value[0];
+        } else if (equalsNoCase(key, "MISSING") && value.length() == 1) {
+            missing_char = value[0];
+        } else if (equalsNoCase(key, "MATCHCHAR") && value.length() == 1) {
+            match_char = value[0];
+        } else {
+            // SYMBOLS, EQUATE, TRANSPOSE, TOKENS, ... are left to NCL
+            return fail("FORMAT " + key);
+        }
+    }
+    if (datatype.empty())
+        return fail("DATATYPE=STANDARD");
+    return true;
+}
+
+bool NexusScanner::readRowName(string &name) {
+    name.clear();
+    last_quoted = false;
+    int ch = skipSpace();
+    if (ch == EOF)
+        return false;
+    if (ch == ';') {
+        getChar();
+        return false;
+    }
+    if (ch == '\'')
+        return nextToken(name);
+    while ((ch = in.peek()) != EOF && !isspace(ch) && ch != '[') {
+        name += (char)ch;
+        getChar();
+    }
+    // NCL turns underscores of unquoted names into blanks
+    replace(name.begin(), name.end(), '_', ' ');
+    return true;
+}
+
+int NexusScanner::convertChar(int ch, string &row, size_t pos) {
+    if (ch == gap_char)
+        return '-';
+    if (ch == missing_char)
+        return '?';
+    if (match_char && ch == match_char) {
+        if (&row == &sequences[0] || pos >= sequences[0].length())
+            return -1;
+        return sequences[0][pos];
+    }
+    if (isalpha(ch) || ch == '-' || ch == '?' || ch == '*')
+        return toupper(ch);
+    // ambiguity sets {..} / (..) and anything else
+    return -1;
+}
+
+bool NexusScanner::readMatrix(int ntax, int nchar) {
+    if (datatype.empty())
+        return fail("DATATYPE=STANDARD");
+    seq_names.clear();
+    sequences.clear();
+    unordered_map<string, int> row_index;
+    string name;
+    while (readRowName(name)) {
+        int row_id;
+        auto it = row_index.find(name);
+        if (it == row_index.end()) {
+            if (!interleave && row_index.size() == ntax)
+                return fail("too many matrix rows");
+            row_id = seq_names.size();
+            row_index[name] = row_id;
+            seq_names.push_back(name);
+            sequences.push_back("");
+            sequences.back().reserve(nchar);
+        } else if (interleave) {
+            row_id = it->second;
+        } else
+            return fail("duplicated taxon " + name);
+        string &row = sequences[row_id];
+        while (true) {
+            int ch = in.peek();
+            if (ch == EOF)
+                return fail("unexpected end of matrix");
+            if (interleave && ch == '\n')
+                break;
+            if (!interleave && row.length() == nchar)
+                break;
+            getChar();
+            if (ch == '[') {
+                skipComment();
+                continue;
+            }
+            if (isspace(ch))
+                continue;
+            if (ch == ';')
+                return fail("matrix row " + name + " ends early");
+            int state = convertChar(ch, row, row.length());
+            if (state < 0)
+                return fail(string("matrix character ") + (char)ch);
+            row += (char)state;
+        }
+    }
+    if (seq_names.size() != ntax)
+        return fail("number of matrix rows differs from NTAX");
+    for (auto &row : sequences)
+        if (row.length() != nchar)
+            return fail("matrix row length differs from NCHAR");
+    has_matrix = true;
+    return true;
+}
+
+bool NexusScanner::readSetsBlock() {
+    // the block is copied verbatim into sets_text for MSetsBlock
+    sets_text += "begin sets";
+    in_sets = true;
+    bool ok = skipCommand() && skipBlock();
+    in_sets = false;
+    return ok;
+}
@@ -0,0 +1,122 @@
+//
+//  nexusscanner.h
+//  alignment
+//
+//  Streaming reader for the common subset of NEXUS used for large
+//  alignments: DNA/RNA/protein DATA or CHARACTERS matrices (sequential or
+//  interleaved) and SETS blocks. Files using other constructs are left to
+//  the NCL based readers.
+//
+
+#ifndef nexusscanner_h
+#define nexusscanner_h
+
+#include <string>
+#include "utils/tools.h"
+#include "utils/gzstream.h"
+
+class NexusScanner {
+public:
+    /**
+        open a NEXUS file (possibly gzipped)
+        @param filename file name
+    */
+    NexusScanner(const char *filename);
+
+    /**
+        read the whole file
+        @param read_matrix true to extract the DATA/CHARACTERS matrix,
+               false to skip those blocks like any other unknown block
+        @return true if the file only contains constructs handled here,
+                false if the caller should fall back to NCL (see unsupported)
+    */
+    bool scan(bool read_matrix = true);
+
+    /** true if a DATA/CHARACTERS matrix was read */
+    bool has_matrix;
+
+    /** true if the file has at least one SETS block */
+    bool has_sets;
+
+    /** taxon names, in TAXLABELS order if a TAXA block was given, otherwise in matrix order */
+    StrVector seq_names;
+
+    /** matrix rows with gap as '-', missing as '?' and match characters resolved */
+    StrVector sequences;
+
+    /** DATATYPE of the matrix in upper case */
+    string datatype;
+
+    /** "#NEXUS" followed by all SETS blocks, everything else reduced to its line breaks so that line numbers are kept */
+    string sets_text;
+
+    /** the construct that made scan() give up */
+    string unsupported;
+
+protected:
+
+    /** @return next character or EOF, copied to sets_text while inside a SETS block */
+    int getChar();
+
+    /** skip a (possibly nested) [...] comment, the '[' has been read */
+    void skipComment();
+
+    /** skip white space and comments, @return first other character (not consumed) or EOF */
+    int skipSpace();
+
+    /**
+        read the next NEXUS token: a word, a quoted string or a punctuation character
+        @param[out] token the token (quotes removed)
+        @return false at end of file
+    */
+    bool nextToken(string &token);
+
+    /** read the next token and compare it case-insensitively */
+    bool expectToken(const char *expected);
+
+    /** skip tokens up to and including the next ';' */
+    bool skipCommand();
+
+    /** skip tokens up to and including END; or ENDBLOCK; */
+    bool skipBlock();
+
+    bool readTaxaBlock();
+    bool readDataBlock();
+    bool readSetsBlock();
+    bool readDimensions(int &ntax, int &nchar);
+    bool readFormat();
+    bool readMatrix(int ntax, int nchar);
+
+    /** read a taxon name at the start of a matrix row, @return false at ';' */
+    bool readRowName(string &name);
+
+    /**
+        convert one matrix character
+        @return converted character, 0 to skip, -1 if unsupported
+    */
+    int convertChar(int ch, string &row, size_t pos);
+
+    /** record why the fast path does not apply */
+    bool fail(string reason) {
+        unsupported = reason;
+        return false;
+    }
+
+    igzstream in;
+
+    /** true while copying raw characters into sets_text */
+    bool in_sets;
+
+    /** true if the last token was quoted */
+    bool last_quoted;
+
+    int ntax_taxa;
+    StrVector taxlabels;
+
+    bool interleave;
+    char gap_char;
+    char missing_char;
+    char match_char;
+};
+
+#endif /* nexusscanner_h */
@@ -0,0 +1,80 @@
+//
+//  patternindex.cpp
+//  alignment
+//
+
+#include "patternindex.h"
+
+/** initial number of slots, must be a power of two */
+static const size_t PATTERN_INDEX_MIN_SLOTS = 1024;
+
+PatternIndex::PatternIndex() {
+    num_entries = 0;
+}
+
+void PatternIndex::clear() {
+    slots.clear();
+    slot_hash.clear();
+    num_entries = 0;
+}
+
+size_t PatternIndex::hashPattern(const vector<StateType> &pat) {
+    size_t sum = 0;
+    for (auto state : pat)
+        sum = state + (sum << 6) + (sum << 16) - sum;
+    // spread the high bits into the low bits that select the slot
+    sum ^= sum >> 29;
+    sum *= 0xbf58476d1ce4e5b9ULL;
+    sum ^= sum >> 32;
+    return sum;
+}
+
+int PatternIndex::find(const vector<Pattern> &patterns, const vector<StateType> &pat) const {
+    if (slots.empty())
+        return -1;
+    size_t hash = hashPattern(pat);
+    size_t mask = slots.size()-1;
+    // patterns beyond the end were dropped from the alignment without clearing the index
+    for (size_t slot = hash & mask; slots[slot] >= 0; slot = (slot+1) & mask)
+        if (slot_hash[slot] == hash && (size_t)slots[slot] < patterns.size() && patterns[slots[slot]] == pat)
+            return slots[slot];
+    return -1;
+}
+
+void PatternIndex::insert(const vector<Pattern> &patterns, int ptn) {
+    // keep the load factor at most 1/2
+    if ((num_entries+1)*2 > slots.size())
+        grow();
+    const Pattern &pat = patterns[ptn];
+    size_t hash = hashPattern(pat);
+    size_t mask = slots.size()-1;
+    size_t slot = hash & mask;
+    for (; slots[slot] >= 0; slot = (slot+1) & mask)
+        if (slot_hash[slot] == hash && (size_t)slots[slot] < patterns.size() && patterns[slots[slot]] == pat) {
+            slots[slot] = ptn;
+            return;
+        }
+    slots[slot] = ptn;
+    slot_hash[slot] = hash;
+    num_entries++;
+}
+
+void PatternIndex::grow() {
+    IntVector old_slots;
+    vector<size_t> old_hash;
+    old_slots.swap(slots);
+    old_hash.swap(slot_hash);
+    size_t nslot = max(PATTERN_INDEX_MIN_SLOTS, old_slots.size()*2);
+    slots.assign(nslot, -1);
+    slot_hash.assign(nslot, 0);
+    size_t mask = nslot-1;
+    for (size_t i = 0; i < old_slots.size(); i++) {
+        if (old_slots[i] < 0)
+            continue;
+        size_t slot = old_hash[i] & mask;
+        while (slots[slot] >= 0)
+            slot = (slot+1) & mask;
+        slots[slot] = old_slots[i];
+        slot_hash[slot] = old_hash[i];
+    }
+}
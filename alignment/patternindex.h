@@ -0,0 +1,61 @@
+//
+//  patternindex.h
+//  alignment
+//
+//  Open-addressing hash index from site patterns to their position in the
+//  alignment. Slots only hold pattern indices and cached hash values; keys
+//  are compared against the patterns stored in the alignment, so patterns
+//  are never copied into the index.
+//
+
+#ifndef patternindex_h
+#define patternindex_h
+
+#include "utils/tools.h"
+#include "pattern.h"
+
+class PatternIndex {
+public:
+    PatternIndex();
+
+    /** remove all entries */
+    void clear();
+
+    /** @return number of indexed patterns */
+    size_t size() const {
+        return num_entries;
+    }
+
+    /**
+        look up a pattern
+        @param patterns the patterns referred to by the index
+        @param pat pattern to look up
+        @return index of the pattern in patterns, -1 if not found
+    */
+    int find(const vector<Pattern> &patterns, const vector<StateType> &pat) const;
+
+    /**
+        index patterns[ptn], replacing an entry with the same states
+        @param patterns the patterns referred to by the index
+        @param ptn index of the pattern
+    */
+    void insert(const vector<Pattern> &patterns, int ptn);
+
+    /** @return hash value of a pattern */
+    static size_t hashPattern(const vector<StateType> &pat);
+
+protected:
+
+    /** double the number of slots, entries are re-distributed by their cached hashes */
+    void grow();
+
+    /** pattern index of each slot, -1 if empty, the number of slots is a power of two */
+    IntVector slots;
+
+    /** hash value of the pattern in each slot */
+    vector<size_t> slot_hash;
+
+    size_t num_entries;
+};
+
+#endif /* patternindex_h */
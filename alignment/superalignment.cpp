@@ -22,6 +22,7 @@
 #include "superalignment.h"
 #include "nclextra/msetsblock.h"
 #include "nclextra/myreader.h"
+#include "nexusscanner.h"
 #include "main/phylotesting.h"
 #include "utils/timeutil.h" //for getRealTime()
 
@@ -462,34 +463,52 @@ void SuperAlignment::readPartitionRaxml(Params &params) {
 void SuperAlignment::readPartitionNexus(Params &params) {
 //    Params origin_params = params;
     MSetsBlock *sets_block = new MSetsBlock();
-    NxsTaxaBlock *taxa_block = NULL;
-    NxsAssumptionsBlock *assumptions_block = NULL;
-    NxsDataBlock *data_block = NULL;
-    MyReader nexus(params.partition_file);
-    nexus.Add(sets_block);
-
-    if (!params.aln_file) {
-        taxa_block = new NxsTaxaBlock();
-        assumptions_block = new NxsAssumptionsBlock(taxa_block);
-        data_block = new NxsDataBlock(taxa_block, assumptions_block);
-        nexus.Add(taxa_block);
-        nexus.Add(assumptions_block);
-        nexus.Add(data_block);
-    }
-
-    MyToken token(nexus.inf);
-    nexus.Execute(token);
-    
     Alignment *input_aln = NULL;
-    if (params.aln_file) {
-        input_aln = createAlignment(params.aln_file, params.sequence_type, params.intype, params.model_name);
+
+    // the matrix is read directly, NCL only parses the extracted SETS blocks
+    NexusScanner scanner(params.partition_file);
+    if (scanner.scan(!params.aln_file)) {
+        MyReader nexus;
+        nexus.Add(sets_block);
+        istringstream sets_in(scanner.sets_text);
+        MyToken token(sets_in);
+        nexus.Execute(token);
+
+        if (params.aln_file)
+            input_aln = createAlignment(params.aln_file, params.sequence_type, params.intype, params.model_name);
+        else if (scanner.has_matrix)
+            input_aln = new Alignment(scanner, params.sequence_type, params.model_name);
     } else {
-        if (data_block->GetNTax() > 0) {
-            input_aln = new Alignment(data_block, params.sequence_type, params.model_name);
+        if (verbose_mode >= VB_MED)
+            cout << "Reading NEXUS file with NCL (" << scanner.unsupported << ")" << endl;
+        NxsTaxaBlock *taxa_block = NULL;
+        NxsAssumptionsBlock *assumptions_block = NULL;
+        NxsDataBlock *data_block = NULL;
+        MyReader nexus(params.partition_file);
+        nexus.Add(sets_block);
+
+        if (!params.aln_file) {
+            taxa_block = new NxsTaxaBlock();
+            assumptions_block = new NxsAssumptionsBlock(taxa_block);
+            data_block = new NxsDataBlock(taxa_block, assumptions_block);
+            nexus.Add(taxa_block);
+            nexus.Add(assumptions_block);
+            nexus.Add(data_block);
+        }
+
+        MyToken token(nexus.inf);
+        nexus.Execute(token);
+
+        if (params.aln_file) {
+            input_aln = createAlignment(params.aln_file, params.sequence_type, params.intype, params.model_name);
+        } else {
+            if (data_block->GetNTax() > 0) {
+                input_aln = new Alignment(data_block, params.sequence_type, params.model_name);
+            }
+            delete data_block;
+            delete assumptions_block;
+            delete taxa_block;
         }
-        delete data_block;
-        delete assumptions_block;
-        delete taxa_block;
     }
 
     // check if converted from DNA to AA
@@ -1033,27 +1052,18 @@ void SuperAlignment::removePartitions(set<int> &removed_id) {
     buildPattern();
 }
 
-Alignment *SuperAlignment::removeIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs) {
-    auto n = getNSeq();
-    IntVector checked;
-    vector<bool> removed;
-    checked.resize(n, 0);
-    removed.resize(n, false);
-    
-    //JB2020-06-23 Begin : Determine hashes for all the sequences
-    auto startHash = getRealTime();
-    vector<size_t> hashes;
-    hashes.resize(n, 0);
-    #ifdef USE_BOOST
+void SuperAlignment::computeSeqHashes(vector<size_t> &hashes) {
+    int n = getNSeq();
+    hashes.assign(n, 0);
     #ifdef _OPENMP
-        #pragma omp parallel for
+        #pragma omp parallel for schedule(dynamic, 100)
     #endif
     for (int seq1=0; seq1<n; ++seq1) {
         size_t hash = 0;
         int part = 0;
         for (auto ait = partitions.begin(); ait != partitions.end(); ait++, part++) {
             int  subseq1 = taxa_index[seq1][part];
-            bool present = ( 0 < subseq1 );
+            bool present = ( 0 <= subseq1 );
             adjustHash(present, hash);
             if (present) {
                 for (iterator it = (*ait)->begin(); it != (*ait)->end(); it++) {
@@ -1063,73 +1073,32 @@ Alignment *SuperAlignment::removeIdenticalSeq(string not_remove, bool keep_two,
         }
         hashes[seq1] = hash;
     }
-    if (verbose_mode >= VB_MED) {
-        auto hashTime = getRealTime() - startHash;
-        cout << "Hashing sequences took " << hashTime << " wall-clock seconds" << endl;
-    }
-    #endif
-    //JB2020-06-23 Finish
-
-    bool listIdentical = !Params::getInstance().suppress_duplicate_sequence_warnings;
+}
 
-    auto startCheck = getRealTime();
-	for (size_t seq1 = 0; seq1 < getNSeq(); ++seq1) {
-        if (checked[seq1]) continue;
-        bool first_ident_seq = true;
-		for (size_t seq2 = seq1+1; seq2 < getNSeq(); ++seq2) {
-            if (getSeqName(seq2) == not_remove || removed[seq2]) { continue;
-            }
-            if (hashes[seq1]!=hashes[seq2]) {
-                continue;
-            }
-			bool equal_seq = true;
-			int part = 0;
-			// check if seq1 and seq2 are identical over all partitions
-			for (vector<Alignment*>::iterator ait = partitions.begin(); ait != partitions.end(); ait++, part++) {
-				int subseq1 = taxa_index[seq1][part];
-				int subseq2 = taxa_index[seq2][part];
-				if (subseq1 < 0 && subseq2 < 0) // continue if both seqs are absent in this partition
-					continue;
-				if (subseq1 < 0 && subseq2 > 0) {
-					// if one sequence is present and the other is absent for a gene, we conclude that they are not identical
-					equal_seq = false;
-					break;
-				}
-				if (subseq1 > 0 && subseq2 < 0) {
-					// if one sequence is present and the other is absent for a gene, we conclude that they are not identical
-					equal_seq = false;
-					break;
-				}
-				// now if both seqs are present, check sequence content
-                for (iterator it = (*ait)->begin(); it != (*ait)->end(); it++) {
-					if  ((*it)[subseq1] != (*it)[subseq2]) {
-						equal_seq = false;
-						break;
-					}
-                }
-			}
-            if (!equal_seq) {
-                continue;
-            }
-            if (removed_seqs.size() + 3 < getNSeq() && (!keep_two || !first_ident_seq)) {
-                removed_seqs.push_back(getSeqName(seq2));
-                target_seqs.push_back(getSeqName(seq1));
-                removed[seq2] = true;
-            } else {
-                if (listIdentical) {
-                    cout << "NOTE: " << getSeqName(seq2) << " is identical to " << getSeqName(seq1)
-                        << " but kept for subsequent analysis" << endl;
-                }
-            }
-            checked[seq2] = 1;
-            first_ident_seq = false;
-		}
-		checked[seq1] = 1;
-	}
-    if (verbose_mode >= VB_MED) {
-        auto checkTime = getRealTime() - startCheck;
-        cout << "Checking for identical sequences took " << checkTime << " wall-clock seconds" << endl;
+bool SuperAlignment::isIdenticalSeq(int seq1, int seq2) {
+    int part = 0;
+    // check if seq1 and seq2 are identical over all partitions
+    for (vector<Alignment*>::iterator ait = partitions.begin(); ait != partitions.end(); ait++, part++) {
+        int subseq1 = taxa_index[seq1][part];
+        int subseq2 = taxa_index[seq2][part];
+        if (subseq1 < 0 && subseq2 < 0) // continue if both seqs are absent in this partition
+            continue;
+        if (subseq1 < 0 || subseq2 < 0) {
+            // if one sequence is present and the other is absent for a gene, we conclude that they are not identical
+            return false;
+        }
+        // now if both seqs are present, check sequence content
+        if (!(*ait)->isIdenticalSeq(subseq1, subseq2))
+            return false;
     }
+    return true;
+}
+
+Alignment *SuperAlignment::removeIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs) {
+    vector<bool> removed;
+    findIdenticalSeq(not_remove, keep_two, removed_seqs, target_seqs, removed);
+    if (Params::getInstance().remove_near_identical_seqs)
+        outWarning("Near-identical sequences are only removed from unpartitioned alignments");
 
 	if (removed_seqs.empty()) return this; // do nothing if the list is empty
 
@@ -1745,7 +1714,7 @@ Alignment *SuperAlignment::concatenateAlignments(set<int> &ids) {
     		//ASSERT(part_seq == partitions[id]->getNSeq());
     		aln->addPattern(pat, pattern_to_sites[it - partitions[id]->begin()][0], (*it).frequency);
     		// IMPORTANT BUG FIX FOLLOW
-    		int ptnindex = aln->pattern_index[pat];
+    		int ptnindex = aln->pattern_index.find(*aln, pat);
 
             // 2021-04-14: build original site to patterns index
             ASSERT((*it).frequency == pattern_to_sites[it - partitions[id]->begin()].size());
@@ -1857,17 +1826,19 @@ void SuperAlignment::orderPatternByNumChars(int pat_type) {
         // partial_partition
         if (Params::getInstance().partition_type == TOPO_UNLINKED)
             continue;
-        for (auto pit = partitions[part]->ordered_pattern.begin(); pit != partitions[part]->ordered_pattern.end(); ++pit) {
-            Pattern pattern(*pit);
+        Alignment *part_aln = partitions[part];
+        for (size_t ptn = 0; ptn < part_aln->ordered_pattern.size(); ++ptn) {
+            Pattern pattern(part_aln->ordered_pattern[ptn]);
             pattern.resize(nseq); // maximal unknown states
             for (int j = 0; j < nseq; j++)
                 if (taxa_index[j][part] >= 0)
-                    pattern[j] = (*pit)[taxa_index[j][part]];
+                    pattern[j] = part_aln->getOrderedTipState(taxa_index[j][part], ptn);
                 else
                     pattern[j] = partitions[part]->STATE_UNKNOWN;
             ordered_pattern.push_back(pattern);
         }
 //        sum_scores[part] = partitions[part]->pars_lower_bound[0];
     }
+    buildOrderedTipStates();
     // TODO compute pars_lower_bound (lower bound of pars score for remaining patterns)
 }
@@ -169,6 +169,17 @@ public:
      */
     virtual Alignment *removeIdenticalSeq(string not_remove, bool keep_two, StrVector &removed_seqs, StrVector &target_seqs);
 
+    /**
+     * compute a hash value for each sequence over all partitions, identical sequences have the same hash
+     * @param[out] hashes hash value of each sequence
+     */
+    virtual void computeSeqHashes(vector<size_t> &hashes);
+
+    /**
+     * @return TRUE if seq1 and seq2 are present in the same partitions and identical there
+     */
+    virtual bool isIdenticalSeq(int seq1, int seq2);
+
 
     /*
         check if some states are absent, which may cause numerical issues
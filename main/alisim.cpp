@@ -826,7 +826,7 @@ void generateMultipleAlignmentsFromSingleTree(AliSimulator *super_alisimulator,
                   || (super_alisimulator->tree->getModelFactory() && super_alisimulator->tree->getModelFactory()->getASC() != ASC_NONE)
                   || super_alisimulator->params->aln_output_format == IN_MAPLE)
         {
-            outWarning("Cannot skip merging sequence chunks in simulations with FunDi, Partitions, +ASC models, or when outputting alignment in MAPLE format. AliSim will concatenate sequence chunks from intermediate files into a single output file.");
+            outWarning("Cannot skip merging sequence chunks in simulations with FunDi, Partitions, +ASC models, or when outputting alignment in MAPLE format. AliSim will write all sequence chunks into a single output file.");
             
             Params::getInstance().no_merge = false;
             super_alisimulator->params->no_merge = false;
@@ -2458,6 +2458,8 @@ int main(int argc, char *argv[]) {
     }
     // omp_set_nested(false); // don't allow nested OpenMP parallelism
     omp_set_max_active_levels(1);
+    if (Params::getInstance().numa_placement)
+        pinThreadsToNodes();
 #else
     if (Params::getInstance().num_threads != 1) {
         cout << endl << endl;
@@ -3612,6 +3614,8 @@ char* build_phylogenetic(StringArray& cnames, StringArray& cseqs, const char* cm
     }
     // omp_set_nested(false); // don't allow nested OpenMP parallelism
     omp_set_max_active_levels(1);
+    if (Params::getInstance().numa_placement)
+        pinThreadsToNodes();
 #else
     if (Params::getInstance().num_threads != 1) {
         cout << endl << endl;
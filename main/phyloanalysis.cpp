@@ -66,6 +66,7 @@
 #include "timetree.h"
 #include <Eigen/Eigenvalues>
 #include <unsupported/Eigen/MatrixFunctions>
+#include <mutex>
 
 using namespace Eigen;
 using Eigen::Map;
@@ -1274,7 +1275,9 @@ void printOutfilesInfo(Params &params, IQTree &tree) {
     if (params.print_marginal_prob && params.optimize_params_use_hmm)
         cout << "  Marginal probability:          " << params.out_prefix << ".mprob" << endl;
 
-    if (params.print_ancestral_sequence) {
+    if (params.print_ancestral_sequence == AST_JOINT && isJointAncestralSupported(&tree)) {
+        cout << "  Ancestral sequences:           " << params.out_prefix << ".aseq" << endl;
+    } else if (params.print_ancestral_sequence) {
         cout << "  Ancestral state:               " << params.out_prefix << ".state" << endl;
 //        cout << "  Ancestral sequences:           " << params.out_prefix << ".aseq" << endl;
     }
@@ -2838,6 +2841,9 @@ void printFinalSearchInfo(Params &params, IQTree &iqtree, double search_cpu_time
     cout << "Total wall-clock time used: "
             << getRealTime() - params.start_real_time << " sec ("
             << convert_time(getRealTime() - params.start_real_time) << ")" << endl;
+    uint64_t peak_mem = getPeakMemoryUsage();
+    if (peak_mem)
+        cout << "Peak memory used: " << (peak_mem / 1048576) << " MB" << endl;
 
 }
 
@@ -2858,10 +2864,28 @@ void processDervMCMCTree(double *gradient_vector, size_t branchNum, size_t mem_s
     Map<RowVectorXd> gradient_vector_eigen_mapped(gradient_vector, branchNum);
     gradient_vector_eigen = gradient_vector_eigen_mapped;
 
+    // hessian = -G * diag(ptn_freq) * G^T. G_matrix is a scratch copy, so the square roots
+    // of the pattern frequencies are folded into it, which avoids the transposed and scaled copies
     Map<Matrix<double, Dynamic, Dynamic, RowMajor>> G_matrix_eigen(G_matrix, branchNum, mem_size);
-    MatrixXd G_matrix_eigen_t = G_matrix_eigen.transpose();
-    hessian = G_matrix_eigen * ptn_freq_diagonal.asDiagonal() * G_matrix_eigen_t;
-    hessian = (-1) * hessian;
+    RowVectorXd sqrt_ptn_freq = ptn_freq_diagonal.array().sqrt();
+    G_matrix_eigen.array().rowwise() *= sqrt_ptn_freq.array();
+
+    // the result is symmetric: compute the lower triangle in blocks of rows, then mirror it
+    hessian.resize(branchNum, branchNum);
+    const size_t block_size = 64;
+    size_t num_blocks = (branchNum + block_size - 1) / block_size;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (size_t block = 0; block < num_blocks; block++) {
+        size_t first = block * block_size;
+        size_t rows = min(block_size, branchNum - first);
+        hessian.block(first, 0, rows, first + rows).noalias() =
+            -G_matrix_eigen.middleRows(first, rows) * G_matrix_eigen.topRows(first + rows).transpose();
+    }
+    for (size_t i = 0; i < branchNum; i++)
+        for (size_t j = i + 1; j < branchNum; j++)
+            hessian(i, j) = hessian(j, i);
     hessian.diagonal() = Map<VectorXd>(hessian_diagonal, branchNum).array();
 
 }
@@ -3615,22 +3639,29 @@ void runTreeReconstruction(Params &params, IQTree* &iqtree) {
         if (params.lh_mem_save == LM_MEM_SAVE && params.max_mem_size > total_mem)
             params.max_mem_size = total_mem;
 
-        uint64_t mem_required = iqtree->getMemoryRequired();
+        MemoryComponents mem_components;
+        iqtree->getMemoryComponents(mem_components);
+        uint64_t mem_required = mem_components.total();
 
         if (mem_required >= total_mem*0.95 && !iqtree->isSuperTree()) {
-            // switch to memory saving mode
+            // switch to memory saving mode, partial likelihood slots fill what the other components leave
             if (params.lh_mem_save != LM_MEM_SAVE) {
-                params.max_mem_size = (total_mem*0.95)/mem_required;
+                uint64_t normal_mem = mem_required;
+                params.max_mem_size = total_mem*0.95;
                 params.lh_mem_save = LM_MEM_SAVE;
-                mem_required = iqtree->getMemoryRequired();
+                mem_components = MemoryComponents();
+                iqtree->getMemoryComponents(mem_components);
+                mem_required = mem_components.total();
                 cout << "NOTE: Switching to memory saving mode using " << (mem_required / 1073741824.0) << " GB ("
-                    <<  (mem_required*100/total_mem) << "% of normal mode)" << endl;
+                    <<  (mem_required*100/normal_mem) << "% of normal mode)" << endl;
                 cout << "NOTE: Use -mem option if you want to restrict RAM usage further" << endl;
             }
             if (mem_required >= total_mem) {
                 params.lh_mem_save = LM_MEM_SAVE;
                 params.max_mem_size = 0.0;
-                mem_required = iqtree->getMemoryRequired();
+                mem_components = MemoryComponents();
+                iqtree->getMemoryComponents(mem_components);
+                mem_required = mem_components.total();
             }
         }
         if (mem_required >= total_mem) {
@@ -3640,6 +3671,8 @@ void runTreeReconstruction(Params &params, IQTree* &iqtree) {
 
 //#if defined __APPLE__ || defined __MACH__
         cout << "NOTE: " << (mem_required / 1048576) << " MB RAM (" << (mem_required / 1073741824) << " GB) is required!" << endl;
+        if (params.memCheck || verbose_mode >= VB_MED)
+            mem_components.report(cout);
 //#else
 //        cout << "NOTE: " << ((double) mem_size / 1000.0) / 1000 << " MB RAM is required!" << endl;
 //#endif
@@ -4134,6 +4167,274 @@ void runTreeReconstruction(Params &params, IQTree* &iqtree) {
 
 }
 
+/**********************************************************
+ * CONCURRENT TREE RECONSTRUCTIONS
+ ***********************************************************/
+
+/**
+    create the tree object for a reconstruction on aln, of the same kind as tree
+    @param tree tree of the original alignment
+    @param aln alignment to analyse: the original one or a resampled copy
+ */
+static IQTree *newReconstructionTree(Params &params, IQTree *tree, Alignment *aln) {
+    IQTree *iqtree;
+    if (aln->isSuperAlignment()){
+        if(params.partition_type != BRLEN_OPTIMIZE){
+            iqtree = new PhyloSuperTreePlen((SuperAlignment*) aln, (PhyloSuperTree*) tree);
+        } else {
+            iqtree = new PhyloSuperTree((SuperAlignment*) aln, (PhyloSuperTree*) tree);
+        }
+    } else {
+        // allocate heterotachy tree if neccessary
+        int pos = posRateHeterotachy(aln->model_name);
+        
+        if (params.num_mixlen > 1) {
+            iqtree = new PhyloTreeMixlen(aln, params.num_mixlen);
+        } else if (pos != string::npos) {
+            iqtree = new PhyloTreeMixlen(aln, 0);
+        } else
+            iqtree = new IQTree(aln);
+    }
+    if (!tree->constraintTree.empty()) {
+        iqtree->constraintTree.readConstraint(tree->constraintTree);
+    }
+    return iqtree;
+}
+
+/**
+    @param option command line option that asked for the jobs
+    @param num_jobs requested number of reconstructions at the same time
+    @param num_tasks number of reconstructions still to do
+    @return number of reconstructions to run at the same time,
+            1 if they must run one after another
+ */
+static int getNumConcurrentJobs(Params &params, const char *option, int num_jobs, int num_tasks) {
+#ifdef _OPENMP
+    num_jobs = min(num_jobs, num_tasks);
+    if (num_jobs <= 1)
+        return 1;
+    if (MPIHelper::getInstance().getNumProcesses() > 1) {
+        outWarning(string(option) + " is ignored with MPI");
+        return 1;
+    }
+    if (params.pll) {
+        outWarning(string(option) + " is ignored with PLL");
+        return 1;
+    }
+    return num_jobs;
+#else
+    if (num_jobs > 1)
+        outWarning(string(option) + " needs a multicore build");
+    return 1;
+#endif
+}
+
+#ifdef _OPENMP
+
+/**
+    stream buffer for cout while concurrent reconstructions run: the output of each job
+    (including its inner threads) is collected separately and written to the log in one
+    piece by takeOutput(), so that the jobs do not interleave their lines
+ */
+class JobStreamBuf : public streambuf {
+public:
+    /**
+        @param num_jobs number of threads of the outer parallel region
+        @param outside_buf buffer for output written outside that region, e.g. by the master thread
+     */
+    JobStreamBuf(int num_jobs, streambuf *outside_buf) : job_output(num_jobs), outside_buf(outside_buf) {}
+
+    /** @return output of the job of the calling thread so far, which is then cleared */
+    string takeOutput() {
+        string out;
+        int job = getJob();
+        lock_guard<mutex> lock(output_mutex);
+        if (job >= 0)
+            out.swap(job_output[job]);
+        return out;
+    }
+
+protected:
+    virtual int overflow(int c) {
+        if (c != EOF) {
+            char ch = c;
+            xsputn(&ch, 1);
+        }
+        return c;
+    }
+
+    virtual streamsize xsputn(const char *s, streamsize n) {
+        int job = getJob();
+        lock_guard<mutex> lock(output_mutex);
+        if (job >= 0)
+            job_output[job].append(s, n);
+        else
+            outside_buf->sputn(s, n);
+        return n;
+    }
+
+    /** @return job of the calling thread, or -1 if it is not in the outer parallel region */
+    int getJob() {
+        if (omp_get_level() < 1)
+            return -1;
+        int job = omp_get_ancestor_thread_num(1);
+        return (job < job_output.size()) ? job : -1;
+    }
+
+    vector<string> job_output;
+    streambuf *outside_buf;
+    mutex output_mutex;
+};
+
+/** remove the intermediate files that a reconstruction wrote under its own prefix */
+static void removeReconstructionFiles(string prefix) {
+    const char *suffixes[] = {".treefile", ".mldist", ".obsdist", ".bionj", ".uniqueseq.phy",
+        ".parstree", ".contree", ".splits.nex", ".ufboot"};
+    for (auto suffix : suffixes)
+        if (fileExists(prefix + suffix))
+            remove((prefix + suffix).c_str());
+}
+
+/**
+    one independent run of runMultipleTreeReconstruction on the calling thread
+    @param params program parameters, copied so that the run can change them
+    @param alignment alignment, shared by all runs
+    @param tree tree of the original alignment
+    @param run run number starting from 0
+    @param num_threads number of threads for this run
+    @param checkpoint (OUT) checkpoint of the run, as the serial loop keeps it under "run<number>"
+    @param[out] tree_str best tree of the run
+    @return best log-likelihood of the run
+ */
+static double runIndependentRun(Params &params, Alignment *alignment, IQTree *tree, int run, int num_threads,
+                                Checkpoint *checkpoint, string &tree_str)
+{
+    Params run_params = params;
+    run_params.num_threads = num_threads;
+    run_params.ran_seed = params.ran_seed + run*1000 + MPIHelper::getInstance().getProcessID();
+    string run_prefix = string(params.out_prefix) + ".run" + convertIntToString(run+1);
+    run_params.out_prefix = (char*)run_prefix.c_str();
+    checkpoint->put("seed", run_params.ran_seed);
+
+    // the run and its threads see run_params via Params::getInstance() and draw from their own streams
+    begin_concurrent_job(run_params, run_params.ran_seed, num_threads);
+
+    IQTree *iqtree = newReconstructionTree(run_params, tree, alignment);
+    iqtree->setCheckpoint(checkpoint);
+    iqtree->num_precision = tree->num_precision;
+
+    runTreeReconstruction(run_params, iqtree);
+    stringstream ss;
+    iqtree->printTree(ss);
+    tree_str = ss.str();
+    double score = iqtree->getBestScore();
+    delete iqtree;
+
+    end_concurrent_job();
+    removeReconstructionFiles(run_prefix);
+    return score;
+}
+
+/**
+    do the remaining independent runs with num_jobs runs at a time. The runs share the
+    alignment and the ModelFinder result of the original tree; each has its own thread
+    team, random stream (seeded as in the serial loop) and checkpoint. Only the final
+    tree and log-likelihood of a run are passed back. Results are committed in run
+    order (runLnL, .runtrees); runs finished ahead of that order stay in the checkpoint.
+    @param runLnL (IN/OUT) log-likelihoods of the runs done so far
+    @param num_jobs number of runs at a time
+    @param runtrees_name .runtrees file
+ */
+static void runConcurrentRuns(Params &params, Alignment *alignment, IQTree *tree, DoubleVector &runLnL,
+                              int num_jobs, string runtrees_name)
+{
+    Checkpoint *checkpoint = tree->getCheckpoint();
+    int total_threads = (params.num_threads > 0) ? params.num_threads : countPhysicalCPUCores();
+    int team_size = max(1, total_threads / num_jobs);
+    int next_run = runLnL.size();
+
+    auto isFinished = [&](int run) {
+        return checkpoint->hasKey("run" + convertIntToString(run+1) + CKP_SEP + "runtree");
+    };
+
+    cout << endl << "---> START " << params.num_runs - runLnL.size() << " RUNS, " << num_jobs
+         << " AT A TIME WITH " << team_size << " THREAD(S) EACH" << endl;
+
+    // the runs share the alignment: order its patterns for parsimony before they start
+    if (alignment->ordered_pattern.empty())
+        alignment->orderPatternByNumChars(PAT_VARIANT);
+
+    JobStreamBuf job_buf(num_jobs, cout.rdbuf());
+    streambuf *saved_buf = cout.rdbuf(&job_buf);
+    ostream log_out(saved_buf);
+    init_concurrent_jobs(num_jobs);
+    int saved_active_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(max(saved_active_levels, 2));
+    double start_real_time = getRealTime();
+
+#pragma omp parallel num_threads(num_jobs)
+    {
+        while (true) {
+            int run = -1;
+#pragma omp critical (independent_runs)
+            {
+                while (next_run < params.num_runs && isFinished(next_run))
+                    next_run++;
+                if (next_run < params.num_runs)
+                    run = next_run++;
+            }
+            if (run < 0)
+                break;
+
+            Checkpoint *run_checkpoint = new Checkpoint;
+            string tree_str;
+            double score = runIndependentRun(params, alignment, tree, run, team_size, run_checkpoint, tree_str);
+            stringstream ss;
+            ss.precision(10);
+            ss << "[ lh=" << score << " ]" << tree_str;
+            run_checkpoint->put("runtree", ss.str());
+            run_checkpoint->put("runLnL", score);
+
+#pragma omp critical (independent_runs)
+            {
+                checkpoint->putSubCheckpoint(run_checkpoint, "run" + convertIntToString(run+1));
+                // commit all runs that are now in order
+                try {
+                    ofstream tree_out;
+                    tree_out.exceptions(ios::failbit | ios::badbit);
+                    tree_out.open(runtrees_name.c_str(), ios_base::out | ios_base::app);
+                    while (runLnL.size() < params.num_runs && isFinished(runLnL.size())) {
+                        checkpoint->startStruct("run" + convertIntToString(runLnL.size()+1));
+                        double run_score = 0.0;
+                        checkpoint->getString("runtree", tree_str);
+                        checkpoint->get("runLnL", run_score);
+                        checkpoint->endStruct();
+                        tree_out << tree_str << endl;
+                        runLnL.push_back(run_score);
+                    }
+                    tree_out.close();
+                } catch (ios::failure) {
+                    outError(ERR_WRITE_OUTPUT, runtrees_name);
+                }
+                checkpoint->putVector("runLnL", runLnL);
+                checkpoint->dump(true);
+                log_out << endl << "---> START RUN NUMBER " << run + 1 << " (seed: " << params.ran_seed + run*1000 + MPIHelper::getInstance().getProcessID() << ")" << endl
+                        << job_buf.takeOutput() << endl;
+                log_out << "Run " << run + 1 << " finished with log-likelihood " << score << ", "
+                        << getRealTime() - start_real_time << " sec" << endl;
+            }
+            delete run_checkpoint;
+        }
+    }
+
+    omp_set_max_active_levels(saved_active_levels);
+    init_concurrent_jobs(0);
+    cout.rdbuf(saved_buf);
+    ASSERT(runLnL.size() == params.num_runs);
+}
+
+#endif // _OPENMP
+
 /**********************************************************
  * MULTIPLE TREE RECONSTRUCTION
  ***********************************************************/
@@ -4172,6 +4473,27 @@ void runMultipleTreeReconstruction(Params &params, Alignment *alignment, IQTree
         if (runLnL[run] > runLnL[best_run])
             best_run = run;
 
+    int num_jobs = params.num_run_jobs;
+    if (num_jobs > 1 && params.num_bootstrap_samples > 0 && params.consensus_type == CT_CONSENSUS_TREE) {
+        // the consensus tree is re-optimised on each improving run
+        outWarning("--run-jobs is ignored with standard bootstrap consensus trees");
+        num_jobs = 1;
+    }
+    if (num_jobs > 1 && (params.model_name.substr(0,4) == "TEST" || params.model_name.substr(0,2) == "MF") && tree->isSuperTree()) {
+        // part_info of the original tree is taken over from the runs
+        outWarning("--run-jobs is ignored with model selection on partitions");
+        num_jobs = 1;
+    }
+    num_jobs = getNumConcurrentJobs(params, "--run-jobs", num_jobs, params.num_runs - runLnL.size());
+#ifdef _OPENMP
+    if (num_jobs > 1) {
+        runConcurrentRuns(params, alignment, tree, runLnL, num_jobs, runtrees_name);
+        for (run = 0; run < runLnL.size(); run++)
+            if (runLnL[run] > runLnL[best_run])
+                best_run = run;
+    }
+#endif
+
     // do multiple tree reconstruction
     for (run = runLnL.size(); run < params.num_runs; run++) {
 
@@ -4188,28 +4510,7 @@ void runMultipleTreeReconstruction(Params &params, Alignment *alignment, IQTree
         int *saved_randstream = randstream;
         init_random(params.ran_seed);
         
-        IQTree *iqtree;
-        if (alignment->isSuperAlignment()){
-            if(params.partition_type != BRLEN_OPTIMIZE){
-                iqtree = new PhyloSuperTreePlen((SuperAlignment*) alignment, (PhyloSuperTree*) tree);
-            } else {
-                iqtree = new PhyloSuperTree((SuperAlignment*) alignment, (PhyloSuperTree*) tree);
-            }
-        } else {
-            // allocate heterotachy tree if neccessary
-            int pos = posRateHeterotachy(alignment->model_name);
-            
-            if (params.num_mixlen > 1) {
-                iqtree = new PhyloTreeMixlen(alignment, params.num_mixlen);
-            } else if (pos != string::npos) {
-                iqtree = new PhyloTreeMixlen(alignment, 0);
-            } else
-                iqtree = new IQTree(alignment);
-        }
-        
-        if (!tree->constraintTree.empty()) {
-            iqtree->constraintTree.readConstraint(tree->constraintTree);
-        }
+        IQTree *iqtree = newReconstructionTree(params, tree, alignment);
         
         // set checkpoint
         iqtree->setCheckpoint(tree->getCheckpoint());
@@ -4514,6 +4815,163 @@ void exhaustiveSearchGAMMAInvar(Params &params, IQTree &iqtree) {
 /**********************************************************
  * STANDARD NON-PARAMETRIC BOOTSTRAP
  ***********************************************************/
+/**
+    @param num_samples number of replicates still to do
+    @return number of bootstrap replicates to reconstruct at the same time,
+            1 if the replicates must run one after another
+ */
+static int getNumBootstrapJobs(Params &params, int num_samples) {
+    if (params.num_bootstrap_jobs > 1 && (params.print_tree_lh || params.print_bootaln || params.print_boot_site_freq)) {
+        // these files are written in replicate order
+        outWarning("--boot-jobs is ignored when printing " + string(RESAMPLE_NAME) + " alignments or likelihoods");
+        return 1;
+    }
+    return getNumConcurrentJobs(params, "--boot-jobs", params.num_bootstrap_jobs, num_samples);
+}
+
+#ifdef _OPENMP
+
+/** checkpoint key of a finished replicate whose tree is not yet in .boottrees */
+static string bootTreeKey(int sample) {
+    return "bootTree" + convertIntToString(sample);
+}
+
+/**
+    reconstruct the tree of one bootstrap replicate on the calling thread
+    @param params program parameters, copied so that the replicate can change them
+    @param alignment original alignment
+    @param tree tree of the original alignment
+    @param sample replicate number starting from 0
+    @param num_threads number of threads for this replicate
+    @return tree string of the replicate
+ */
+static string runBootstrapReplicate(Params &params, Alignment *alignment, IQTree *tree, int sample, int num_threads) {
+    Params boot_params = params;
+    boot_params.num_threads = num_threads;
+    // intermediate files (.mldist, .bionj, .treefile) of each replicate go to their own prefix
+    string boot_prefix = string(params.out_prefix) + "." + RESAMPLE_NAME + convertIntToString(sample+1);
+    boot_params.out_prefix = (char*)boot_prefix.c_str();
+
+    // same bootstrap alignment as the serial loop; the stream of this thread then drives the tree search.
+    // The replicate and its threads see boot_params via Params::getInstance() and draw from their own streams
+    begin_concurrent_job(boot_params, params.ran_seed + sample, num_threads);
+
+    Alignment* bootstrap_alignment;
+    if (alignment->isSuperAlignment())
+        bootstrap_alignment = new SuperAlignment;
+    else
+        bootstrap_alignment = new Alignment;
+    bootstrap_alignment->createBootstrapAlignment(alignment, NULL, params.bootstrap_spec);
+
+    IQTree *boot_tree = newReconstructionTree(boot_params, tree, bootstrap_alignment);
+    // replicates must not share checkpoint state
+    Checkpoint *checkpoint = new Checkpoint;
+    boot_tree->setCheckpoint(checkpoint);
+    boot_tree->num_precision = tree->num_precision;
+
+    runTreeReconstruction(boot_params, boot_tree);
+    stringstream ss;
+    boot_tree->printTree(ss);
+
+    bootstrap_alignment = boot_tree->aln;
+    delete boot_tree;
+    delete bootstrap_alignment;
+    delete checkpoint;
+    end_concurrent_job();
+
+    removeReconstructionFiles(boot_prefix);
+    return ss.str();
+}
+
+/**
+    reconstruct the remaining bootstrap replicates with num_jobs replicates at a time.
+    Each replicate uses its own random stream seeded as in the serial loop and its own
+    checkpoint; only the original alignment and tree are shared (read-only).
+    Trees are appended to .boottrees in replicate order, trees finished ahead of
+    that order are kept in the checkpoint so that a restart does not redo them.
+    @param bootSample number of replicates already in .boottrees
+    @param num_jobs number of replicates at a time
+    @param boottrees_name .boottrees file
+ */
+static void runConcurrentBootstrap(Params &params, Alignment *alignment, IQTree *tree,
+                                   int bootSample, int num_jobs, string boottrees_name)
+{
+    Checkpoint *checkpoint = tree->getCheckpoint();
+    int num_samples = params.num_bootstrap_samples;
+    int total_threads = (params.num_threads > 0) ? params.num_threads : countPhysicalCPUCores();
+    int team_size = max(1, total_threads / num_jobs);
+    int next_sample = bootSample;
+    int num_todo = num_samples - bootSample;
+    int num_done = 0;
+    for (int sample = bootSample; sample < num_samples; sample++)
+        if (checkpoint->hasKey(bootTreeKey(sample)))
+            num_done++;
+
+    cout << endl << "===> START " << num_todo - num_done << " " << RESAMPLE_NAME_UPPER
+         << " REPLICATES, " << num_jobs << " AT A TIME WITH " << team_size << " THREAD(S) EACH" << endl << endl;
+
+    JobStreamBuf job_buf(num_jobs, cout.rdbuf());
+    streambuf *saved_buf = cout.rdbuf(&job_buf);
+    ostream log_out(saved_buf);
+    init_concurrent_jobs(num_jobs);
+    int saved_active_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(max(saved_active_levels, 2));
+    double start_real_time = getRealTime();
+
+#pragma omp parallel num_threads(num_jobs)
+    {
+        while (true) {
+            int sample = -1;
+#pragma omp critical (bootstrap_jobs)
+            {
+                while (next_sample < num_samples && checkpoint->hasKey(bootTreeKey(next_sample)))
+                    next_sample++;
+                if (next_sample < num_samples)
+                    sample = next_sample++;
+            }
+            if (sample < 0)
+                break;
+
+            string tree_str = runBootstrapReplicate(params, alignment, tree, sample, team_size);
+
+#pragma omp critical (bootstrap_jobs)
+            {
+                checkpoint->put(bootTreeKey(sample), tree_str);
+                // move all replicates that are now in order into .boottrees
+                try {
+                    ofstream tree_out;
+                    tree_out.exceptions(ios::failbit | ios::badbit);
+                    tree_out.open(boottrees_name.c_str(), ios_base::out | ios_base::app);
+                    while (bootSample < num_samples && checkpoint->getString(bootTreeKey(bootSample), tree_str)) {
+                        tree_out << tree_str << endl;
+                        checkpoint->erase(bootTreeKey(bootSample));
+                        bootSample++;
+                    }
+                    tree_out.close();
+                } catch (ios::failure) {
+                    outError(ERR_WRITE_OUTPUT, boottrees_name);
+                }
+                checkpoint->put("bootSample", bootSample);
+                checkpoint->putBool("finished", false);
+                checkpoint->dump(true);
+                num_done++;
+                log_out << endl << "===> START " << RESAMPLE_NAME_UPPER << " REPLICATE NUMBER "
+                        << sample + 1 << endl << endl << job_buf.takeOutput() << endl;
+                log_out << RESAMPLE_NAME_UPPER << " replicate " << sample + 1 << " done ("
+                        << num_done << "/" << num_todo
+                        << "), " << getRealTime() - start_real_time << " sec" << endl;
+            }
+        }
+    }
+
+    omp_set_max_active_levels(saved_active_levels);
+    init_concurrent_jobs(0);
+    cout.rdbuf(saved_buf);
+    ASSERT(bootSample == num_samples);
+}
+
+#endif // _OPENMP
+
 void runStandardBootstrap(Params &params, Alignment *alignment, IQTree *tree) {
     ModelCheckpoint *model_info = new ModelCheckpoint;
     StrVector removed_seqs, twin_seqs;
@@ -4572,6 +5030,15 @@ void runStandardBootstrap(Params &params, Alignment *alignment, IQTree *tree) {
     // 2018-06-21: bug fix: alignment might be changed by -m ...MERGE
     alignment = tree->aln;
     
+    int num_jobs = getNumBootstrapJobs(params, params.num_bootstrap_samples - bootSample);
+#ifdef _OPENMP
+    if (num_jobs > 1) {
+        runConcurrentBootstrap(params, alignment, tree, bootSample, num_jobs, boottrees_name);
+        // nothing left for the loop below
+        bootSample = params.num_bootstrap_samples;
+    }
+#endif
+
     // do bootstrap analysis
     for (int sample = bootSample; sample < params.num_bootstrap_samples; sample++) {
         cout << endl << "===> START " << RESAMPLE_NAME_UPPER << " REPLICATE NUMBER "
@@ -4606,24 +5073,7 @@ void runStandardBootstrap(Params &params, Alignment *alignment, IQTree *tree) {
             boot_lh << "0\t" << prob << endl;
             boot_lh.close();
         }
-        IQTree *boot_tree;
-        if (alignment->isSuperAlignment()){
-            if(params.partition_type != BRLEN_OPTIMIZE){
-                boot_tree = new PhyloSuperTreePlen((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
-            } else {
-                boot_tree = new PhyloSuperTree((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) tree);
-            }
-        } else {
-            // allocate heterotachy tree if neccessary
-            int pos = posRateHeterotachy(alignment->model_name);
-            
-            if (params.num_mixlen > 1) {
-                boot_tree = new PhyloTreeMixlen(bootstrap_alignment, params.num_mixlen);
-            } else if (pos != string::npos) {
-                boot_tree = new PhyloTreeMixlen(bootstrap_alignment, 0);
-            } else
-                boot_tree = new IQTree(bootstrap_alignment);
-        }
+        IQTree *boot_tree = newReconstructionTree(params, tree, bootstrap_alignment);
         if (params.print_bootaln && MPIHelper::getInstance().isMaster()) {
             bootstrap_alignment->printAlignment(params.aln_output_format, bootaln_name.c_str(), true);
         }
@@ -4633,10 +5083,6 @@ void runStandardBootstrap(Params &params, Alignment *alignment, IQTree *tree) {
                 bootstrap_alignment->printAlignment(params.aln_output_format, (((string)params.out_prefix)+"."+convertIntToString(sample)+".bootaln").c_str());
         }
 
-        if (!tree->constraintTree.empty()) {
-            boot_tree->constraintTree.readConstraint(tree->constraintTree);
-        }
-
         // set checkpoint
         boot_tree->setCheckpoint(tree->getCheckpoint());
         boot_tree->num_precision = tree->num_precision;
@@ -5026,6 +5472,11 @@ void doSymTest(Alignment *alignment, Params &params) {
     marsym.resize(num_parts*params.symtest_shuffle);
     intsym.resize(num_parts*params.symtest_shuffle);
 
+    // permutations are tested in parallel, each with its own random stream, and
+    // reported in order; without permutations the sequence pairs run in parallel
+#ifdef _OPENMP
+#pragma omp parallel for ordered schedule(dynamic) if(params.symtest_shuffle > 1)
+#endif
     for (int i = 0; i < params.symtest_shuffle; i++) {
         vector<SymTestStat> *stats = NULL;
         if (params.symtest_stat)
@@ -5038,19 +5489,24 @@ void doSymTest(Alignment *alignment, Params &params) {
             alignment->doSymTest(i*num_parts, sym, marsym, intsym, rstream, stats);
             finish_random(rstream);
         }
-        if ((i+1)*10 % params.symtest_shuffle == 0) {
-            cout << " " << (i+1)*100 / params.symtest_shuffle << "%";
-            cout.flush();
-        }
-        if (!stats)
-            continue;
-        for (auto it = stats->begin(); it != stats->end(); it++) {
-            *out_stat << it->part << ',' << it->seq1 << ',' << it->seq2 << ','
-            << it->chi2_sym << ',' << it->pval_sym << ','
-            << it->chi2_marsym << ',' << it->pval_marsym << ','
-            << it->chi2_intsym << ',' << it->pval_intsym << endl;
+#ifdef _OPENMP
+#pragma omp ordered
+#endif
+        {
+            if ((i+1)*10 % params.symtest_shuffle == 0) {
+                cout << " " << (i+1)*100 / params.symtest_shuffle << "%";
+                cout.flush();
+            }
+            if (stats) {
+                for (auto it = stats->begin(); it != stats->end(); it++) {
+                    *out_stat << it->part << ',' << it->seq1 << ',' << it->seq2 << ','
+                    << it->chi2_sym << ',' << it->pval_sym << ','
+                    << it->chi2_marsym << ',' << it->pval_marsym << ','
+                    << it->chi2_intsym << ',' << it->pval_intsym << endl;
+                }
+                delete stats;
+            }
         }
-        delete stats;
     }
 
     if (out_stat) {
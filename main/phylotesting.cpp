@@ -12,6 +12,8 @@
 #endif
 #include <iqtree_config.h>
 #include <numeric>
+#include <mutex>
+#include <condition_variable>
 #include "tree/phylotree.h"
 #include "tree/iqtree.h"
 #include "tree/phylotreemixlen.h"
@@ -1322,6 +1324,37 @@ void getRateHet(SeqType seq_type, string model_name, double frac_invariant_sites
     reorderModelNames(ratehet, rate_options, sizeof(rate_options) / sizeof(rate_options[0]));
 }
 
+/**
+ memory needed while ModelFinder runs: alignment and parsimony vectors of the input tree
+ plus the tree copies on which the candidate models are evaluated
+ @param iqtree input tree
+ @param ncategory maximum number of rate categories of the candidate models
+ */
+static MemoryComponents getModelFinderMemory(Params &params, IQTree &iqtree, size_t ncategory) {
+    MemoryComponents tree_mem, mem;
+    iqtree.getMemoryComponents(tree_mem, ncategory);
+    mem.alignment = tree_mem.alignment;
+    mem.partial_pars = tree_mem.partial_pars;
+    mem.model_finder = iqtree.getMemoryRequiredThreaded(ncategory);
+    // the figure of a single tree includes the alignment and parsimony vectors, which the copies share;
+    // supertrees and tree mixtures add up some of their trees, so theirs is left as an upper bound
+    if (!iqtree.isSuperTree() && !iqtree.isTreeMix())
+        mem.model_finder -= min(mem.model_finder, mem.alignment + mem.partial_pars);
+    // FreeRate candidates optimized by EM add single-category trees, see RateFree::optimizeWithEM;
+    // counted whenever there are rate categories, as an upper bound
+    bool by_model = params.openmp_by_model && !iqtree.isSuperTree();
+    if (ncategory > 1 && params.optimize_alg_freerate.find("EM") != string::npos) {
+        uint64_t worker_mem = mem.model_finder / ncategory;
+        mem.rate_em = worker_mem * RateFree::getNumEMWorkers(by_model ? 1 : params.num_threads, ncategory, worker_mem);
+    }
+    // when parallel over models, every thread evaluates a model on its own copy
+    if (by_model) {
+        mem.model_finder *= max(params.num_threads, 1);
+        mem.rate_em *= max(params.num_threads, 1);
+    }
+    return mem;
+}
+
 void runModelFinder(Params &params, IQTree &iqtree, ModelCheckpoint &model_info, string &best_subst_name, string &best_rate_name, map<string, vector<string> > nest_network, bool under_mix_finder)
 {
     if (params.model_name.find("+T") != string::npos) {
@@ -1466,8 +1499,11 @@ void runModelFinder(Params &params, IQTree &iqtree, ModelCheckpoint &model_info,
             }
         }
 
-        uint64_t mem_size = iqtree.getMemoryRequiredThreaded(max_cats);
+        MemoryComponents mem_components = getModelFinderMemory(params, iqtree, max_cats);
+        uint64_t mem_size = mem_components.total();
         cout << "NOTE: ModelFinder requires " << (mem_size / 1024) / 1024 << " MB RAM!" << endl;
+        if (params.memCheck || verbose_mode >= VB_MED)
+            mem_components.report(cout);
         if (mem_size >= getMemorySize()) {
             outError("Memory required exceeds your computer RAM size!");
         }
@@ -2014,6 +2050,9 @@ string CandidateModel::evaluate(Params &params,
             iqtree->setCheckpoint(&in_model_info);
             bool init_success;
             if (mixture_action != MA_FIND_RATE && iqtree->aln->seq_type == SEQ_DNA) {
+#ifdef _OPENMP
+#pragma omp critical (model_info)
+#endif
                 init_success = iqtree->getModelFactory()->initFromNestedModel(nest_network);
             } else {
                 //reestimating RHAS model
@@ -3330,6 +3369,7 @@ CandidateModel CandidateModelSet::test(Params &params, PhyloTree* in_tree, Model
 
 int64_t CandidateModelSet::getNextModel() {
     int64_t next_model;
+    bool has_blocked = false;
 #pragma omp critical
     {
     if (size() == 0)
@@ -3340,8 +3380,10 @@ int64_t CandidateModelSet::getNextModel() {
         for (next_model = current_model+1; next_model != current_model; next_model++) {
             if (next_model == size())
                 next_model = 0;
-            if (!at(next_model).hasFlag(MF_IGNORED + MF_WAITING + MF_RUNNING)) {
-                break;
+            if (!at(next_model).hasFlag(MF_IGNORED + MF_WAITING + MF_RUNNING + MF_DONE)) {
+                if (!hasPendingNestedModel(next_model))
+                    break;
+                has_blocked = true;
             }
         }
     }
@@ -3349,11 +3391,45 @@ int64_t CandidateModelSet::getNextModel() {
         current_model = next_model;
         at(next_model).setFlag(MF_RUNNING);
     } else
-        next_model = -1;
+        next_model = has_blocked ? -2 : -1;
     }
     return next_model;
 }
 
+bool CandidateModelSet::hasPendingNestedModel(int64_t model) {
+    if (at(model).subst_name.empty())
+        return false;
+    // candidate names still carry the frequency suffix, e.g. RY3.3b+FO
+    string subst_name = at(model).subst_name.substr(0, at(model).subst_name.find('+'));
+    // only Lie-Markov models are warm-started from their nested models
+    if (!ModelLieMarkov::validModelName(subst_name))
+        return false;
+    auto it = nest_network.find(subst_name);
+    if (it == nest_network.end())
+        return false;
+    for (auto &nested_name : it->second)
+        for (auto &candidate : *this) {
+            if (candidate.hasFlag(MF_DONE + MF_IGNORED + MF_WAITING) || candidate.rate_name != at(model).rate_name)
+                continue;
+            if (candidate.subst_name == nested_name || candidate.subst_name.find(nested_name + "+") == 0)
+                return true;
+        }
+    return false;
+}
+
+bool CandidateModelSet::isNestedLieMarkovModel(int64_t model) {
+    if (at(model).subst_name.empty())
+        return false;
+    string subst_name = at(model).subst_name.substr(0, at(model).subst_name.find('+'));
+    if (!ModelLieMarkov::validModelName(subst_name))
+        return false;
+    for (auto &nest : nest_network)
+        if (ModelLieMarkov::validModelName(nest.first) &&
+            find(nest.second.begin(), nest.second.end(), subst_name) != nest.second.end())
+            return true;
+    return false;
+}
+
 CandidateModel CandidateModelSet::evaluateAll(Params &params, PhyloTree* in_tree, ModelCheckpoint &model_info,
                                     ModelsBlock *models_block, int num_threads, int brlen_type,
                                     string in_model_name, bool merge_phase, bool write_info)
@@ -3428,21 +3504,37 @@ CandidateModel CandidateModelSet::evaluateAll(Params &params, PhyloTree* in_tree
     }
 
     int64_t num_models = size();
+    // number of models finished so far, signalled to threads waiting for nested models
+    int64_t num_finished = 0;
+    mutex finished_mutex;
+    condition_variable finished_cond;
 #ifdef _OPENMP
 #pragma omp parallel num_threads(num_threads)
 #endif
     {
     int64_t model;
     do {
+        int64_t seen_finished;
+        {
+            lock_guard<mutex> lock(finished_mutex);
+            seen_finished = num_finished;
+        }
         model = getNextModel();
         if (model == -1)
             break;
+        if (model == -2) {
+            // remaining models wait for their nested models, which warm-start them
+            unique_lock<mutex> lock(finished_mutex);
+            finished_cond.wait(lock, [&] { return num_finished != seen_finished; });
+            continue;
+        }
 
         // optimize model parameters
         string orig_model_name = at(model).getName();
         // keep separate output model_info to only update model_info if better model found
         ModelCheckpoint out_model_info;
         at(model).set_name = at(model).aln->name;
+        at(model).nest_network = nest_network;
         string tree_string;
         
         // main call to estimate model parameters
@@ -3463,6 +3555,9 @@ CandidateModel CandidateModelSet::evaluateAll(Params &params, PhyloTree* in_tree
 #ifdef _OPENMP
 #pragma omp critical
         {
+        // model_info is also read by the threads evaluating other models
+#pragma omp critical (model_info)
+        {
 #endif
         if (best_score > at(model).getScore()) {
             best_score = at(model).getScore();
@@ -3472,7 +3567,16 @@ CandidateModel CandidateModelSet::evaluateAll(Params &params, PhyloTree* in_tree
             // only update model_info with better model
             model_info.putSubCheckpoint(&out_model_info, "");
         }
+        // starting values for the Lie-Markov models nesting this one
+        if (isNestedLieMarkovModel(model)) {
+            model_info.startStruct("OptModel");
+            model_info.putSubCheckpoint(&out_model_info, at(model).getName());
+            model_info.endStruct();
+        }
         model_info.dump();
+#ifdef _OPENMP
+        }
+#endif
         if (write_info) {
             cout.width(3);
             cout << right << model+1 << "  ";
@@ -3499,6 +3603,11 @@ CandidateModel CandidateModelSet::evaluateAll(Params &params, PhyloTree* in_tree
 #ifdef _OPENMP
         }
 #endif
+        {
+            lock_guard<mutex> lock(finished_mutex);
+            num_finished++;
+        }
+        finished_cond.notify_all();
     } while (model != -1);
     }
     
@@ -6372,8 +6481,11 @@ CandidateModel findMixtureComponent(Params &params, IQTree &iqtree, ModelCheckpo
         n_class = getClassNum(model_str);
     }
     
-    uint64_t mem_size = iqtree.getMemoryRequiredThreaded(max_cats);
+    MemoryComponents mem_components = getModelFinderMemory(params, iqtree, max_cats);
+    uint64_t mem_size = mem_components.total();
     cout << "NOTE: MixtureFinder " << n_class << "-class models requires " << (mem_size / 1024) / 1024 << " MB RAM!" << endl;
+    if (params.memCheck || verbose_mode >= VB_MED)
+        mem_components.report(cout);
     if (mem_size >= getMemorySize()) {
         outError("Memory required exceeds your computer RAM size!");
     }
@@ -7017,5 +7129,25 @@ map<string, vector<string> > generateNestNetwork(StrVector model_names, StrVecto
         nest_network[model_freq_names[i].model_freq] = nested_models;
         nest_network_all[model_freq_names[i].model_freq] = nested_models_all;
     }
+
+    // Lie-Markov models: all models whose basis matrices are shared, regardless of the test order
+    StrVector lm_names;
+    for (i = 0; i < model_names.size(); i++) {
+        int model_num, symmetry;
+        StateFreqType def_freq;
+        string name;
+        ModelLieMarkov::getLieMarkovModelInfo(model_names[i], name, full_name, model_num, symmetry, def_freq);
+        if (model_num >= 0)
+            lm_names.push_back(name);
+    }
+    for (i = 0; i < lm_names.size(); i++) {
+        vector<string> nested_models;
+        for (j = 0; j < lm_names.size(); j++) {
+            IntVector param_map;
+            if (ModelLieMarkov::getNestedParamMap(lm_names[j], lm_names[i], param_map))
+                nested_models.push_back(lm_names[j]);
+        }
+        nest_network[lm_names[i]] = nested_models;
+    }
     return nest_network;
 }
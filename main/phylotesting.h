@@ -313,9 +313,24 @@ public:
         return -1;
     }
 
-    /** get the next model to evaluate in parallel */
+    /**
+     get the next model to evaluate in parallel
+     @return model index, -1 if no model is left, -2 if the remaining models wait for their nested models
+     */
     int64_t getNextModel();
 
+    /**
+     @return true if model is a Lie-Markov model and one of its nested models (see nest_network)
+     with the same rate heterogeneity is still to be evaluated
+     */
+    bool hasPendingNestedModel(int64_t model);
+
+    /**
+     @return true if model is nested in a Lie-Markov candidate (see nest_network),
+     so that its optimised parameters are kept to warm-start that candidate
+     */
+    bool isNestedLieMarkovModel(int64_t model);
+
     /**
      evaluate all models in parallel
      */
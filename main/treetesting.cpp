@@ -227,15 +227,70 @@ void printSiteLhCategory(const char*filename, PhyloTree *tree, SiteLoglType wsl)
     
 }
 
+bool isJointAncestralSupported(PhyloTree *tree) {
+    return !tree->isSuperTree() && !tree->isTreeMix() && tree->aln->seq_type != SEQ_POMO &&
+        !tree->getModel()->isSiteSpecificModel();
+}
+
+/**
+    print the joint reconstruction of ancestral sequences at all internal nodes in PHYLIP format
+    @param out_prefix output prefix, the sequences go to out_prefix.aseq
+    @param tree the tree with the fitted model
+*/
+static void printJointAncestralSequences(const char *out_prefix, PhyloTree *tree) {
+    size_t nptn = tree->getAlnNPattern();
+    size_t nsites = tree->getAlnNSite();
+    Alignment *aln = tree->aln;
+    int *joint_ancestral = new int[nptn*(tree->nodeNum-tree->leafNum)];
+    tree->computeJointAncestralSequences(joint_ancestral);
+
+    string filename = (string)out_prefix + ".aseq";
+    try {
+        NodeVector nodes;
+        tree->getInternalNodes(nodes);
+        StrVector seqs;
+        size_t name_width = 0;
+        for (NodeVector::iterator it = nodes.begin(); it != nodes.end(); it++) {
+            Node *node = *it;
+            // set node name if neccessary
+            if (node->name.empty() || !isalpha(node->name[0])) {
+                node->name = "Node" + convertIntToString(node->id-tree->leafNum+1);
+            }
+            name_width = max(name_width, node->name.length());
+            int *joint_ancestral_node = joint_ancestral + (node->id-tree->leafNum)*nptn;
+            string seq;
+            for (size_t site = 0; site < nsites; site++)
+                seq += aln->convertStateBackStr(joint_ancestral_node[aln->getPatternID(site)]);
+            seqs.push_back(seq);
+        }
+
+        ofstream out;
+        out.exceptions(ios::failbit | ios::badbit);
+        out.open(filename.c_str());
+        out << nodes.size() << " " << (seqs.empty() ? 0 : seqs[0].length()) << endl;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            out.width(name_width);
+            out << left << nodes[i]->name << " " << seqs[i] << endl;
+        }
+        out.close();
+        cout << "Joint ancestral sequences printed to " << filename << endl;
+    } catch (ios::failure) {
+        outError(ERR_WRITE_OUTPUT, filename);
+    }
+    delete [] joint_ancestral;
+}
+
 void printAncestralSequences(const char *out_prefix, PhyloTree *tree, AncestralSeqType ast) {
     
-    //    int *joint_ancestral = NULL;
-    //
-    //    if (tree->params->print_ancestral_sequence == AST_JOINT) {
-    //        joint_ancestral = new int[nptn*tree->leafNum];
-    //        tree->computeJointAncestralSequences(joint_ancestral);
-    //    }
-    
+    if (ast == AST_JOINT) {
+        if (!isJointAncestralSupported(tree)) {
+            outWarning("Joint ancestral reconstruction is not supported for partition, tree mixture, PoMo or site-specific models, marginal reconstruction is done instead");
+        } else {
+            printJointAncestralSequences(out_prefix, tree);
+            return;
+        }
+    }
+
     string filename = (string)out_prefix + ".state";
     //    string filenameseq = (string)out_prefix + ".stateseq";
     
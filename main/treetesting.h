@@ -93,6 +93,12 @@ void printSiteStateFreq(const char*filename, PhyloTree *tree, double *state_freq
 */
 void printSiteStateFreq(const char* filename, Alignment *aln);
 
+/**
+    @param tree phylogenetic tree
+    @return true if joint ancestral reconstruction supports the tree and its model
+*/
+bool isJointAncestralSupported(PhyloTree *tree);
+
 /**
     print ancestral sequences
     @param filename output file name
@@ -689,7 +689,7 @@ ModelFactory::ModelFactory(Params &params, string &model_name, PhyloTree *tree,
     if ((posasc = rate_str.find("+ASC_INF")) != string::npos) {
         // ascertainment bias correction
         ASC_type = ASC_INFORMATIVE;
-        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns);
+        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns, unobserved_ptn_layout);
         
         // rebuild the seq_states to contain states of unobserved constant patterns
         //tree->aln->buildSeqStates(model->seq_states, true);
@@ -708,7 +708,7 @@ ModelFactory::ModelFactory(Params &params, string &model_name, PhyloTree *tree,
     } else if ((posasc = rate_str.find("+ASC_MIS")) != string::npos) {
         // initialize Holder's ascertainment bias correction model
         ASC_type = ASC_VARIANT_MISSING;
-        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns);
+        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns, unobserved_ptn_layout);
         // rebuild the seq_states to contain states of unobserved constant patterns
         //tree->aln->buildSeqStates(model->seq_states, true);
         if (tree->aln->frac_invariant_sites > 0) {
@@ -726,7 +726,7 @@ ModelFactory::ModelFactory(Params &params, string &model_name, PhyloTree *tree,
     } else if ((posasc = rate_str.find("+ASC")) != string::npos) {
         // ascertainment bias correction
         ASC_type = ASC_VARIANT;
-        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns);
+        tree->aln->getUnobservedConstPatterns(ASC_type, unobserved_ptns, unobserved_ptn_layout);
         
         // delete rarely observed state
         for (int i = unobserved_ptns.size()-1; i >= 0; i--)
@@ -1099,6 +1099,53 @@ string replaceLastQ(string model_name, string nested_q_name) {
     return nested_mix_model;
 }
 
+bool ModelFactory::initFromNestedLieMarkov(map<string, vector<string> > &nest_network) {
+    string model_name = model->getName();
+    string rate_name = site_rate->name;
+    auto itr = nest_network.find(model_name);
+    if (itr == nest_network.end())
+        return false;
+
+    // nested models are not necessarily tested before this one: take the best one done
+    string best_nested_model_name;
+    double max_logl = -DBL_MAX;
+    for (auto nested_model_name : itr->second) {
+        string best_model_logl_df;
+        if (!checkpoint->getString(nested_model_name + rate_name, best_model_logl_df))
+            continue;
+        stringstream ss(best_model_logl_df);
+        double cur_logl;
+        ss >> cur_logl;
+        if (cur_logl > max_logl) {
+            max_logl = cur_logl;
+            best_nested_model_name = nested_model_name;
+        }
+    }
+    if (best_nested_model_name.empty())
+        return false;
+
+    checkpoint->startStruct("OptModel");
+    checkpoint->startStruct(best_nested_model_name + rate_name);
+    // parameters are weights of model specific basis matrices, so they are mapped, not restored
+    DoubleVector model_parameters;
+    checkpoint->startStruct("ModelLieMarkov" + best_nested_model_name);
+    CKP_VECTOR_RESTORE(model_parameters);
+    checkpoint->endStruct();
+    bool success = ((ModelLieMarkov*)model)->initFromNestedModel(best_nested_model_name, model_parameters);
+    if (success) {
+        site_rate->restoreCheckpoint();
+        // also start from the rooted tree optimized under the nested model
+        PhyloTree *tree = site_rate->getTree();
+        tree->PhyloTree::restoreCheckpoint();
+        tree->initializeAllPartialLh();
+        if (verbose_mode >= VB_MED)
+            cout << model_name + rate_name << " initialized from " << best_nested_model_name + rate_name << endl;
+    }
+    checkpoint->endStruct();
+    checkpoint->endStruct();
+    return success;
+}
+
 bool ModelFactory::initFromNestedModel(map<string, vector<string> > nest_network) {
     string model_name, last_q_name, rate_name, nested_full_name, best_nested_model_name;
     vector<string> nested_models;
@@ -1110,6 +1157,9 @@ bool ModelFactory::initFromNestedModel(map<string, vector<string> > nest_network
     model_name = model->getName();
     rate_name = site_rate->name;
 
+    if (nmix == 1 && model->isLieMarkov())
+        return initFromNestedLieMarkov(nest_network);
+
     if (nmix == 1){
         itr = nest_network.find(model_name);
         if (itr == nest_network.end() || itr->second.size() == 0)
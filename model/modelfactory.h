@@ -109,6 +109,13 @@ public:
     */
     virtual bool initFromNestedModel(map<string, vector<string> > nest_network);
 
+    /**
+        initialise a Lie-Markov model from the best nested Lie-Markov model in checkpoint,
+        including its rate heterogeneity and its rooted tree
+        @return false if no nested model was done or its parameters cannot be mapped
+    */
+    bool initFromNestedLieMarkov(map<string, vector<string> > &nest_network);
+
     /**
         initialize the parameters from the (k-1)-class mixture model
         return false if the k-class model can't initialise from (k-1)-class model
@@ -253,6 +260,12 @@ public:
 	 */
 	vector<Pattern> unobserved_ptns;
 
+    /**
+     * for Holder's correction (+ASC_MIS): missing-data layout of each pattern, indexing
+     * into one state block of unobserved_ptns
+     */
+    IntVector unobserved_ptn_layout;
+
     /** ascertainment bias correction type */
     ASCType ASC_type;
     
@@ -704,6 +704,77 @@ void ModelLieMarkov::writeInfo(ostream &out) {
     return;
 }
 
+/*
+ * Rates of basis matrix i of a Lie-Markov model in iqtree order,
+ * without the transformation for fixed base frequencies.
+ */
+static void getUnconstrainedBasis(int model_num, int symmetry, int i, double *rates) {
+    const double *unpermuted_rates = LM_BASIS_MATRICES[BASES[model_num][i]];
+    for (int rate=0; rate<NUM_RATES; rate++)
+        rates[rate] = unpermuted_rates[SYMMETRY_PERM[symmetry][rate]];
+}
+
+static bool equalBasis(const double *rates1, const double *rates2, double sign) {
+    for (int rate=0; rate<NUM_RATES; rate++)
+        if (fabs(rates1[rate] - sign*rates2[rate]) > 1e-9)
+            return false;
+    return true;
+}
+
+/*static*/ bool ModelLieMarkov::getNestedParamMap(string nested_name, string model_name, IntVector &param_map) {
+    int nested_num, nested_symmetry, model_num, symmetry;
+    parseModelName(nested_name, &nested_num, &nested_symmetry);
+    parseModelName(model_name, &model_num, &symmetry);
+    if (nested_num < 0 || model_num < 0 || MODEL_PARAMS[nested_num] >= MODEL_PARAMS[model_num])
+        return false;
+    // basis[0] is the 'A' matrix of all models, only the parameterised ones have to match
+    double nested_rates[NUM_RATES], rates[NUM_RATES];
+    param_map.clear();
+    for (int i=1; i<=MODEL_PARAMS[nested_num]; i++) {
+        getUnconstrainedBasis(nested_num, nested_symmetry, i, nested_rates);
+        int match = 0;
+        for (int j=1; j<=MODEL_PARAMS[model_num] && !match; j++) {
+            getUnconstrainedBasis(model_num, symmetry, j, rates);
+            if (equalBasis(nested_rates, rates, 1.0))
+                match = j;
+            else if (equalBasis(nested_rates, rates, -1.0))
+                match = -j;
+        }
+        if (!match)
+            return false;
+        param_map.push_back(match);
+    }
+    return true;
+}
+
+bool ModelLieMarkov::initFromNestedModel(string nested_name, DoubleVector &nested_params) {
+    IntVector param_map;
+    if (!getNestedParamMap(nested_name, name, param_map) || param_map.size() != nested_params.size())
+        return false;
+    // fixed base frequencies (+F, +FU) transform the basis matrices of both models differently
+    if (num_params != MODEL_PARAMS[model_num])
+        return false;
+    double rates_unconstrained[NUM_RATES];
+    for (int i=1; i<=num_params; i++) {
+        getUnconstrainedBasis(model_num, symmetry, i, rates_unconstrained);
+        if (!equalBasis(basis[i], rates_unconstrained, 1.0))
+            return false;
+    }
+    // sum of weighted basis matrices, and hence the rate matrix, is that of the nested model
+    memset(model_parameters, 0, sizeof(double)*num_params);
+    for (int i=0; i<param_map.size(); i++) {
+        if (param_map[i] > 0)
+            model_parameters[param_map[i]-1] = nested_params[i];
+        else
+            model_parameters[-param_map[i]-1] = -nested_params[i];
+    }
+    setRates();
+    decomposeRateMatrix();
+    if (phylo_tree)
+        phylo_tree->clearAllPartialLH();
+    return true;
+}
+
 
 ModelLieMarkov::~ModelLieMarkov() {
   // Do nothing, for now. model_parameters is reclaimed in ~ModelMarkov
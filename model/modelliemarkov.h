@@ -48,6 +48,26 @@ public:
 
 	static string getModelInfo(string model_name, string &full_name, StateFreqType &def_freq);
 
+	/**
+		check if a Lie-Markov model is nested in another one such that its parameters carry over:
+		every basis matrix of nested_name must be, up to its sign, a basis matrix of model_name
+		@param nested_name name of the nested model
+		@param model_name name of the nesting model
+		@param[out] param_map for each parameter of nested_name, 1 + index of the matching
+		       parameter of model_name, negated if the basis matrix has the opposite sign
+		@return TRUE if nested_name is nested in model_name
+	*/
+	static bool getNestedParamMap(string nested_name, string model_name, IntVector &param_map);
+
+	/**
+		initialize model parameters from the optimized parameters of a nested model,
+		giving the same rate matrix as the nested model
+		@param nested_name name of the nested model
+		@param nested_params its model parameters
+		@return FALSE if the nested model cannot be mapped onto this model
+	*/
+	bool initFromNestedModel(string nested_name, DoubleVector &nested_params);
+
 	// DO NOT override this function, because
     // BQM, 2017-05-02: getNDimFreq should return degree of freedom, which is not included in getNDim()
     // That's why 0 is returned for FREQ_ESTIMATE, num_states-1 for FREQ_EMPIRICAL
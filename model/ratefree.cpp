@@ -503,39 +503,63 @@ void RateFree::writeParameters(ostream &out) {
 
 }
 
-double RateFree::optimizeWithEM() {
-    size_t ptn, c;
-    size_t nptn = phylo_tree->aln->getNPattern();
-    size_t nmix = ncategory;
-    const double MIN_PROP = 1e-4;
-    
-//    double *lk_ptn = aligned_alloc<double>(nptn);
-    double *new_prop = aligned_alloc<double>(nmix);
-    PhyloTree *tree = new PhyloTree;
+/** number of patterns whose posterior weights are summed together in the E-step */
+const size_t EM_PATTERN_BLOCK = 1024;
 
-    // attach memory to save space
-//    tree->central_partial_lh = phylo_tree->central_partial_lh;
-//    tree->central_scale_num = phylo_tree->central_scale_num;
-//    tree->central_partial_pars = phylo_tree->central_partial_pars;
+PhyloTree *RateFree::createEMRateTree(int nthreads) {
+    PhyloTree *tree = new PhyloTree;
 
     tree->copyPhyloTree(phylo_tree, true);
     tree->optimize_by_newton = phylo_tree->optimize_by_newton;
     tree->setParams(phylo_tree->params);
     tree->setLikelihoodKernel(phylo_tree->sse);
-    tree->setNumThreads(phylo_tree->num_threads);
+    tree->setNumThreads(nthreads);
 
     // initialize model
     ModelFactory *model_fac = new ModelFactory();
     model_fac->joint_optimize = phylo_tree->params->optimize_model_rate_joint;
-//    model_fac->unobserved_ptns = phylo_tree->getModelFactory()->unobserved_ptns;
 
-    RateHeterogeneity *site_rate = new RateHeterogeneity; 
+    RateHeterogeneity *site_rate = new RateHeterogeneity;
     tree->setRate(site_rate);
     site_rate->setTree(tree);
-            
+
     model_fac->site_rate = site_rate;
     tree->model_factory = model_fac;
     tree->setParams(phylo_tree->params);
+    return tree;
+}
+
+int RateFree::getNumEMWorkers(int num_threads, int ncategory, uint64_t worker_mem) {
+    int num_workers = 1;
+#ifdef _OPENMP
+    num_workers = max(1, min(num_threads, ncategory));
+    if (worker_mem > 0)
+        num_workers = min((uint64_t)num_workers, max((uint64_t)1, getMemorySize() / 2 / worker_mem));
+#endif
+    return num_workers;
+}
+
+double RateFree::optimizeWithEM() {
+    size_t c;
+    size_t nptn = phylo_tree->aln->getNPattern();
+    size_t nmix = ncategory;
+    const double MIN_PROP = 1e-4;
+    
+    double *new_prop = aligned_alloc<double>(nmix);
+
+    // the category rates are optimized independently of each other in the M-step,
+    // with one single-threaded tree per worker if there are threads and memory to spare
+    vector<PhyloTree*> trees;
+    trees.push_back(createEMRateTree(1));
+    int num_workers = getNumEMWorkers(phylo_tree->num_threads, nmix, trees[0]->getMemoryRequired());
+    if (num_workers == 1)
+        trees[0]->setNumThreads(phylo_tree->num_threads);
+    for (int i = 1; i < num_workers; i++)
+        trees.push_back(createEMRateTree(1));
+
+    size_t nblock = (nptn + EM_PATTERN_BLOCK - 1) / EM_PATTERN_BLOCK;
+    DoubleVector block_prop(nblock*nmix);
+    DoubleVector new_rates(nmix);
     double old_score = 0.0;
     // EM algorithm loop described in Wang, Li, Susko, and Roger (2008)
     for (int step = 0; step < ncategory; step++) {
@@ -561,23 +585,37 @@ double RateFree::optimizeWithEM() {
         
                 
         // E-step
-        // decoupled weights (prop) from _pattern_lh_cat to obtain L_ci and compute pattern likelihood L_i
-        memset(new_prop, 0, nmix*sizeof(double));
-        for (ptn = 0; ptn < nptn; ptn++) {
-            double *this_lk_cat = phylo_tree->_pattern_lh_cat + ptn*nmix;
-            double lk_ptn = phylo_tree->ptn_invar[ptn];
-            for (c = 0; c < nmix; c++) {
-                lk_ptn += this_lk_cat[c];
-            }
-            ASSERT(lk_ptn != 0.0);
-            lk_ptn = phylo_tree->ptn_freq[ptn] / lk_ptn;
-            
-            // transform _pattern_lh_cat into posterior probabilities of each category
-            for (c = 0; c < nmix; c++) {
-                this_lk_cat[c] *= lk_ptn;
-                new_prop[c] += this_lk_cat[c];
+        // decoupled weights (prop) from _pattern_lh_cat to obtain L_ci and compute pattern likelihood L_i,
+        // the sums over patterns are taken per block and added in block order,
+        // so that they do not depend on the number of threads
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(max(phylo_tree->num_threads, 1)) if (nblock > 1)
+#endif
+        for (size_t b = 0; b < nblock; b++) {
+            double *this_prop = &block_prop[b*nmix];
+            size_t ptn_end = min(nptn, (b+1)*EM_PATTERN_BLOCK);
+            for (size_t c = 0; c < nmix; c++)
+                this_prop[c] = 0.0;
+            for (size_t ptn = b*EM_PATTERN_BLOCK; ptn < ptn_end; ptn++) {
+                double *this_lk_cat = phylo_tree->_pattern_lh_cat + ptn*nmix;
+                double lk_ptn = phylo_tree->ptn_invar[ptn];
+                for (size_t c = 0; c < nmix; c++) {
+                    lk_ptn += this_lk_cat[c];
+                }
+                ASSERT(lk_ptn != 0.0);
+                lk_ptn = phylo_tree->ptn_freq[ptn] / lk_ptn;
+
+                // transform _pattern_lh_cat into posterior probabilities of each category
+                for (size_t c = 0; c < nmix; c++) {
+                    this_lk_cat[c] *= lk_ptn;
+                    this_prop[c] += this_lk_cat[c];
+                }
             }
         }
+        memset(new_prop, 0, nmix*sizeof(double));
+        for (size_t b = 0; b < nblock; b++)
+            for (c = 0; c < nmix; c++)
+                new_prop[c] += block_prop[b*nmix+c];
         
         // M-step, update weights according to (*)
         int maxpropid = 0;
@@ -623,9 +661,16 @@ double RateFree::optimizeWithEM() {
         
         ASSERT(fabs(sum_prop+new_pinvar-1.0) < MIN_PROP);
         
-        // now optimize rates one by one
-        double sum = 0.0;
-        for (c = 0; c < nmix; c++) {
+        // now optimize rates, each category on its own tree weighted by the posterior probabilities
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(num_workers) if (num_workers > 1)
+#endif
+        for (size_t c = 0; c < nmix; c++) {
+            int worker = 0;
+#ifdef _OPENMP
+            worker = omp_get_thread_num();
+#endif
+            PhyloTree *tree = trees[worker];
             tree->copyPhyloTree(phylo_tree, true);
             ModelMarkov *subst_model;
             if (phylo_tree->getModel()->isMixture() && phylo_tree->getModelFactory()->fused_mix_rate)
@@ -633,8 +678,10 @@ double RateFree::optimizeWithEM() {
             else
                 subst_model = (ModelMarkov*)phylo_tree->getModel();
             tree->setModel(subst_model);
-            subst_model->setTree(tree);
-            model_fac->model = subst_model;
+            // the model may be shared by the workers, it then stays attached to phylo_tree
+            if (num_workers == 1)
+                subst_model->setTree(tree);
+            tree->model_factory->model = subst_model;
             if (subst_model->isMixture() || subst_model->isSiteSpecificModel() || !subst_model->isReversible())
                 tree->setLikelihoodKernel(phylo_tree->sse);
 
@@ -643,18 +690,21 @@ double RateFree::optimizeWithEM() {
             // copy posterior probability into ptn_freq
             tree->computePtnFreq();
             double *this_lk_cat = phylo_tree->_pattern_lh_cat+c;
-            for (ptn = 0; ptn < nptn; ptn++) {
+            for (size_t ptn = 0; ptn < nptn; ptn++) {
                 tree->ptn_freq[ptn] = this_lk_cat[ptn*nmix];
             }
             double scaling = rates[c];
             tree->scaleLength(scaling);
             tree->optimizeTreeLengthScaling(MIN_PROP, scaling, 1.0/prop[c], 0.001);
-            converged = converged && (fabs(rates[c] - scaling) < 1e-4);
-            rates[c] = scaling;
-            sum += prop[c] * rates[c];
+            new_rates[c] = scaling;
             // reset subst model
             tree->setModel(NULL);
-            subst_model->setTree(phylo_tree);
+            if (num_workers == 1)
+                subst_model->setTree(phylo_tree);
+        }
+        for (c = 0; c < nmix; c++) {
+            converged = converged && (fabs(rates[c] - new_rates[c]) < 1e-4);
+            rates[c] = new_rates[c];
         }
         
         phylo_tree->clearAllPartialLH();
@@ -666,12 +716,8 @@ double RateFree::optimizeWithEM() {
         quicksort(rates, 0, ncategory-1, prop);
     }
     
-    // deattach memory
-//    tree->central_partial_lh = NULL;
-//    tree->central_scale_num = NULL;
-//    tree->central_partial_pars = NULL;
-
-    delete tree;
+    for (auto tree : trees)
+        delete tree;
     aligned_free(new_prop);
     return phylo_tree->computeLikelihood();
 }
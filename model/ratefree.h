@@ -98,6 +98,23 @@ public:
     */
     double optimizeWithEM();
 
+    /**
+        create a single-rate tree to optimize the rate of one category in the EM M-step
+        @param nthreads number of threads of the new tree
+        @return new tree, with its own model factory and no substitution model
+    */
+    PhyloTree *createEMRateTree(int nthreads);
+
+    /**
+        number of single-category trees that optimizeWithEM optimizes at the same time:
+        one per thread up to the number of categories, as many as half of the RAM holds
+        @param num_threads number of threads of the tree
+        @param ncategory number of rate categories
+        @param worker_mem memory of one single-category tree in bytes
+        @return number of workers, at least 1
+    */
+    static int getNumEMWorkers(int num_threads, int ncategory, uint64_t worker_mem);
+
 	/**
 		return the number of dimensions
 	*/
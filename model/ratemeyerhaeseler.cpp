@@ -329,10 +329,24 @@ void RateMeyerHaeseler::optimizeRates() {
 	int ambiguous_sites = 0;
 	int nseq = phylo_tree->leafNum;
 	int nstates = phylo_tree->aln->num_states;
+	// tree likelihood: all patterns at once in the eigen space of the model if it allows,
+	// instead of a tree copy per pattern in optimizeRate
+	DoubleVector ml_rates;
+	bool eigen_rates = !rate_mh &&
+		phylo_tree->optimizePatternRatesEigen(ml_rates, MIN_SITE_RATE, MAX_SITE_RATE, false);
 	for (i = 0; i < size(); i++) {
         int freq = phylo_tree->aln->at(i).frequency;
 		if (phylo_tree->aln->at(i).computeAmbiguousChar(nstates) <= nseq-2) {
-			optimizeRate(i);
+			if (eigen_rates) {
+				// same bounds as optimizeRate
+				double optx = ml_rates[i];
+				if (phylo_tree->aln->at(i).isConst() || optx < MIN_SITE_RATE*2)
+					optx = MIN_SITE_RATE;
+				else if (optx > MAX_SITE_RATE*0.99)
+					optx = MAX_SITE_RATE;
+				at(i) = optx;
+			} else
+				optimizeRate(i);
 			if (at(i) == MIN_SITE_RATE) invar_sites += freq;
 			if (at(i) == MAX_SITE_RATE) {
 				saturated_sites += freq;
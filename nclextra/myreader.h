@@ -48,6 +48,11 @@ public:
 			outError(ERR_READ_INPUT);
 	}
 
+	/**
+		constructor for reading from a stream other than inf, e.g. MyToken(istringstream)
+	*/
+	MyReader() : NxsReader() {}
+
 	/**
 		destructor
 	*/
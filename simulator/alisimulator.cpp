@@ -790,11 +790,22 @@ void AliSimulator::simulateSeqsForTree(map<string,string> input_msa, std::vector
 
 void AliSimulator::executeEM(int thread_id, int &sequence_length, int default_segment_length, ModelSubst *model, map<string,string> input_msa, std::vector<bool>* const site_locked_vec, string output_filepath, std::ios_base::openmode open_mode, bool write_sequences_to_tmp_data, bool store_seq_at_cache, int max_depth, vector<string> &state_mapping)
 {
-    ostream *single_output = NULL;
     ostream *out = NULL;
     vector<vector<short int>> sequence_cache;
     int actual_segment_length = sequence_length;
     
+    // with multiple threads, each thread writes its sequence chunks directly into the single output file at their final positions
+    bool write_at_offsets = isWritingChunksAtOffsets() && output_filepath.length() > 0 && !write_sequences_to_tmp_data;
+    if (write_at_offsets)
+    {
+        // the positions are computed from continuous ids of the nodes
+        buildContinousIdsForTree();
+        
+        // create the output file with its first line
+        initOutputFile(out, thread_id, sequence_length, output_filepath, open_mode, write_sequences_to_tmp_data);
+        closeOutputStream(out);
+    }
+    
     // simulate Sequences
     #ifdef _OPENMP
     #pragma omp parallel private(out, thread_id, sequence_cache, actual_segment_length)
@@ -814,8 +825,11 @@ void AliSimulator::executeEM(int thread_id, int &sequence_length, int default_se
             sequence_cache[0] = tree->root->sequence->sequence_chunks[thread_id];
         }
         
-        // init the output stream
-        initOutputFile(out, thread_id, actual_segment_length, output_filepath, open_mode, write_sequences_to_tmp_data);
+        // init the output stream: open the created output file for writing at arbitrary positions, or create a new file
+        if (write_at_offsets)
+            openOutputStream(out, getOutputNameWithExt(params->aln_output_format, output_filepath), std::ios_base::in | std::ios_base::out, true);
+        else
+            initOutputFile(out, thread_id, actual_segment_length, output_filepath, open_mode, write_sequences_to_tmp_data);
         
         // initialize trans_matrix
         double *trans_matrix = new double[max_num_states * max_num_states];
@@ -831,177 +845,21 @@ void AliSimulator::executeEM(int thread_id, int &sequence_length, int default_se
         // release sequence cache
         if (store_seq_at_cache)
             vector<vector<short int>>().swap(sequence_cache);
-        
-        // merge output files into a single file if using multithreading
-        #ifdef _OPENMP
-        #pragma omp barrier
-        #endif
-        mergeOutputFiles(single_output, thread_id, output_filepath, open_mode, write_sequences_to_tmp_data);
             
     #ifdef _OPENMP
     }
     #endif
 }
 
-/**
-    merge output files
-*/
-void AliSimulator::mergeOutputFiles(ostream *&single_output, int thread_id, string output_filepath, std::ios_base::openmode open_mode, bool write_sequences_to_tmp_data)
+bool AliSimulator::isWritingChunksAtOffsets()
 {
-    // skip merging if users want to do so
-    if (params->no_merge) return;
-    
-    if (output_filepath.length() > 0 && !write_sequences_to_tmp_data)
-    {
-        // merge output files into a single file
-        if (num_threads != 1)
-        {
-            // open single_output stream
-            #ifdef _OPENMP
-            #pragma omp single
-            #endif
-            {
-                string single_output_filepath = getOutputNameWithExt(params->aln_output_format, output_filepath);
-                openOutputStream(single_output, single_output_filepath, open_mode);
-                
-                // output the first line
-                string first_line = "";
-                if (params->aln_output_format == IN_PHYLIP)
-                {
-                    int num_nodes = tree->leafNum;
-                    if (params->alisim_write_internal_sequences)
-                        num_nodes = tree->nodeNum;
-                    // don't count the fake root
-                    num_nodes -= ((tree->root->isLeaf() && tree->root->name == ROOT_NAME)?1:0);
-                    
-                    first_line = convertIntToString(num_nodes) + " " + convertIntToString(num_sites_per_state == 1 ? round(expected_num_sites * inverse_length_ratio) : (round(expected_num_sites * inverse_length_ratio) * num_sites_per_state)) + "\n";
-                    *single_output << first_line;
-                }
-                if (!params->do_compression)
-                    starting_pos = single_output->tellp();
-                else
-                    starting_pos = first_line.length();
+    return params->alisim_openmp_alg == EM && num_threads != 1 && !params->no_merge;
+}
 
-                // for Windows only, the line break is \r\n instead of only \n
-                #if defined WIN32 || defined _WIN32 || defined __WIN32__ || defined WIN64
-                ++starting_pos;
-                #endif
-            }
-            
-            // dummy variables
-            vector<ifstream> input_streams(num_threads);
-            uint64_t actual_num_lines_per_thread = 0;
-            uint64_t average_num_lines_per_thread = 0;
-            uint64_t line_num = 0;
-            string line;
-            uint64_t pos = 0;
-            double inverse_num_threads = 1.0 / num_threads;
-            
-            // open all files
-            for (int i = 0; i < input_streams.size(); i++)
-            {
-                // add ".phy" or ".fa" to the output_filepath
-                string tmp_output_filepath = getOutputNameWithExt(params->aln_output_format, output_filepath + "_" + convertIntToString(i + 1));
-                
-                // open an input file
-                input_streams[i].open(tmp_output_filepath.c_str(), std::ifstream::binary);
-                
-                // count num of lines, set start position
-                safeGetline(input_streams[i], line);
-                uint64_t line_length = line.length() + 1;
-                
-                // for Windows only, the line break is \r\n instead of only \n
-                #if defined WIN32 || defined _WIN32 || defined __WIN32__ || defined WIN64
-                ++line_length;
-                #endif
-                
-                // when using FunDi, the entire sequences are written into one of output files -> need to check average_num_lines_per_thread == 0
-                if (i == 0 || average_num_lines_per_thread == 0)
-                {
-                    input_streams[i].seekg(0, input_streams[i].end);
-                    uint64_t length = input_streams[i].tellg();
-                    uint64_t total_num_lines = length/line_length;
-                    average_num_lines_per_thread = total_num_lines * inverse_num_threads;
-                    
-                    // compute the starting line number
-                    pos = thread_id * average_num_lines_per_thread;
-                    
-                    // compute actual_num_lines_per_thread
-                    actual_num_lines_per_thread = thread_id < (num_threads - 1) ? average_num_lines_per_thread : total_num_lines - pos;
-                    
-                    
-                }
-                // set start position
-                input_streams[i].seekg(pos * line_length);
-            }
-            
-            // compute pos in the output file
-            pos = starting_pos + (pos - 1) * output_line_length;
-            
-            // merge chunks of each sequence and write to the single output file
-            for (line_num = 0; line_num < actual_num_lines_per_thread; line_num++)
-            {
-                string output = "";
-                for (int j = 0; j < input_streams.size(); j++)
-                {
-                    safeGetline(input_streams[j], line);
-                    output += line;
-                }
-                
-                if (output.length() > 0)
-                {
-                    // if using FASTA -> break sequence name into new line
-                    if (params->aln_output_format == IN_FASTA)
-                    {
-                        // insert '>' into sequence name
-                        output = ">" + output;
-                        
-                        // insert break line
-                        for (int i = 1; i < output.length(); i++)
-                            if (output[i-1] == ' ' && output[i] != ' ')
-                            {
-                                output[i-1] = '\n';
-                                break;
-                            }
-                    }
-                    
-                    // add the break line for the current output
-                    output += "\n";
-                    
-                    // update pos for the current output line
-                    pos += output_line_length;
-                
-                    // write the concatenated sequence into file
-                    #ifdef _OPENMP
-                    #pragma omp critical
-                    #endif
-                    {
-                        // jump to the correct position before writing if users want to keep the sequence order
-                        if (params->keep_seq_order)
-                            single_output->seekp(pos);
-                        (*single_output) << output;
-                    }
-                }
-            }
-            
-            // close all files
-            for (int i = 0; i < input_streams.size(); i++)
-                input_streams[i].close();
-            
-            // close single_output stream
-            #ifdef _OPENMP
-            #pragma omp barrier
-            #pragma omp single
-            #endif
-            closeOutputStream(single_output);
-            
-            // delete all intermidate files
-            // add ".phy" or ".fa" to the output_filepath
-            string tmp_output_filepath = getOutputNameWithExt(params->aln_output_format, output_filepath + "_" + convertIntToString(thread_id + 1));
-            // delete file
-            remove(tmp_output_filepath.c_str());
-        }
-    }
+int64_t AliSimulator::getSeqChunkPos(Node *node, int thread_id, int segment_start)
+{
+    int64_t pos = ((int64_t)node_continuous_id[node->id]) * ((int64_t)output_line_length);
+    return pos + starting_pos + (num_sites_per_state == 1 ? segment_start : (segment_start * num_sites_per_state)) + (thread_id == 0 ? 0 : seq_name_length);
 }
 
 void AliSimulator::executeIM(int thread_id, int &sequence_length, int default_segment_length, ModelSubst *model, map<string,string> input_msa, std::vector<bool>* const site_locked_vec, string output_filepath, std::ios_base::openmode open_mode, bool write_sequences_to_tmp_data, bool store_seq_at_cache, int max_depth, vector<string> &state_mapping)
@@ -1309,9 +1167,7 @@ void AliSimulator::initVariables(int sequence_length, string output_filepath, ve
     
     // reset variables at nodes (essential when simulating multiple alignments)
     resetTree(max_depth, store_seq_at_cache);
-    
-    // if using AliSim-OpenMP-EM algorithm, update whether we need to output temporary files in PHYLIP format
-    force_output_PHYLIP = params->alisim_openmp_alg == EM && num_threads != 1 && !params->no_merge;
+
 }
 
 /**
@@ -1332,16 +1188,17 @@ void AliSimulator::initOutputFile(ostream *&out, int thread_id, int actual_segme
         // otherwise, just add ".phy" or ".fa" to the output_filepath
         else
         {
-            // only add thread_id to filename if using multiple threads with AliSim-OpenMP-EM
+            // only add thread_id to filename if each thread of AliSim-OpenMP-EM writes its own file (--no-merge)
+            bool separate_files = params->alisim_openmp_alg == EM && num_threads != 1 && params->no_merge;
             string thread_id_str = "";
-            if (params->alisim_openmp_alg == EM && num_threads != 1)
+            if (separate_files)
                 thread_id_str = "_" + convertIntToString(thread_id + 1);
             
             // add ".phy" or ".fa" to the output_filepath
             output_filepath = getOutputNameWithExt(params->aln_output_format, output_filepath + thread_id_str);
             
             // open the output stream (create new or append an existing file)
-            if (params->alisim_openmp_alg == EM && num_threads != 1)
+            if (separate_files)
                 openOutputStream(out, output_filepath, std::ios_base::out, true);
             else
                 openOutputStream(out, output_filepath, open_mode);
@@ -1357,18 +1214,9 @@ void AliSimulator::initOutputFile(ostream *&out, int thread_id, int actual_segme
             // don't count the fake root
             num_nodes -= ((tree->root->isLeaf() && tree->root->name == ROOT_NAME)?1:0);
             
-            // if using AliSim-OpenMP-EM algorithm
-            if (params->alisim_openmp_alg == EM)
-            {
-                // only output the first line in the singlethreading mode;
-                // in multithreading mode:
-                // -> without merging intermediate output files -> also output the first line
-                // -> with merging step -> the first line will be output later when merging output files
-                if (num_threads == 1
-                    || (num_threads != 1 && params->no_merge))
-                    *out << num_nodes << " " << round(actual_segment_length * inverse_length_ratio) * num_sites_per_state << endl;
-            }
-            // if using AliSim-OpenMP-IM algorithm
+            // if each thread of AliSim-OpenMP-EM writes its own file, the first line gives the length of its segment
+            if (params->alisim_openmp_alg == EM && num_threads != 1 && params->no_merge)
+                *out << num_nodes << " " << round(actual_segment_length * inverse_length_ratio) * num_sites_per_state << endl;
             else
             {
                 first_line = convertIntToString(num_nodes) + " " + convertIntToString(round(expected_num_sites * inverse_length_ratio) * num_sites_per_state) + "\n";
@@ -1377,7 +1225,7 @@ void AliSimulator::initOutputFile(ostream *&out, int thread_id, int actual_segme
         }
         
         // get the starting position for writing
-        if (params->alisim_openmp_alg == IM)
+        if (params->alisim_openmp_alg == IM || isWritingChunksAtOffsets())
         {
             if (!params->do_compression)
                 starting_pos = out->tellp();
@@ -1746,7 +1594,7 @@ void AliSimulator::mergeAndWriteSeqIndelFunDi(int thread_id, ostream &out, int s
                     else
                     {
                         // export pre_output string (containing taxon name and ">" or "space" based on the output format)
-                        string pre_output = exportPreOutputString((*it)->node, params->aln_output_format, max_length_taxa_name, force_output_PHYLIP);
+                        string pre_output = exportPreOutputString((*it)->node, params->aln_output_format, max_length_taxa_name);
                         string output(num_sites_per_state == 1 ? sequence_length : (sequence_length * num_sites_per_state), '-');
                         
                         // convert numerical states into readable characters
@@ -1765,7 +1613,11 @@ void AliSimulator::mergeAndWriteSeqIndelFunDi(int thread_id, ostream &out, int s
                         #ifdef _OPENMP
                         #pragma omp critical
                         #endif
+                        {
+                            if (isWritingChunksAtOffsets())
+                                out.seekp(getSeqChunkPos((*it)->node, 0, 0));
                             out << pre_output << output << "\n";
+                        }
                     }
                 }
                 
@@ -1778,7 +1630,7 @@ void AliSimulator::mergeAndWriteSeqIndelFunDi(int thread_id, ostream &out, int s
                     else
                     {
                         // export pre_output string (containing taxon name and ">" or "space" based on the output format)
-                        string pre_output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name, force_output_PHYLIP);
+                        string pre_output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name);
                         string output(num_sites_per_state == 1 ? sequence_length : (sequence_length * num_sites_per_state), '-');
                         
                         // convert numerical states into readable characters
@@ -1797,7 +1649,11 @@ void AliSimulator::mergeAndWriteSeqIndelFunDi(int thread_id, ostream &out, int s
                         #ifdef _OPENMP
                         #pragma omp critical
                         #endif
+                        {
+                            if (isWritingChunksAtOffsets())
+                                out.seekp(getSeqChunkPos(node, 0, 0));
                             out << pre_output << output << "\n";
+                        }
                     }
                 }
             }
@@ -1889,24 +1745,21 @@ void AliSimulator::outputOneSequence(Node* node, string &output, int thread_id,
     // output a sequence with AliSim-OpenMP-EM
     if (params->alisim_openmp_alg == EM)
     {
-        // only write sequence name in the first thread
-        if (thread_id == 0)
+        // write the chunk at its position in the single output file
+        if (isWritingChunksAtOffsets())
         {
-            string pre_output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name, force_output_PHYLIP);
-            out << pre_output << output << "\n";
+            if (thread_id == 0)
+                output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name) + output;
+            if (thread_id == num_simulating_threads - 1)
+                output = output + "\n";
+            out.seekp(getSeqChunkPos(node, thread_id, segment_start));
+            out << output;
         }
-        // write sequence chunk in other threads
+        // a single thread, or each thread writes its own file (--no-merge)
         else
         {
-            // if users skip concatenating sequence chunks from intermediate files -> write sequence name
-            if (params->no_merge)
-            {
-                string pre_output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name);
-                out << pre_output << output << "\n";
-            }
-            // don't write the sequence name in intermediate files
-            else
-                out << output << "\n";
+            string pre_output = exportPreOutputString(node, params->aln_output_format, max_length_taxa_name);
+            out << pre_output << output << "\n";
         }
     }
     // output a sequence with AliSim-OpenMP-IM
@@ -1922,11 +1775,7 @@ void AliSimulator::outputOneSequence(Node* node, string &output, int thread_id,
         
         //  cache output into the writing queue
         if (num_threads != 1)
-        {
-            int64_t pos = ((int64_t)node_continuous_id[node->id]) * ((int64_t)output_line_length);
-            pos += starting_pos + (num_sites_per_state == 1 ? segment_start : (segment_start * num_sites_per_state)) + (thread_id == 0 ? 0 : seq_name_length);
-            cacheSeqChunkStr(pos, output, thread_id);
-        }
+            cacheSeqChunkStr(getSeqChunkPos(node, thread_id, segment_start), output, thread_id);
         // write output to file
         else
             out << output;
@@ -1971,7 +1820,7 @@ void AliSimulator::cacheSeqChunkStr(int64_t pos, string seq_chunk_str, int threa
 *  export pre_output string (contains taxon name and ">" or "space" based on the output format
 *
 */
-string AliSimulator::exportPreOutputString(Node *node, InputType output_format, int max_length_taxa_name, bool force_PHYLIP)
+string AliSimulator::exportPreOutputString(Node *node, InputType output_format, int max_length_taxa_name)
 {
     string pre_output = "";
     
@@ -1982,7 +1831,7 @@ string AliSimulator::exportPreOutputString(Node *node, InputType output_format,
     pre_output.resize(max_length_taxa_name, ' ');
     
     // in FASTA format
-    if (output_format == IN_FASTA && !force_PHYLIP)
+    if (output_format == IN_FASTA)
     {
         pre_output = ">" + pre_output;
         pre_output[pre_output.length() - 1] = '\n';
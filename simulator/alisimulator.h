@@ -424,9 +424,17 @@ protected:
     void executeEM(int thread_id, int &sequence_length, int default_segment_length, ModelSubst *model, map<string,string> input_msa, std::vector<bool>* const site_locked_vec, string output_filepath, std::ios_base::openmode open_mode, bool write_sequences_to_tmp_data, bool store_seq_at_cache, int max_depth, vector<string> &state_mapping);
     
     /**
-        merge output files when using multiple threads
+        @return TRUE if threads of AliSim-OpenMP-EM write their sequence chunks directly into a single output file
     */
-    void mergeOutputFiles(ostream *&single_output, int thread_id, string output_filepath, std::ios_base::openmode open_mode, bool write_sequences_to_tmp_data);
+    bool isWritingChunksAtOffsets();
+    
+    /**
+        get the position of a sequence chunk in the output file
+        @param node the node of the sequence
+        @param thread_id the thread simulating the chunk, the chunk of thread 0 starts with the sequence name
+        @param segment_start the first site of the chunk
+    */
+    int64_t getSeqChunkPos(Node *node, int thread_id, int segment_start);
     
     /**
         output a sequence to file (if using AliSim-OpenMP-EM) or store it to common cache (if using AliSim-OpenMP-IM)
@@ -475,7 +483,6 @@ public:
     vector<SequenceChunkStr> seq_str_cache;
     vector<int> cache_start_indexes;
     int cache_size_per_thread;
-    bool force_output_PHYLIP = false;
     vector<int> node_continuous_id;
     
     // variables using for posterior mean rates/state frequencies
@@ -533,7 +540,7 @@ public:
     *  export pre_output string (containing taxon name and ">" or "space" based on the output format)
     *
     */
-    static string exportPreOutputString(Node *node, InputType output_format, int max_length_taxa_name, bool force_PHYLIP = false);
+    static string exportPreOutputString(Node *node, InputType output_format, int max_length_taxa_name);
 
     /**
     *  update new genome from original genome and the genome tree for each tips (due to Indels)
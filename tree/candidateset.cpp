@@ -437,9 +437,9 @@ int CandidateSet::computeSplitOccurences(double supportThreshold) {
             }
         }
     }
-    int newNumStableSplits = countStableSplits(supportThreshold);
+    numStableSplits = countStableSplits(supportThreshold);
     if (verbose_mode >= VB_MED) {
-        cout << ((double) newNumStableSplits / (aln->getNSeq() - 3)) * 100;
+        cout << ((double) numStableSplits / (aln->getNSeq() - 3)) * 100;
         cout << " % of the splits are stable (support threshold " << supportThreshold;
         cout << " from " << candSplits.getNumTree() << " trees)" << endl;
     }
@@ -2481,12 +2481,20 @@ double IQTree::doTreeSearch() {
         nniInfos = doNNISearch();
         curTree = getTreeString();
         int pos = addTreeToCandidateSet(curTree, curScore, true, MPIHelper::getInstance().getProcessID());
-        if (pos != -2 && pos != -1 && (Params::getInstance().fixStableSplits || Params::getInstance().adaptPertubation))
-            candidateTrees.computeSplitOccurences(Params::getInstance().stableSplitThreshold);
+        double split_stability = -1.0;
+        if (pos != -2 && pos != -1 && (Params::getInstance().fixStableSplits || Params::getInstance().adaptPertubation
+                                       || stop_rule.isConvergenceMonitored())) {
+            int num_stable = candidateTrees.computeSplitOccurences(Params::getInstance().stableSplitThreshold);
+            if (candidateTrees.size() > 1 && aln->getNSeq() > 3)
+                split_stability = (double)num_stable / (aln->getNSeq() - 3);
+        }
 
         if (MPIHelper::getInstance().isWorker() || MPIHelper::getInstance().gotMessage())
             syncCurrentTree();
 
+        // after syncing, the candidate set also reflects trees found by other processes
+        if (stop_rule.isConvergenceMonitored())
+            stop_rule.updateConvergence(candidateTrees.getBestScore(), pos >= 0, split_stability);
 
         // TODO: cannot check yet, need to somehow return treechanged
 //        if (nni_count == 0 && params->snni && numPerturb > 0 && treechanged) {
@@ -2811,6 +2819,90 @@ void IQTree::refineBootTrees(){
 }
 */
 
+IQTree *IQTree::createRefineBootTree(int sample, ModelsBlock *models_block, int nthreads) {
+    // create bootstrap alignment
+    Alignment* bootstrap_alignment;
+    if (aln->isSuperAlignment()) {
+        bootstrap_alignment = new SuperAlignment;
+        bootstrap_alignment->createBootstrapAlignment(aln, NULL, params->bootstrap_spec);
+    } else {
+        // the UFBoot sample is a weight vector over the patterns of aln:
+        // the replicate tree works on aln itself, weighted by the sample
+        bootstrap_alignment = aln;
+    }
+
+    // create bootstrap tree
+    IQTree *boot_tree;
+    if (aln->isSuperAlignment()){
+        if(params->partition_type != BRLEN_OPTIMIZE){
+            boot_tree = new PhyloSuperTreePlen((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) this);
+        } else {
+            boot_tree = new PhyloSuperTree((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) this);
+        }
+    } else {
+        // allocate heterotachy tree if neccessary
+        int pos = posRateHeterotachy(aln->model_name);
+
+        if (params->num_mixlen > 1) {
+            boot_tree = new PhyloTreeMixlen(bootstrap_alignment, params->num_mixlen);
+        } else if (pos != string::npos) {
+            boot_tree = new PhyloTreeMixlen(bootstrap_alignment, 0);
+        } else
+            boot_tree = new IQTree(bootstrap_alignment);
+    }
+    boot_tree->on_refine_btree = true;
+    boot_tree->save_all_trees = 0;
+    if (bootstrap_alignment == aln)
+        boot_tree->ptn_freq_weights = boot_samples[sample];
+
+    // initialize constraint tree
+    if (!constraintTree.empty()) {
+        boot_tree->constraintTree.readConstraint(constraintTree);
+    }
+
+    // set likelihood kernel
+    boot_tree->setParams(params);
+    boot_tree->setLikelihoodKernel(sse);
+    boot_tree->setNumThreads(nthreads);
+    // 2019-06-03: bug fix setting part_info properly
+    if (boot_tree->isSuperTree())
+        ((PhyloSuperTree*)boot_tree)->setPartInfo((PhyloSuperTree*)this);
+    // copy model
+    // BQM 2019-05-31: bug fix with -bsam option
+    boot_tree->initializeModel(*params, aln->model_name, models_block);
+    boot_tree->getModelFactory()->setCheckpoint(getCheckpoint());
+    if (isSuperTree())
+        ((PartitionModel*)boot_tree->getModelFactory())->PartitionModel::restoreCheckpoint();
+    else
+        boot_tree->getModelFactory()->restoreCheckpoint();
+    // workers run concurrently: from now on each keeps its state in a checkpoint of its own
+    Checkpoint *worker_checkpoint = new Checkpoint;
+    boot_tree->setCheckpoint(worker_checkpoint);
+    boot_tree->getModelFactory()->setCheckpoint(worker_checkpoint);
+    // load the current ufboot tree
+    // 2019-02-06: fix crash with -sp and -bnni
+    if (isSuperTree())
+        boot_tree->PhyloTree::readTreeString(boot_trees[sample]);
+    else
+        boot_tree->readTreeString(boot_trees[sample]);
+
+    if (boot_tree->isSuperTree() && params->partition_type == BRLEN_OPTIMIZE) {
+        if (((PhyloSuperTree*)boot_tree)->size() > 1) {
+            // re-initialize branch lengths for unlinked model
+            boot_tree->wrapperFixNegativeBranch(true);
+        }
+    }
+
+    // TODO: check if this resolves the crash in reorientPartialLh()
+    boot_tree->initializeAllPartialLh();
+
+    // just in case some branch lengths are negative
+    if (int num_neg = boot_tree->wrapperFixNegativeBranch(false))
+        outWarning("Bootstrap tree " + convertIntToString(sample+1) + " has " +
+            convertIntToString(num_neg) + "non-positive branch lengths");
+    return boot_tree;
+}
+
 /**********************************************************
  * STANDARD NON-PARAMETRIC BOOTSTRAP
  ***********************************************************/
@@ -2851,128 +2943,95 @@ void IQTree::refineBootTrees() {
     deleteAllPartialLh();
 
     ModelsBlock *models_block = readModelsDefinition(*params);
-    
-	// do bootstrap analysis
-	for (int sample = refined_samples; sample < boot_trees.size(); sample++) {
-        // create bootstrap alignment
-        Alignment* bootstrap_alignment;
-        if (aln->isSuperAlignment())
-            bootstrap_alignment = new SuperAlignment;
-        else
-            bootstrap_alignment = new Alignment;
-        bootstrap_alignment->createBootstrapAlignment(aln, NULL, params->bootstrap_spec);
-
-        // create bootstrap tree
-        IQTree *boot_tree;
-        if (aln->isSuperAlignment()){
-            if(params->partition_type != BRLEN_OPTIMIZE){
-                boot_tree = new PhyloSuperTreePlen((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) this);
-            } else {
-                boot_tree = new PhyloSuperTree((SuperAlignment*) bootstrap_alignment, (PhyloSuperTree*) this);
-            }
-        } else {
-            // allocate heterotachy tree if neccessary
-            int pos = posRateHeterotachy(aln->model_name);
-            
-            if (params->num_mixlen > 1) {
-                boot_tree = new PhyloTreeMixlen(bootstrap_alignment, params->num_mixlen);
-            } else if (pos != string::npos) {
-                boot_tree = new PhyloTreeMixlen(bootstrap_alignment, 0);
-            } else
-                boot_tree = new IQTree(bootstrap_alignment);
-        }
-
-        boot_tree->on_refine_btree = true;
-        boot_tree->save_all_trees = 0;
-
-        // initialize constraint tree
-        if (!constraintTree.empty()) {
-            boot_tree->constraintTree.readConstraint(constraintTree);
-        }
-
-        // set likelihood kernel
-        boot_tree->setParams(params);
-        boot_tree->setLikelihoodKernel(sse);
-        boot_tree->setNumThreads(num_threads);
-
-        // 2019-06-03: bug fix setting part_info properly
-        if (boot_tree->isSuperTree())
-            ((PhyloSuperTree*)boot_tree)->setPartInfo((PhyloSuperTree*)this);
 
-        // copy model
-        // BQM 2019-05-31: bug fix with -bsam option
-        boot_tree->initializeModel(*params, aln->model_name, models_block);
-        boot_tree->getModelFactory()->setCheckpoint(getCheckpoint());
-        if (isSuperTree())
-            ((PartitionModel*)boot_tree->getModelFactory())->PartitionModel::restoreCheckpoint();
-        else
-            boot_tree->getModelFactory()->restoreCheckpoint();
-
-        // load the current ufboot tree
-        // 2019-02-06: fix crash with -sp and -bnni
-        if (isSuperTree())
-            boot_tree->PhyloTree::readTreeString(boot_trees[sample]);
-        else
-            boot_tree->readTreeString(boot_trees[sample]);
-        
-        if (boot_tree->isSuperTree() && params->partition_type == BRLEN_OPTIMIZE) {
-            if (((PhyloSuperTree*)boot_tree)->size() > 1) {
-                // re-initialize branch lengths for unlinked model
-                boot_tree->wrapperFixNegativeBranch(true);
-            }
-        }
-        
-        // TODO: check if this resolves the crash in reorientPartialLh()
-        boot_tree->initializeAllPartialLh();
+    // replicates are refined concurrently by independent single-threaded workers,
+    // as many as the threads of this tree and the memory allow
+    int num_workers = 1;
+#ifdef _OPENMP
+    num_workers = min(num_threads, (int)boot_trees.size() - refined_samples);
+    uint64_t worker_mem = getMemoryRequired();
+    if (worker_mem > 0)
+        num_workers = min((uint64_t)num_workers, max((uint64_t)1, getMemorySize() / 2 / worker_mem));
+    num_workers = max(num_workers, 1);
+    if (num_workers > 1)
+        cout << "Using " << num_workers << " replicate workers" << endl;
+#endif
 
-        // just in case some branch lengths are negative
-        if (int num_neg = boot_tree->wrapperFixNegativeBranch(false))
-            outWarning("Bootstrap tree " + convertIntToString(sample+1) + " has " +
-                convertIntToString(num_neg) + "non-positive branch lengths");
+	// do bootstrap analysis
+	for (int first = refined_samples; first < boot_trees.size(); first += num_workers) {
+        int last = min(first + num_workers, (int)boot_trees.size());
 
-        // REMARK: branch lengths were estimated from original alignments
-        // for bootstrap_alignment, they still thus need to be reoptimized a bit
-        boot_tree->optimizeBranches(2);
+        // set up the workers one by one, as they read the model from the checkpoint
+        vector<IQTree*> boot_tree(last - first);
+        for (int sample = first; sample < last; sample++)
+            boot_tree[sample-first] = createRefineBootTree(sample, models_block, (num_workers > 1) ? 1 : num_threads);
 
+        vector<int> num_nni_steps(last - first);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(last - first) if (last - first > 1)
+#endif
+        for (int i = 0; i < last - first; i++) {
+            // each replicate draws from its own stream seeded by its index,
+            // so that the result does not depend on the number of workers
+            int *saved_randstream = randstream;
+#ifdef _OPENMP
+#pragma omp critical (random_streams)
+#endif
+            init_random(params->ran_seed + first + i + 1);
 
-        auto num_nnis = boot_tree->doNNISearch();
-        if (num_nnis.second != 0)
-            refined_trees++;
+            // REMARK: branch lengths were estimated from original alignments
+            // for bootstrap_alignment, they still thus need to be reoptimized a bit
+            boot_tree[i]->optimizeBranches(2);
+            num_nni_steps[i] = boot_tree[i]->doNNISearch().second;
 
-        if (verbose_mode >= VB_MED) {
-            cout << "UFBoot tree " << sample+1 << ": " << boot_logl[sample] << " -> " << boot_tree->getCurScore() << endl;
+#ifdef _OPENMP
+#pragma omp critical (random_streams)
+#endif
+            finish_random();
+            randstream = saved_randstream;
         }
 
-        stringstream ostr;
-        if (params->print_ufboot_trees == 2)
-            boot_tree->printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA | WT_BR_LEN | WT_BR_LEN_SHORT);
-        else
-            boot_tree->printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
-        boot_trees[sample] = ostr.str();
-        boot_logl[sample] = boot_tree->curScore;
-
+        // collect the refined trees in the order of the replicates
+        for (int sample = first; sample < last; sample++) {
+            IQTree *tree = boot_tree[sample-first];
+            if (num_nni_steps[sample-first] != 0)
+                refined_trees++;
 
-        // delete memory
-        //boot_tree->setModelFactory(NULL);
-        boot_tree->save_all_trees = 2;
-
-        bootstrap_alignment = boot_tree->aln;
-        delete boot_tree;
-        // fix bug: bootstrap_alignment might be changed
-        delete bootstrap_alignment;
+            if (verbose_mode >= VB_MED) {
+                cout << "UFBoot tree " << sample+1 << ": " << boot_logl[sample] << " -> " << tree->getCurScore() << endl;
+            }
 
+            stringstream ostr;
+            if (params->print_ufboot_trees == 2)
+                tree->printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA | WT_BR_LEN | WT_BR_LEN_SHORT);
+            else
+                tree->printTree(ostr, WT_TAXON_ID | WT_SORT_TAXA);
+            boot_trees[sample] = ostr.str();
+            boot_logl[sample] = tree->curScore;
+
+            // delete memory
+            //boot_tree->setModelFactory(NULL);
+            tree->save_all_trees = 2;
+
+            Alignment *bootstrap_alignment = tree->aln;
+            Checkpoint *worker_checkpoint = tree->getCheckpoint();
+            delete tree;
+            delete worker_checkpoint;
+            // fix bug: bootstrap_alignment might be changed
+            if (bootstrap_alignment != aln)
+                delete bootstrap_alignment;
 
-        if ((sample+1) % 100 == 0)
-            cout << sample+1 << " samples done" << endl;
+            if ((sample+1) % 100 == 0)
+                cout << sample+1 << " samples done" << endl;
 
-        saveCheckpoint();
-        checkpoint->startStruct("UFBoot");
-        refined_samples = sample;
-        CKP_SAVE(refined_samples);
-        checkpoint->endStruct();
-
-        checkpoint->dump();
+            saveCheckpoint();
+            checkpoint->startStruct("UFBoot");
+            refined_samples = sample;
+            CKP_SAVE(refined_samples);
+            checkpoint->endStruct();
 
+            checkpoint->dump();
+        }
 	}
     
     delete models_block;
@@ -3155,6 +3214,10 @@ pair<int, int> IQTree::doNNISearch(bool write_info) {
             }
         }
     }
+    // UFBoot replicates may be refined concurrently
+#ifdef _OPENMP
+#pragma omp critical
+#endif
     MPIHelper::getInstance().setNumNNISearch(MPIHelper::getInstance().getNumNNISearch() + 1);
 
     return nniInfos;
@@ -1019,6 +1019,15 @@ public:
 
     // Diep added for UFBoot2-Corr
     void refineBootTrees();
+
+    /**
+        create the tree refining one UFBoot replicate, with the model restored from the checkpoint
+        @param sample index of the UFBoot replicate
+        @param models_block user-defined models
+        @param nthreads number of threads of the new tree
+        @return new tree on the bootstrap alignment, loaded with the current UFBoot tree
+    */
+    IQTree *createRefineBootTree(int sample, ModelsBlock *models_block, int nthreads);
     bool on_refine_btree;
     Alignment* saved_aln_on_refine_btree;
     vector<IntVector> boot_samples_int;
@@ -1880,13 +1880,11 @@ void IQTreeMix::initSettings(Params &params) {
     IQTree::initSettings(params);
 }
 
-uint64_t IQTreeMix::getMemoryRequired(size_t ncategory, bool full_mem) {
-    uint64_t mem_size = 0;
+void IQTreeMix::getMemoryComponents(MemoryComponents &mem, size_t ncategory, bool full_mem) {
     size_t i;
     for (i=0; i<size(); i++) {
-        mem_size += at(i)->getMemoryRequired(ncategory, full_mem);
+        at(i)->getMemoryComponents(mem, ncategory, full_mem);
     }
-    return mem_size;
 }
 
 // get memory requirement for ModelFinder
@@ -3324,7 +3322,11 @@ void IQTreeMix::computeParsimony() {
     for (size_t optn=0; optn<noptn; optn++) {
         if (aln->ordered_pattern[optn].frequency == 0)
             continue;
-        opattern2id.insert(pair<Pattern,int>(aln->ordered_pattern.at(optn),optn));
+        Pattern pat(aln->ordered_pattern[optn]);
+        pat.resize(aln->getNSeq());
+        for (size_t seq = 0; seq < pat.size(); seq++)
+            pat[seq] = aln->getOrderedTipState(seq, optn);
+        opattern2id.insert(pair<Pattern,int>(pat,optn));
         
         /*
         cout << optn+1;
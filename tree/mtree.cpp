@@ -25,6 +25,7 @@
 #include "pda/splitgraph.h"
 #include "utils/tools.h"
 #include "mtreeset.h"
+#include "utils/gzstream.h"
 using namespace std;
 
 /*********************************************
@@ -685,7 +686,7 @@ void MTree::printTaxa(ostream &out, NodeVector &subtree) {
 }
 
 void MTree::readTree(const char *infile, bool &is_rooted, int tree_line_index) {
-    ifstream in;
+    igzstream in;
     try {
         in.exceptions(ios::failbit | ios::badbit);
         in.open(infile);
@@ -15,6 +15,10 @@
 #endif
 #include <vectorclass/vectorclass.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef __SSE2__
 inline Vec2d horizontal_add(Vec2d x[2]) {
 #if  INSTRSET >= 3  // SSE3
@@ -1438,6 +1442,22 @@ inline UINT fast_popcount(Vec8ui &x) {
 
 }
 
+#if MAX_VECTOR_SIZE >= 512
+inline UINT fast_popcount(Vec16ui &x) {
+#if defined(__AVX512VPOPCNTDQ__)
+    // one VPOPCNTQ over the whole register
+    return (UINT)_mm512_reduce_add_epi64(_mm512_popcnt_epi64(x));
+#else
+    MEM_ALIGN_BEGIN uint64_t vec[8] MEM_ALIGN_END;
+    x.store(vec);
+    UINT res = 0;
+    for (int i = 0; i < 8; i++)
+        res += (UINT)_mm_popcnt_u64(vec[i]);
+    return res;
+#endif
+}
+#endif
+
 inline void horizontal_popcount(Vec4ui &x) {
     MEM_ALIGN_BEGIN UINT vec[4] MEM_ALIGN_END;
     x.store_a(vec);
@@ -1462,6 +1482,39 @@ inline void horizontal_popcount(Vec8ui &x) {
     x.load_a(vec);
 }
 
+/**
+ Fitch step for one column of VectorClass::size()*UINT_BITS sites
+ @param x, y children's bit vectors, one VectorClass per state
+ @param z (OUT) parent's bit vectors
+ @return number of substitutions in this column
+ */
+template<class VectorClass, const int NSTATES>
+inline UINT computePartialParsimonyFitchColumn(VectorClass *x, VectorClass *y, VectorClass *z, int nstates) {
+    const int n = NSTATES ? NSTATES : nstates;
+    VectorClass w = 0;
+    for (int i = 0; i < n; i++) {
+        z[i] = x[i] & y[i];
+        w |= z[i];
+    }
+    w = ~w;
+    for (int i = 0; i < n; i++)
+        z[i] |= w & (x[i] | y[i]);
+    return fast_popcount(w);
+}
+
+/**
+ @return number of substitutions on a branch for one column of VectorClass::size()*UINT_BITS sites
+ */
+template<class VectorClass, const int NSTATES>
+inline UINT computeParsimonyBranchFitchColumn(VectorClass *x, VectorClass *y, int nstates) {
+    const int n = NSTATES ? NSTATES : nstates;
+    VectorClass w = x[0] & y[0];
+    for (int i = 1; i < n; i++)
+        w |= x[i] & y[i];
+    w = ~w;
+    return fast_popcount(w);
+}
+
 template<class VectorClass>
 void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad) {
     if (dad_branch->partial_lh_computed & 2)
@@ -1508,9 +1561,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
             switch ((*alnit)->seq_type) {
             case SEQ_DNA:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 4) {
                         for (int j = 0; j < freq; j++, site++) {
                             if (site == NUM_BITS) {
@@ -1551,9 +1603,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
                 break;
             case SEQ_PROTEIN:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 20) {
                         for (int j = 0; j < freq; j++, site++) {
                             if (site == NUM_BITS) {
@@ -1592,9 +1643,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
             break;
             default:
             for (int patid = start_pos; patid != end_pos; patid++) {
-                Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                int state = pat->at(leafid);
-                int freq = pat->frequency;
+                int state = aln->getOrderedTipState(leafid, patid);
+                int freq = aln->ordered_pattern[patid].frequency;
                 if (aln->seq_type == SEQ_POMO && state >= nstates 
                     && state < aln->STATE_UNKNOWN) {
                     state -= nstates;
@@ -1699,20 +1749,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
             #endif
             for (site = 0; site<nsites; site++) {
                 size_t offset = entry_size*site;
-                VectorClass *x = (VectorClass*)(left->partial_pars + offset);
-                VectorClass *y = (VectorClass*)(right->partial_pars + offset);
-                VectorClass *z = (VectorClass*)(dad_branch->partial_pars + offset);
-                z[0] = x[0] & y[0];
-                z[1] = x[1] & y[1];
-                z[2] = x[2] & y[2];
-                z[3] = x[3] & y[3];
-                VectorClass w = z[0] | z[1] | z[2] | z[3];
-                w = ~w;
-                z[0] |= w & (x[0] | y[0]);
-                z[1] |= w & (x[1] | y[1]);
-                z[2] |= w & (x[2] | y[2]);
-                z[3] |= w & (x[3] | y[3]);
-                score += fast_popcount(w);
+                score += computePartialParsimonyFitchColumn<VectorClass, 4>((VectorClass*)(left->partial_pars + offset),
+                    (VectorClass*)(right->partial_pars + offset), (VectorClass*)(dad_branch->partial_pars + offset), nstates);
             }
             break;
                 
@@ -1722,20 +1760,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
             #endif
             for (site = 0; site<nsites; site++) {
                 size_t offset = entry_size*site;
-                VectorClass *x = (VectorClass*)(left->partial_pars + offset);
-                VectorClass *y = (VectorClass*)(right->partial_pars + offset);
-                VectorClass *z = (VectorClass*)(dad_branch->partial_pars + offset);
-                int i;
-                VectorClass w = 0;
-                for (i = 0; i < nstates; i++) {
-                    z[i] = x[i] & y[i];
-                    w |= z[i];
-                }
-                w = ~w;
-                for (i = 0; i < nstates; i++) {
-                    z[i] |= w & (x[i] | y[i]);
-                }
-                score += fast_popcount(w);
+                score += computePartialParsimonyFitchColumn<VectorClass, 0>((VectorClass*)(left->partial_pars + offset),
+                    (VectorClass*)(right->partial_pars + offset), (VectorClass*)(dad_branch->partial_pars + offset), nstates);
             }
             break;
                 
@@ -1744,6 +1770,79 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
     }
 }
 
+template<class VectorClass>
+void PhyloTree::collectParsimonyTraversalFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, vector<ParsimonyTraversalInfo> &traversal) {
+    if (dad_branch->partial_lh_computed & 2)
+        return;
+    Node *node = dad_branch->node;
+    if (node->name == ROOT_NAME || node->isLeaf()) {
+        // tip bit vectors are filled serially site by site
+        computePartialParsimonyFastSIMD<VectorClass>(dad_branch, dad);
+        return;
+    }
+    ASSERT(node->degree() == 3); // it works only for strictly bifurcating tree
+    ParsimonyTraversalInfo info;
+    info.dad_branch = dad_branch;
+    info.left = info.right = NULL;
+    FOR_NEIGHBOR_IT(node, dad, it) {
+        PhyloNeighbor* pit = (PhyloNeighbor*) (*it);
+        collectParsimonyTraversalFastSIMD<VectorClass>(pit, (PhyloNode*) node, traversal);
+        if (!info.left) info.left = pit; else info.right = pit;
+    }
+    dad_branch->partial_lh_computed |= 2;
+    traversal.push_back(info);
+}
+
+template<class VectorClass, const int NSTATES>
+UINT PhyloTree::computeParsimonyTreeFastSIMD(PhyloNeighbor *dad_branch, PhyloNeighbor *node_branch,
+                                             vector<ParsimonyTraversalInfo> &traversal, size_t nsites) {
+    const int nstates = NSTATES ? NSTATES : aln->getMaxNumStates();
+    const size_t entry_size = nstates * VectorClass::size();
+    const size_t scoreid = nsites*entry_size;
+    size_t ntraversal = traversal.size();
+    UINT branch_score = 0;
+    for (auto &info : traversal)
+        info.score = 0;
+
+    // every thread owns a fixed range of columns for the whole traversal: a column of a
+    // parent only depends on the same column of its children, so no barrier is needed between nodes
+#ifdef _OPENMP
+#pragma omp parallel num_threads(num_threads) reduction(+: branch_score)
+#endif
+    {
+        size_t thread_id = 0, nthreads = 1;
+#ifdef _OPENMP
+        thread_id = omp_get_thread_num();
+        nthreads = omp_get_num_threads();
+#endif
+        size_t begin = nsites*thread_id/nthreads;
+        size_t end = nsites*(thread_id+1)/nthreads;
+        for (size_t k = 0; k < ntraversal; k++) {
+            ParsimonyTraversalInfo &info = traversal[k];
+            UINT score = 0;
+            for (size_t site = begin; site < end; site++) {
+                size_t offset = entry_size*site;
+                score += computePartialParsimonyFitchColumn<VectorClass, NSTATES>((VectorClass*)(info.left->partial_pars + offset),
+                    (VectorClass*)(info.right->partial_pars + offset), (VectorClass*)(info.dad_branch->partial_pars + offset), nstates);
+            }
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+            info.score += score;
+        }
+        for (size_t site = begin; site < end; site++) {
+            size_t offset = entry_size*site;
+            branch_score += computeParsimonyBranchFitchColumn<VectorClass, NSTATES>((VectorClass*)(dad_branch->partial_pars + offset),
+                (VectorClass*)(node_branch->partial_pars + offset), nstates);
+        }
+    }
+
+    // subtree scores, children come first in the traversal
+    for (auto &info : traversal)
+        info.dad_branch->partial_pars[scoreid] = info.score + info.left->partial_pars[scoreid] + info.right->partial_pars[scoreid];
+    return branch_score;
+}
+
 template<class VectorClass>
 int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst) {
     PhyloNode *node = (PhyloNode*) dad_branch->node;
@@ -1751,10 +1850,6 @@ int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNo
     ASSERT(node_branch);
     if (!central_partial_pars)
         initializeAllPartialPars();
-    if ((dad_branch->partial_lh_computed & 2) == 0)
-        computePartialParsimonyFastSIMD<VectorClass>(dad_branch, dad);
-    if ((node_branch->partial_lh_computed & 2) == 0)
-        computePartialParsimonyFastSIMD<VectorClass>(node_branch, node);
     int nstates = aln->getMaxNumStates();
 
 //    VectorClass score = 0;
@@ -1763,8 +1858,28 @@ int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNo
     const int NUM_BITS = VectorClass::size() * UINT_BITS;
     int nsites = (aln->num_parsimony_sites + NUM_BITS - 1)/NUM_BITS;
     int entry_size = nstates * VectorClass::size();
-    
     int scoreid = nsites*entry_size;
+
+    if (num_threads > 1 && nsites > num_threads*10) {
+        // whole-tree pass: one parallel region for all pending nodes and the branch itself
+        vector<ParsimonyTraversalInfo> traversal;
+        collectParsimonyTraversalFastSIMD<VectorClass>(dad_branch, dad, traversal);
+        collectParsimonyTraversalFastSIMD<VectorClass>(node_branch, node, traversal);
+        UINT branch_score;
+        if (nstates == 4)
+            branch_score = computeParsimonyTreeFastSIMD<VectorClass, 4>(dad_branch, node_branch, traversal, nsites);
+        else
+            branch_score = computeParsimonyTreeFastSIMD<VectorClass, 0>(dad_branch, node_branch, traversal, nsites);
+        if (branch_subst)
+            *branch_subst = branch_score;
+        return branch_score + dad_branch->partial_pars[scoreid] + node_branch->partial_pars[scoreid];
+    }
+
+    if ((dad_branch->partial_lh_computed & 2) == 0)
+        computePartialParsimonyFastSIMD<VectorClass>(dad_branch, dad);
+    if ((node_branch->partial_lh_computed & 2) == 0)
+        computePartialParsimonyFastSIMD<VectorClass>(node_branch, node);
+    
     UINT sum_end_node = (dad_branch->partial_pars[scoreid] + node_branch->partial_pars[scoreid]);
     UINT score = sum_end_node;
     UINT lower_bound = best_pars_score;
@@ -1777,11 +1892,8 @@ int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNo
         #endif
         for (int site = 0; site < nsites; site++) {
             size_t offset = entry_size*site;
-            VectorClass *x = (VectorClass*)(dad_branch->partial_pars + offset);
-            VectorClass *y = (VectorClass*)(node_branch->partial_pars + offset);
-            VectorClass w = (x[0] & y[0]) | (x[1] & y[1]) | (x[2] & y[2]) | (x[3] & y[3]);
-            w = ~w;
-            score += fast_popcount(w);
+            score += computeParsimonyBranchFitchColumn<VectorClass, 4>((VectorClass*)(dad_branch->partial_pars + offset),
+                (VectorClass*)(node_branch->partial_pars + offset), nstates);
             #ifndef _OPENMP
             if (score >= lower_bound) 
                 break;
@@ -1794,14 +1906,8 @@ int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNo
         #endif
         for (int site = 0; site < nsites; ++site) {
             size_t offset = entry_size*site;
-            VectorClass *x = (VectorClass*)(dad_branch->partial_pars + offset);
-            VectorClass *y = (VectorClass*)(node_branch->partial_pars + offset);
-            VectorClass w = x[0] & y[0];
-            for (int i = 1; i < nstates; i++) {
-                w |= x[i] & y[i];
-            }
-            w = ~w;
-            score += fast_popcount(w);
+            score += computeParsimonyBranchFitchColumn<VectorClass, 0>((VectorClass*)(dad_branch->partial_pars + offset),
+                (VectorClass*)(node_branch->partial_pars + offset), nstates);
             #ifndef _OPENMP
             if (score >= lower_bound) 
                 break;
@@ -1819,39 +1925,105 @@ int PhyloTree::computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNo
  Sankoff parsimony function
  ****************************************************************************/
 
+/** minimum number of pattern vectors per thread before the Sankoff kernels go parallel */
+#define SANKOFF_MIN_VECTORS_PER_THREAD 16
+
+/**
+ transpose the tip costs of VectorClass::size() consecutive patterns into one vector per state
+ @param tip_buffer (OUT) nstates vectors
+ @param aln alignment with the ordered patterns
+ @param ptn first of the patterns
+ @param node_id leaf ID
+ */
+template<class VectorClass>
+inline void loadTipPartialParsimonySankoff(VectorClass *tip_buffer, UINT *tip_partial_pars,
+                                           Alignment *aln, size_t ptn, int node_id, int nstates) {
+    for (int i = 0; i < VectorClass::size(); i++) {
+        UINT *tip_ptr = &tip_partial_pars[aln->getOrderedTipState(node_id, ptn+i)*nstates];
+        UINT *tip_buffer_ptr = (UINT*)tip_buffer + i;
+        for (int j = 0; j < nstates; j++, tip_buffer_ptr += VectorClass::size())
+            *tip_buffer_ptr = tip_ptr[j];
+    }
+}
+
+/**
+ min-plus product of one cost matrix row with a child's partial parsimony: min_j(child[j] + cost_row[j]).
+ With NSTATES > 0 the loop is fully unrolled and the child vectors stay in registers
+ across the rows of the cost matrix.
+ */
+template<class VectorClass, const int NSTATES>
+inline VectorClass minPlusSankoff(VectorClass *child, UINT *cost_row, int nstates) {
+    VectorClass res = child[0] + cost_row[0];
+    for (int j = 1; j < (NSTATES ? NSTATES : nstates); j++)
+        res = min(child[j] + cost_row[j], res);
+    return res;
+}
+
+/**
+ number of threads for a Sankoff kernel over nptn patterns
+ */
+template<class VectorClass>
+inline int getSankoffNumThreads(int num_threads, size_t nptn) {
+    if (num_threads > 1 && nptn >= (size_t)num_threads * VectorClass::size() * SANKOFF_MIN_VECTORS_PER_THREAD)
+        return num_threads;
+    return 1;
+}
+
 template<class VectorClass>
+void PhyloTree::setParsimonyKernelSankoffSIMD() {
+    switch (aln->num_states) {
+    case 2:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 2>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 2>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 2>;
+        break;
+    case 3:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 3>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 3>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 3>;
+        break;
+    case 4:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 4>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 4>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 4>;
+        break;
+    case 5:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 5>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 5>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 5>;
+        break;
+    case 6:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 6>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 6>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 6>;
+        break;
+    default:
+        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<VectorClass, 0>;
+        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<VectorClass, 0>;
+        computeParsimonyOutOfTreePointer = &PhyloTree::computeParsimonyOutOfTreeSankoffSIMD<VectorClass, 0>;
+        break;
+    }
+}
+
+template<class VectorClass, const int NSTATES>
 void PhyloTree::computePartialParsimonySankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad){
     // don't recompute the parsimony
     if (dad_branch->partial_lh_computed & 2)
         return;
     
     Node *node = dad_branch->node;
-    //assert(node->degree() <= 3);
-    /*
-     if(aln->num_states != cost_nstates){
-     cout << "Your cost matrix is not compatible with the alignment"
-     << " in terms of number of states. Please check!" << endl;
-     exit(1);
-     }
-     */
-    int nstates = aln->num_states;
+    const int nstates = NSTATES ? NSTATES : aln->num_states;
     assert(dad_branch->partial_pars);
     
-    size_t pars_block_size = getBitsBlockSize();
-    
-    
     // internal node
-    
     UINT * partial_pars = dad_branch->partial_pars;
-    memset(partial_pars, 0, sizeof(UINT)*pars_block_size);
-    VectorClass *tip_buffer = aligned_alloc<VectorClass>(nstates*2);
     
     PhyloNeighbor *left = NULL, *right = NULL;
     
     FOR_NEIGHBOR_IT(node, dad, it)
     if ((*it)->node->name != ROOT_NAME) {
         if (!(*it)->node->isLeaf())
-            computePartialParsimonySankoffSIMD<VectorClass>((PhyloNeighbor*) (*it), (PhyloNode*) node);
+            computePartialParsimonySankoffSIMD<VectorClass, NSTATES>((PhyloNeighbor*) (*it), (PhyloNode*) node);
         if (!left)
             left = ((PhyloNeighbor*)*it);
         else
@@ -1866,136 +2038,90 @@ void PhyloTree::computePartialParsimonySankoffSIMD(PhyloNeighbor *dad_branch, Ph
     }
     ASSERT(node->degree() >= 3);
     
-    if (node->degree() > 3) {
-        // multifurcating node
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()) {
-            int ptn_start_index = ptn*nstates;
-            VectorClass *partial_pars_ptr = (VectorClass*)&partial_pars[ptn_start_index];
-            
+    bool multifurcating = node->degree() > 3;
+    size_t nptn = aln->ordered_pattern.size();
+    int threads = getSankoffNumThreads<VectorClass>(num_threads, nptn);
+    
+    // pattern vectors are independent, each thread handles a contiguous block
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if (threads > 1)
+#endif
+    {
+    VectorClass *tip_buffer = aligned_alloc<VectorClass>(nstates*2);
+    VectorClass *tip_buffer_right = tip_buffer + nstates;
+    
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int64_t ptn = 0; ptn < nptn; ptn+=VectorClass::size()) {
+        // ignore const ptn because it does not affect pars score
+        //if (aln->at(ptn).isConst()) continue;
+        VectorClass *partial_pars_ptr = (VectorClass*)&partial_pars[ptn*nstates];
+        UINT *cost_matrix_ptr = cost_matrix;
+        
+        if (multifurcating) {
+            // multifurcating node
+            for (int i = 0; i < nstates; i++)
+                partial_pars_ptr[i] = 0;
             FOR_NEIGHBOR_IT(node, dad, it) if ((*it)->node->name != ROOT_NAME) {
                 if ((*it)->node->isLeaf()) {
                     // leaf node
-                    for (int i = 0; i < VectorClass::size(); i++) {
-                        UINT *tip_buffer_ptr = (UINT*)tip_buffer + i;
-                        UINT *partial_pars_child_ptr = &tip_partial_pars[aln->ordered_pattern[ptn+i][(*it)->node->id]*nstates];
-                        for (int j = 0; j < nstates; j++, tip_buffer_ptr += VectorClass::size())
-                            *tip_buffer_ptr = partial_pars_child_ptr[j];
-                    }
-                    
-                    for (int i = 0; i < nstates; i++){
+                    loadTipPartialParsimonySankoff(tip_buffer, tip_partial_pars, aln, ptn, (*it)->node->id, nstates);
+                    for (int i = 0; i < nstates; i++)
                         partial_pars_ptr[i] += tip_buffer[i];
-                    }
                 } else {
                     // internal node
-                    VectorClass *partial_pars_child_ptr = (VectorClass*)&((PhyloNeighbor*) (*it))->partial_pars[ptn_start_index];
-                    UINT *cost_matrix_ptr = cost_matrix;
-                    
-                    for (int i = 0; i < nstates; i++){
+                    VectorClass *partial_pars_child_ptr = (VectorClass*)&((PhyloNeighbor*) (*it))->partial_pars[ptn*nstates];
+                    cost_matrix_ptr = cost_matrix;
+                    for (int i = 0; i < nstates; i++, cost_matrix_ptr += nstates) {
                         // min(j->i) from child_branch
-                        VectorClass min_child_ptn_pars = partial_pars_child_ptr[0] + cost_matrix_ptr[0];
-                        for (int j = 1; j < nstates; j++) {
-                            min_child_ptn_pars = min(partial_pars_child_ptr[j] + cost_matrix_ptr[j], min_child_ptn_pars);
-                        }
-                        partial_pars_ptr[i] += min_child_ptn_pars;
-                        cost_matrix_ptr += nstates;
+                        partial_pars_ptr[i] += minPlusSankoff<VectorClass, NSTATES>(partial_pars_child_ptr, cost_matrix_ptr, nstates);
                     }
                 }
             }
-        }
-    } else if (left->node->isLeaf() && right->node->isLeaf()) {
-        // tip-tip case
-        VectorClass *tip_buffer_right = tip_buffer + nstates;
-        
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()){
-            // ignore const ptn because it does not affect pars score
-            //if (aln->at(ptn).isConst()) continue;
-            size_t ptn_start_index = ptn*nstates;
-            
-            // load data for tip
-            for (int i = 0; i < VectorClass::size(); i++) {
-                UINT *left_ptr = &tip_partial_pars[aln->ordered_pattern[ptn+i][left->node->id]*nstates];
-                UINT *right_ptr = &tip_partial_pars[aln->ordered_pattern[ptn+i][right->node->id]*nstates];
-                UINT *tip_buffer_ptr = (UINT*)tip_buffer + i;
-                UINT *tip_buffer_right_ptr = (UINT*)tip_buffer_right + i;
-                for (int j = 0; j < nstates; j++) {
-                    *tip_buffer_ptr = left_ptr[j];
-                    *tip_buffer_right_ptr = right_ptr[j];
-                    tip_buffer_ptr += VectorClass::size();
-                    tip_buffer_right_ptr += VectorClass::size();
-                }
-            }
-            VectorClass *partial_pars_ptr = (VectorClass*)&partial_pars[ptn_start_index];
-            
-            for (int i = 0; i < nstates; i++){
-                // min(j->i) from child_branch
+        } else if (left->node->isLeaf() && right->node->isLeaf()) {
+            // tip-tip case
+            loadTipPartialParsimonySankoff(tip_buffer, tip_partial_pars, aln, ptn, left->node->id, nstates);
+            loadTipPartialParsimonySankoff(tip_buffer_right, tip_partial_pars, aln, ptn, right->node->id, nstates);
+            for (int i = 0; i < nstates; i++)
                 partial_pars_ptr[i] = tip_buffer[i] + tip_buffer_right[i];
-            }
-        }
-    } else if (left->node->isLeaf() && !right->node->isLeaf()) {
-        // tip-inner case
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()){
-            // ignore const ptn because it does not affect pars score
-            //if (aln->at(ptn).isConst()) continue;
-            size_t ptn_start_index = ptn*nstates;
-            
-            for (int i = 0; i < VectorClass::size(); i++) {
-                UINT *left_ptr = &tip_partial_pars[aln->ordered_pattern[ptn+i][left->node->id]*nstates];
-                UINT *tip_buffer_ptr = (UINT*)tip_buffer + i;
-                for (int j = 0; j < nstates; j++) {
-                    *tip_buffer_ptr = left_ptr[j];
-                    tip_buffer_ptr += VectorClass::size();
-                }
-            }
-            
-            VectorClass *right_ptr = (VectorClass*)&right->partial_pars[ptn_start_index];
-            VectorClass *partial_pars_ptr = (VectorClass*)&partial_pars[ptn_start_index];
-            UINT *cost_matrix_ptr = cost_matrix;
-            VectorClass right_contrib;
-            
-            for(int i = 0; i < nstates; i++){
+        } else if (left->node->isLeaf()) {
+            // tip-inner case
+            loadTipPartialParsimonySankoff(tip_buffer, tip_partial_pars, aln, ptn, left->node->id, nstates);
+            VectorClass *right_ptr = (VectorClass*)&right->partial_pars[ptn*nstates];
+            for (int i = 0; i < nstates; i++, cost_matrix_ptr += nstates) {
                 // min(j->i) from child_branch
-                right_contrib = right_ptr[0] + cost_matrix_ptr[0];
-                for(int j = 1; j < nstates; j++) {
-                    right_contrib = min(right_ptr[j] + cost_matrix_ptr[j], right_contrib);
-                }
-                partial_pars_ptr[i] = tip_buffer[i] + right_contrib;
-                cost_matrix_ptr += nstates;
+                partial_pars_ptr[i] = tip_buffer[i] + minPlusSankoff<VectorClass, NSTATES>(right_ptr, cost_matrix_ptr, nstates);
             }
-        }
-    } else {
-        // inner-inner case
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()){
-            // ignore const ptn because it does not affect pars score
-            //if (aln->at(ptn).isConst()) continue;
-            int ptn_start_index = ptn*nstates;
-            
-            VectorClass *left_ptr = (VectorClass*)&left->partial_pars[ptn_start_index];
-            VectorClass *right_ptr = (VectorClass*)&right->partial_pars[ptn_start_index];
-            VectorClass *partial_pars_ptr = (VectorClass*)&partial_pars[ptn_start_index];
-            UINT *cost_matrix_ptr = cost_matrix;
-            VectorClass left_contrib, right_contrib;
-            
-            for (int i = 0; i < nstates; i++){
+        } else {
+            // inner-inner case
+            VectorClass *left_ptr = (VectorClass*)&left->partial_pars[ptn*nstates];
+            VectorClass *right_ptr = (VectorClass*)&right->partial_pars[ptn*nstates];
+            for (int i = 0; i < nstates; i++, cost_matrix_ptr += nstates) {
                 // min(j->i) from child_branch
-                left_contrib = left_ptr[0] + cost_matrix_ptr[0];
-                right_contrib = right_ptr[0] + cost_matrix_ptr[0];
-                for (int j = 1; j < nstates; j++) {
-                    left_contrib = min(left_ptr[j] + cost_matrix_ptr[j], left_contrib);
-                    right_contrib = min(right_ptr[j] + cost_matrix_ptr[j], right_contrib);
-                }
-                partial_pars_ptr[i] = left_contrib+right_contrib;
-                cost_matrix_ptr += nstates;
+                partial_pars_ptr[i] = minPlusSankoff<VectorClass, NSTATES>(left_ptr, cost_matrix_ptr, nstates) +
+                    minPlusSankoff<VectorClass, NSTATES>(right_ptr, cost_matrix_ptr, nstates);
             }
         }
-        
+    }
+    aligned_free(tip_buffer);
     }
     
     dad_branch->partial_lh_computed |= 2;
-    aligned_free(tip_buffer);
 }
 
-template<class VectorClass>
+template<class VectorClass, const int NSTATES>
 int PhyloTree::computeParsimonyBranchSankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst) {
+    return computeParsimonyPatternSankoffSIMD<VectorClass, NSTATES>(dad_branch, dad, branch_subst, NULL);
+}
+
+template<class VectorClass, const int NSTATES>
+UINT PhyloTree::computeParsimonyOutOfTreeSankoffSIMD(UINT *ptn_scores) {
+    return computeParsimonyPatternSankoffSIMD<VectorClass, NSTATES>((PhyloNeighbor*) root->neighbors[0], (PhyloNode*) root, NULL, ptn_scores);
+}
+
+template<class VectorClass, const int NSTATES>
+UINT PhyloTree::computeParsimonyPatternSankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst, UINT *ptn_scores) {
 
     if ((tip_partial_lh_computed & 2) == 0)
         computeTipPartialParsimony();
@@ -2017,78 +2143,84 @@ int PhyloTree::computeParsimonyBranchSankoffSIMD(PhyloNeighbor *dad_branch, Phyl
         node_branch = tmp_nei;
     }
     
-    //int nptn = aln->size();
-    //    if(!_pattern_pars) _pattern_pars = aligned_alloc<BootValTypePars>(nptn+VCSIZE_USHORT);
-    //    memset(_pattern_pars, 0, sizeof(BootValTypePars) * (nptn+VCSIZE_USHORT));
-    
     if ((dad_branch->partial_lh_computed & 2) == 0 && !node->isLeaf())
-        computePartialParsimonySankoffSIMD<VectorClass>(dad_branch, dad);
+        computePartialParsimonySankoffSIMD<VectorClass, NSTATES>(dad_branch, dad);
     if ((node_branch->partial_lh_computed & 2) == 0 && !dad->isLeaf())
-        computePartialParsimonySankoffSIMD<VectorClass>(node_branch, node);
+        computePartialParsimonySankoffSIMD<VectorClass, NSTATES>(node_branch, node);
     
     // now combine likelihood at the branch
-    VectorClass tree_pars = 0;
-    int nstates = aln->num_states;
-    VectorClass branch_pars = 0;
+    UINT tree_pars = 0;
+    UINT branch_pars = 0;
+    const int nstates = NSTATES ? NSTATES : aln->num_states;
+    size_t nptn = aln->ordered_pattern.size();
+    bool dad_leaf = dad->isLeaf();
+    int threads = getSankoffNumThreads<VectorClass>(num_threads, nptn);
     
-    if (dad->isLeaf()) {
-        VectorClass *tip_buffer = aligned_alloc<VectorClass>(nstates);
-        // external node
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()){
-            int ptn_start_index = ptn * nstates;
-            for (int  i = 0; i < VectorClass::size(); i++) {
-                UINT *node_branch_ptr = &tip_partial_pars[aln->ordered_pattern[ptn+i][dad->id]*nstates];
-                UINT *tip_buffer_ptr = (UINT*)tip_buffer + i;
-                for (int j = 0; j < nstates; j++, tip_buffer_ptr += VectorClass::size()) {
-                    *tip_buffer_ptr = node_branch_ptr[j];
-                }
-            }
-            VectorClass *dad_branch_ptr = (VectorClass*)&dad_branch->partial_pars[ptn_start_index];
-            VectorClass min_ptn_pars = tip_buffer[0] + dad_branch_ptr[0];
-            VectorClass br_ptn_pars = tip_buffer[0];
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) if (threads > 1) reduction(+: tree_pars, branch_pars)
+#endif
+    {
+    VectorClass vc_tree_pars = 0;
+    VectorClass vc_branch_pars = 0;
+    VectorClass *tip_buffer = dad_leaf ? aligned_alloc<VectorClass>(nstates) : NULL;
+    
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (int64_t ptn = 0; ptn < nptn; ptn+=VectorClass::size()) {
+        VectorClass *dad_branch_ptr = (VectorClass*)&dad_branch->partial_pars[ptn*nstates];
+        VectorClass min_ptn_pars, br_ptn_pars;
+        if (dad_leaf) {
+            // external node
+            loadTipPartialParsimonySankoff(tip_buffer, tip_partial_pars, aln, ptn, dad->id, nstates);
+            min_ptn_pars = tip_buffer[0] + dad_branch_ptr[0];
+            br_ptn_pars = tip_buffer[0];
             for (int i = 1; i < nstates; i++){
                 // min(j->i) from node_branch
                 VectorClass min_score = tip_buffer[i] + dad_branch_ptr[i];
                 br_ptn_pars = select(min_score < min_ptn_pars, tip_buffer[i], br_ptn_pars);
                 min_ptn_pars = min(min_ptn_pars, min_score);
             }
-            //_pattern_pars[ptn] = min_ptn_pars;
-            tree_pars += min_ptn_pars * VectorClass().load_a(&ptn_freq_pars[ptn]);
-            branch_pars += br_ptn_pars * VectorClass().load_a(&ptn_freq_pars[ptn]);
-        }
-        aligned_free(tip_buffer);
-    }  else {
-        // internal node
-        for (size_t ptn = 0; ptn < aln->ordered_pattern.size(); ptn+=VectorClass::size()){
-            int ptn_start_index = ptn * nstates;
-            VectorClass *node_branch_ptr = (VectorClass*)&node_branch->partial_pars[ptn_start_index];
-            VectorClass *dad_branch_ptr = (VectorClass*)&dad_branch->partial_pars[ptn_start_index];
+        } else {
+            // internal node
+            VectorClass *node_branch_ptr = (VectorClass*)&node_branch->partial_pars[ptn*nstates];
             UINT *cost_matrix_ptr = cost_matrix;
-            VectorClass min_ptn_pars = UINT_MAX;
-            VectorClass br_ptn_pars = UINT_MAX;
-            for(int i = 0; i < nstates; i++){
+            min_ptn_pars = UINT_MAX;
+            br_ptn_pars = UINT_MAX;
+            for (int i = 0; i < nstates; i++, cost_matrix_ptr += nstates) {
                 // min(j->i) from node_branch
                 VectorClass min_score = node_branch_ptr[0] + cost_matrix_ptr[0];
                 VectorClass branch_score = cost_matrix_ptr[0];
-                for(int j = 1; j < nstates; j++) {
+                for (int j = 1; j < nstates; j++) {
                     VectorClass value = node_branch_ptr[j] + cost_matrix_ptr[j];
                     branch_score = select(value < min_score, cost_matrix_ptr[j], branch_score);
-                    min_score = min(value, min_score);                    
+                    min_score = min(value, min_score);
                 }
                 min_score = min_score + dad_branch_ptr[i];
                 br_ptn_pars = select(min_score < min_ptn_pars, branch_score, br_ptn_pars);
                 min_ptn_pars = min(min_score, min_ptn_pars);
-                cost_matrix_ptr += nstates;
             }
-            //_pattern_pars[ptn] = min_ptn_pars;
-            tree_pars += min_ptn_pars * VectorClass().load_a(&ptn_freq_pars[ptn]);
-            branch_pars += br_ptn_pars * VectorClass().load_a(&ptn_freq_pars[ptn]);
         }
+        if (ptn_scores) {
+            // ptn_scores has no padding after the last pattern
+            if (ptn + VectorClass::size() <= nptn)
+                min_ptn_pars.store(&ptn_scores[ptn]);
+            else
+                min_ptn_pars.store_partial(nptn - ptn, &ptn_scores[ptn]);
+        }
+        VectorClass freq = VectorClass().load_a(&ptn_freq_pars[ptn]);
+        vc_tree_pars += min_ptn_pars * freq;
+        vc_branch_pars += br_ptn_pars * freq;
+    }
+    tree_pars += horizontal_add(vc_tree_pars);
+    branch_pars += horizontal_add(vc_branch_pars);
+    if (tip_buffer)
+        aligned_free(tip_buffer);
     }
+    
     if (branch_subst)
-        *branch_subst = horizontal_add(branch_pars);
-    //    cout << endl;
-    return horizontal_add(tree_pars);
+        *branch_subst = branch_pars;
+    return tree_pars;
 }
 
 #endif /* PHYLOKERNEL_H_ */
@@ -1118,6 +1118,13 @@ inline void computeBounds(int threads, int packets, size_t elements, vector<size
     //It is assumed that threads divides packets evenly
     limits.reserve(packets+1);
     elements = roundUpToMultiple(elements, VectorClass::size());
+    if (Params::getInstance().deterministic_reduction) {
+        // packets of equal size, independent of the number of threads
+        for (int packet = 0; packet < packets; packet++)
+            limits.push_back(roundUpToMultiple(elements * packet / packets, VectorClass::size()));
+        limits.push_back(elements);
+        return;
+    }
     size_t block_start = 0;
     
     for (int wave = packets/threads; wave>=1; --wave) {
@@ -1143,6 +1150,36 @@ inline void computeBounds(int threads, int packets, size_t elements, vector<size
             outError("Too many threads may slow down analysis [-nt option]. Reduce threads or use -nt AUTO to automatically determine it");
     }
 }
+
+/**
+    partial sums of each packet, added up in packet order after the parallel loop,
+    so that the totals do not depend on which thread computed which packet
+*/
+class PacketSums {
+public:
+    /**
+        @param num_packets number of packets
+        @param num_sums number of quantities summed per packet
+    */
+    PacketSums(int num_packets, int num_sums) : num_sums(num_sums), sums(num_packets*num_sums, 0.0) {}
+
+    /** @return the partial sums of a packet */
+    double *at(int packet_id) {
+        return &sums[packet_id*num_sums];
+    }
+
+    /** @return total of one quantity over all packets */
+    double total(int sum_id) const {
+        double res = 0.0;
+        for (size_t i = sum_id; i < sums.size(); i += num_sums)
+            res += sums[i];
+        return res;
+    }
+
+private:
+    int num_sums;
+    DoubleVector sums;
+};
 #endif
 
 #ifdef KERNEL_FIX_STATES
@@ -2380,14 +2417,16 @@ void PhyloTree::computeLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch, Phyl
         for (size_t i = 0; i < nmixlen2; i++) all_ddfvec[i] = 0.0;
     }
     
-    double all_lh(0.0), all_df(0.0), all_ddf(0.0), all_prob_const(0.0), all_df_const(0.0), all_ddf_const(0.0);
+    // per packet: log-likelihood (mixed branch lengths), df, ddf, prob_const, df_const, ddf_const
+    PacketSums packet_sums(num_packets, 6);
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_lh,all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
     for (int packet_id = 0; packet_id < num_packets; packet_id++) {
         VectorClass my_df(0.0), my_ddf(0.0), vc_prob_const(0.0), vc_df_const(0.0), vc_ddf_const(0.0);
         size_t ptn_lower = limits[packet_id];
         size_t ptn_upper = limits[packet_id+1];
+        double *my_sums = packet_sums.at(packet_id);
 
         if (!theta_computed)
         #ifdef KERNEL_FIX_STATES
@@ -2456,16 +2495,8 @@ void PhyloTree::computeLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch, Phyl
                     ASSERT(0 && "TODO +ASC not supported");
                 }
             } // FOR ptn
-            all_lh += horizontal_add(my_lh); //handled by reduction clause
-        #ifdef _OPENMP
-        #pragma omp critical
-        #endif
-            {
-                for (size_t i = 0; i < nmixlen; i++)
-                    all_dfvec[i] += my_df[i];
-                for (size_t i = 0; i < nmixlen2; i++)
-                    all_ddfvec[i] += my_ddf[i];
-            }
+            // my_df and my_ddf stay in the packet buffer, they are added up after the loop
+            my_sums[0] = horizontal_add(my_lh);
         } else {
             // to access g-matrix elements to store derivatives
             size_t g_index = branch_id * g_matrix_nptn;
@@ -2547,22 +2578,28 @@ void PhyloTree::computeLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch, Phyl
                     }
                 }
             } // FOR ptn
-            {
-                //These adds don't need to be in a critical section, as the
-                //shared variables are all mentioned in the reduction clause
-                //Note that, since those variables are now double, the
-                //horizontal_add operations need to be done here.
-                all_df  += horizontal_add(my_df);
-                all_ddf += horizontal_add(my_ddf);
-                if (ASC_Lewis) {
-                    all_prob_const += horizontal_add(vc_prob_const);
-                    all_df_const   += horizontal_add(vc_df_const);
-                    all_ddf_const  += horizontal_add(vc_ddf_const);
-                }
+            my_sums[1] = horizontal_add(my_df);
+            my_sums[2] = horizontal_add(my_ddf);
+            if (ASC_Lewis) {
+                my_sums[3] = horizontal_add(vc_prob_const);
+                my_sums[4] = horizontal_add(vc_df_const);
+                my_sums[5] = horizontal_add(vc_ddf_const);
             }
 
         } // else isMixlen()
     } // FOR packet
+    double all_lh = packet_sums.total(0), all_df = packet_sums.total(1), all_ddf = packet_sums.total(2);
+    double all_prob_const = packet_sums.total(3), all_df_const = packet_sums.total(4), all_ddf_const = packet_sums.total(5);
+    if (isMixlen()) {
+        for (int packet_id = 0; packet_id < num_packets; packet_id++) {
+            VectorClass *my_df = ((VectorClass*)buffer_partial_lh_ptr) + (nmixlen+3)*nmixlen*packet_id + nmixlen*2;
+            VectorClass *my_ddf = my_df + nmixlen;
+            for (size_t i = 0; i < nmixlen; i++)
+                all_dfvec[i] += my_df[i];
+            for (size_t i = 0; i < nmixlen2; i++)
+                all_ddfvec[i] += my_ddf[i];
+        }
+    }
     gradient_vector[branch_id] = all_df;
     hessian_diagonal[branch_id] = all_ddf;
 
@@ -2594,43 +2631,34 @@ void PhyloTree::computeLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch, Phyl
         outError("Numerical underflow (lh-derivative). Run again with the safe likelihood kernel via `-safe` option");
     }
     if (ASC_Holder) {
-        // Mark Holder's ascertainment bias correction for missing data
+        // Mark Holder's ascertainment bias correction for missing data,
+        // computed once per missing-data layout and weighted by its total pattern frequency
         double *const_lh = _pattern_lh + max_orig_nptn;
-        size_t step_unobserved_ptns = model_factory->unobserved_ptns.size() / nstates;
-        double *const_lh_next = const_lh + step_unobserved_ptns;
-        double *const_df_next = const_df + step_unobserved_ptns;
-        double *const_ddf_next = const_ddf + step_unobserved_ptns;
+        size_t nlayout = model_factory->unobserved_ptns.size() / nstates;
         for (int step = 1; step < nstates; step++) {
-            for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size()) {
-                (VectorClass().load_a(&const_lh[ptn]) + VectorClass().load_a(&const_lh_next[ptn])).store_a(&const_lh[ptn]);
-                (VectorClass().load_a(&const_df[ptn]) + VectorClass().load_a(&const_df_next[ptn])).store_a(&const_df[ptn]);
-                (VectorClass().load_a(&const_ddf[ptn]) + VectorClass().load_a(&const_ddf_next[ptn])).store_a(&const_ddf[ptn]);
-            }
-            const_lh_next += step_unobserved_ptns;
-            const_df_next += step_unobserved_ptns;
-            const_ddf_next += step_unobserved_ptns;
-        }
-        // cutoff the last entries if going beyond
-        for (size_t ptn = orig_nptn; ptn < max_orig_nptn; ptn++) {
-            const_lh[ptn] = 0.0;
-            const_df[ptn] = 0.0;
-            const_ddf[ptn] = 0.0;
-        }
-        VectorClass sum_df = 0.0, sum_ddf = 0.0;
-        
-        for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size()) {
-            VectorClass prob_const, df_const, ddf_const;
-            prob_const.load_a(&const_lh[ptn]);
-            df_const.load_a(&const_df[ptn]);
-            ddf_const.load_a(&const_ddf[ptn]);
-            prob_const = 1.0 - prob_const;
-            VectorClass df_frac = df_const / prob_const;
-            VectorClass ddf_frac = ddf_const / prob_const;
-            sum_df  += VectorClass().load_a(&ptn_freq[ptn]) * df_frac;
-            sum_ddf += VectorClass().load_a(&ptn_freq[ptn]) * (ddf_frac + df_frac*df_frac);
-        }
-        *df  += horizontal_add(sum_df);
-        *ddf += horizontal_add(sum_ddf);
+            double *const_lh_next = const_lh + step*nlayout;
+            double *const_df_next = const_df + step*nlayout;
+            double *const_ddf_next = const_ddf + step*nlayout;
+            for (size_t layout = 0; layout < nlayout; layout++) {
+                const_lh[layout] += const_lh_next[layout];
+                const_df[layout] += const_df_next[layout];
+                const_ddf[layout] += const_ddf_next[layout];
+            }
+        }
+        DoubleVector layout_freq(nlayout, 0.0);
+        IntVector &ptn_layout = model_factory->unobserved_ptn_layout;
+        for (size_t ptn = 0; ptn < orig_nptn; ptn++)
+            layout_freq[ptn_layout[ptn]] += ptn_freq[ptn];
+        double sum_df = 0.0, sum_ddf = 0.0;
+        for (size_t layout = 0; layout < nlayout; layout++) {
+            double prob_variant = 1.0 - const_lh[layout];
+            double df_frac = const_df[layout] / prob_variant;
+            double ddf_frac = const_ddf[layout] / prob_variant;
+            sum_df  += layout_freq[layout] * df_frac;
+            sum_ddf += layout_freq[layout] * (ddf_frac + df_frac*df_frac);
+        }
+        *df  += sum_df;
+        *ddf += sum_ddf;
         aligned_free(const_ddf);
         aligned_free(const_df);
     } else if (ASC_Lewis) {
@@ -3224,28 +3252,25 @@ double PhyloTree::computeLikelihoodBranchGenericSIMD(PhyloNeighbor *dad_branch,
     }
 
     if (ASC_Holder) {
-        // Mark Holder's ascertainment bias correction for missing data
+        // Mark Holder's ascertainment bias correction for missing data,
+        // computed once per missing-data layout
         double *const_lh = _pattern_lh + max_orig_nptn;
-        size_t step_unobserved_ptns = model_factory->unobserved_ptns.size() / nstates;
-        double *const_lh_next = const_lh + step_unobserved_ptns;
-        for (int step = 1; step < nstates; step++, const_lh_next += step_unobserved_ptns) {
-            #ifdef _OPENMP
-            #pragma omp parallel for
-            #endif
-            for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size())
-                (VectorClass().load_a(&const_lh[ptn]) + VectorClass().load_a(&const_lh_next[ptn])).store_a(&const_lh[ptn]);
-        }
-        // cutoff the last entries if going beyond
-        for (size_t ptn = orig_nptn; ptn < max_orig_nptn; ptn++) {
-            const_lh[ptn] = 0.0;
-        }
-        VectorClass sum_corr = 0.0;
-        for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size()) {
-            VectorClass prob_variant = log(1.0 - VectorClass().load_a(&const_lh[ptn]));
-            (VectorClass().load_a(&_pattern_lh[ptn]) - prob_variant).store_a(&_pattern_lh[ptn]);
-            sum_corr += prob_variant*VectorClass().load_a(&ptn_freq[ptn]);
+        size_t nlayout = model_factory->unobserved_ptns.size() / nstates;
+        for (int step = 1; step < nstates; step++) {
+            double *const_lh_next = const_lh + step*nlayout;
+            for (size_t layout = 0; layout < nlayout; layout++)
+                const_lh[layout] += const_lh_next[layout];
+        }
+        for (size_t layout = 0; layout < nlayout; layout++)
+            const_lh[layout] = log(1.0 - const_lh[layout]);
+        IntVector &ptn_layout = model_factory->unobserved_ptn_layout;
+        double sum_corr = 0.0;
+        for (size_t ptn = 0; ptn < orig_nptn; ptn++) {
+            double prob_variant = const_lh[ptn_layout[ptn]];
+            _pattern_lh[ptn] -= prob_variant;
+            sum_corr += prob_variant*ptn_freq[ptn];
         }
-        tree_lh -= horizontal_add(sum_corr);
+        tree_lh -= sum_corr;
     } else if (ASC_Lewis) {
     	// ascertainment bias correction
         if (all_prob_const >= 1.0 || all_prob_const < 0.0) {
@@ -3449,25 +3474,25 @@ double PhyloTree::computeLikelihoodFromBufferGenericSIMD()
     }
 
     if (ASC_Holder) {
-        // Mark Holder's ascertainment bias correction for missing data
+        // Mark Holder's ascertainment bias correction for missing data,
+        // computed once per missing-data layout
         double *const_lh = _pattern_lh + max_orig_nptn;
-        size_t step_unobserved_ptns = model_factory->unobserved_ptns.size() / nstates;
-        double *const_lh_next = const_lh + step_unobserved_ptns;
-        for (int step = 1; step < nstates; step++, const_lh_next += step_unobserved_ptns) {
-            for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size())
-                (VectorClass().load_a(&const_lh[ptn]) + VectorClass().load_a(&const_lh_next[ptn])).store_a(&const_lh[ptn]);
-        }
-        // cutoff the last entries if going beyond
-        for (size_t ptn = orig_nptn; ptn < max_orig_nptn; ++ptn) {
-            const_lh[ptn] = 0.0;
-        }
-        VectorClass sum_corr = 0.0;
-        for (size_t ptn = 0; ptn < orig_nptn; ptn+=VectorClass::size()) {
-            VectorClass prob_variant = log(1.0 - VectorClass().load_a(&const_lh[ptn]));
-            (VectorClass().load_a(&_pattern_lh[ptn]) - prob_variant).store_a(&_pattern_lh[ptn]);
-            sum_corr += prob_variant*VectorClass().load_a(&ptn_freq[ptn]);
+        size_t nlayout = model_factory->unobserved_ptns.size() / nstates;
+        for (int step = 1; step < nstates; step++) {
+            double *const_lh_next = const_lh + step*nlayout;
+            for (size_t layout = 0; layout < nlayout; layout++)
+                const_lh[layout] += const_lh_next[layout];
+        }
+        for (size_t layout = 0; layout < nlayout; layout++)
+            const_lh[layout] = log(1.0 - const_lh[layout]);
+        IntVector &ptn_layout = model_factory->unobserved_ptn_layout;
+        double sum_corr = 0.0;
+        for (size_t ptn = 0; ptn < orig_nptn; ptn++) {
+            double prob_variant = const_lh[ptn_layout[ptn]];
+            _pattern_lh[ptn] -= prob_variant;
+            sum_corr += prob_variant*ptn_freq[ptn];
         }
-        tree_lh -= horizontal_add(sum_corr);
+        tree_lh -= sum_corr;
     } else if (ASC_Lewis) {
     	// ascertainment bias correction
         if (all_prob_const >= 1.0 || all_prob_const < 0.0) {
@@ -3496,10 +3521,10 @@ double PhyloTree::computeLikelihoodFromBufferGenericSIMD()
 
 #ifdef KERNEL_FIX_STATES
 template <class VectorClass, const bool SAFE_NUMERIC, const int nstates, const bool FMA, const bool SITE_MODEL>
-void PhyloTree::computeLikelihoodDervMixlenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf)
+void PhyloTree::computeLikelihoodDervMixlenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double *ptn_weights, bool *active, double *df, double *ddf)
 #else
 template <class VectorClass, const bool SAFE_NUMERIC, const bool FMA, const bool SITE_MODEL>
-void PhyloTree::computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf)
+void PhyloTree::computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double *ptn_weights, bool *active, double *df, double *ddf)
 #endif
 {
     PhyloNode *node = (PhyloNode*) dad_branch->node;
@@ -3530,53 +3555,35 @@ void PhyloTree::computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch
     size_t orig_nptn     = aln->size();
     size_t max_orig_nptn = roundUpToMultiple(orig_nptn, VectorClass::size());
     size_t nptn          = max_orig_nptn+model_factory->unobserved_ptns.size();
+    size_t weight_stride = get_safe_upper_limit(orig_nptn);
     ASCType ASC_type     = model_factory->getASC();
     bool ASC_Holder      = (ASC_type == ASC_VARIANT_MISSING || ASC_type == ASC_INFORMATIVE_MISSING);
     bool ASC_Lewis       = (ASC_type == ASC_VARIANT || ASC_type == ASC_INFORMATIVE);
     ASSERT(!ASC_Holder && "Holder's ascertainment bias correction not supported for this mixlen model");
+    ASSERT(!SITE_MODEL && "Site-specific model not supported for this mixlen model");
 
-//    size_t mix_addr_nstates[ncat_mix], mix_addr[ncat_mix], cat_id[ncat_mix];
-//    size_t denom = (model_factory->fused_mix_rate) ? 1 : ncat;
-//    for (c = 0; c < ncat_mix; c++) {
-//        size_t m = c/denom;
-//        cat_id[c] = c%ncat;
-//        mix_addr_nstates[c] = m*nstates;
-//        mix_addr[c] = mix_addr_nstates[c]*nstates;
-//    }
+    size_t nmixlen = getMixlen();
+    ASSERT(nmixlen == ncat);
 
     double *eval = model->getEigenvalues();
     ASSERT(eval);
 
-    double *buffer_partial_lh_ptr = buffer_partial_lh;
     vector<size_t> limits;
     computeBounds<VectorClass>(num_threads, num_packets, nptn, limits);
 
 	ASSERT(theta_all);
 
-    double *val0 = NULL;
-    double *val1 = NULL;
-    double *val2 = NULL;
-    double cat_rate[ncat];
-    double cat_prop[ncat];
-
-    int cur_mixlen = getCurMixture();
-
-    if (SITE_MODEL) {
-        for (size_t c = 0; c < ncat; c++) {
-            cat_rate[c] = site_rate->getRate(c);
-            cat_prop[c] = site_rate->getProp(c);
-        }
-    } else {
-        val0 = buffer_partial_lh_ptr;
-        val1 = val0 + get_safe_upper_limit(block);
-        val2 = val1 + get_safe_upper_limit(block);
-        buffer_partial_lh_ptr += 3*get_safe_upper_limit(block);
+    // val0, val1, val2 of all classes, each class with its own branch length
+    double *val0 = buffer_partial_lh;
+    double *val1 = val0 + get_safe_upper_limit(block);
+    double *val2 = val1 + get_safe_upper_limit(block);
+    for (size_t cur_mixlen = 0; cur_mixlen < nmixlen; cur_mixlen++) {
         double len = dad_branch->getLength(cur_mixlen);
         for (size_t c = 0; c < nmix; c++) {
             size_t cur_mix = (model_factory->fused_mix_rate) ? cur_mixlen : c;
             double *eval_ptr = eval+cur_mix*nstates;
             double prop = model->getMixtureWeight(cur_mix);
-            size_t addr = c*nstates;
+            size_t addr = (cur_mixlen*nmix+c)*nstates;
             for (size_t i = 0; i < nstates; i++) {
                 double cof = eval_ptr[i];
                 double val = exp(cof*len) * prop;
@@ -3587,16 +3594,16 @@ void PhyloTree::computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch
             }
         }
     }
-
-    double all_df(0.0), all_ddf(0.0), all_prob_const(0.0), all_df_const(0.0), all_ddf_const(0.0);
+    // per packet: df, ddf, prob_const, df_const, ddf_const of each class
+    PacketSums packet_sums(num_packets, 5*nmixlen);
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
     for (int packet_id = 0; packet_id < num_packets; packet_id++) {
-        VectorClass my_df(0.0), my_ddf(0.0), vc_prob_const(0.0), vc_df_const(0.0), vc_ddf_const(0.0);
         size_t ptn_lower = limits[packet_id];
         size_t ptn_upper = limits[packet_id+1];
+        double *my_sums = packet_sums.at(packet_id);
 
         if (!theta_computed)
         #ifdef KERNEL_FIX_STATES
@@ -3605,79 +3612,87 @@ void PhyloTree::computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch
             computeLikelihoodBufferGenericSIMD<VectorClass, SAFE_NUMERIC, FMA, SITE_MODEL>(dad_branch, dad, ptn_lower, ptn_upper, packet_id);
         #endif
 
-        // mixed branch length model
-        VectorClass lh_ptn;
-        VectorClass df_ptn, ddf_ptn;
+        // classes in the outer loop, theta of the packet stays in cache
+        for (size_t cur_mixlen = 0; cur_mixlen < nmixlen; cur_mixlen++) {
+            if (!active[cur_mixlen])
+                continue;
+            VectorClass my_df(0.0), my_ddf(0.0), vc_prob_const(0.0), vc_df_const(0.0), vc_ddf_const(0.0);
+            size_t addr = cur_mixlen*nmix*nstates;
+            double *weights = ptn_weights + cur_mixlen*weight_stride;
 
-        for (size_t ptn = ptn_lower; ptn < ptn_upper; ptn+=VectorClass::size()) {
-            lh_ptn = df_ptn = ddf_ptn = 0.0;
-            VectorClass *theta = ((VectorClass*)(theta_all + ptn*block)) + cur_mixlen*nstates*nmix;
-            double *val0_ptr = val0;
-            double *val1_ptr = val1;
-            double *val2_ptr = val2;
-            for (size_t c = 0; c < nmix; c++) {
-            #ifdef KERNEL_FIX_STATES
-                dotProductTriple<VectorClass, double, nstates, FMA, true>(val0_ptr, val1_ptr, val2_ptr, theta, lh_ptn, df_ptn, ddf_ptn, nstates);
-            #else
-                dotProductTriple<VectorClass, double, FMA, true>(val0_ptr, val1_ptr, val2_ptr, theta, lh_ptn, df_ptn, ddf_ptn,nstates, nstates);
-            #endif
-                val0_ptr += nstates;
-                val1_ptr += nstates;
-                val2_ptr += nstates;
-                theta += nstates;
-            }
-            lh_ptn = abs(lh_ptn) + VectorClass().load_a(&ptn_invar[ptn]);
-            if (ptn < orig_nptn) {
-                VectorClass freq;
-                freq.load_a(&ptn_freq[ptn]);
-                VectorClass inv_lh_ptn = 1.0 / lh_ptn;
-
-                // compute gradient (my_df)
-                df_ptn  *= inv_lh_ptn;
-                ddf_ptn *= inv_lh_ptn;
-                my_df    = mul_add(df_ptn, freq, my_df);
-                my_ddf  += nmul_add(df_ptn, df_ptn, ddf_ptn) * freq;
-            } else {
-                vc_prob_const += lh_ptn;
-                vc_df_const   += df_ptn;
-                vc_ddf_const  += ddf_ptn;
-            }
-        } // FOR ptn
-        {
-            //These additions don't need to be in a critical section, because of the
-            //reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
-            //clause in the omp parallel for.
-            all_df  += horizontal_add(my_df);
-            all_ddf += horizontal_add(my_ddf);
+            // mixed branch length model
+            VectorClass lh_ptn;
+            VectorClass df_ptn, ddf_ptn;
+
+            for (size_t ptn = ptn_lower; ptn < ptn_upper; ptn+=VectorClass::size()) {
+                VectorClass *theta = ((VectorClass*)(theta_all + ptn*block)) + addr;
+                double *val0_ptr = val0 + addr;
+                double *val1_ptr = val1 + addr;
+                double *val2_ptr = val2 + addr;
+                lh_ptn = df_ptn = ddf_ptn = 0.0;
+                for (size_t c = 0; c < nmix; c++) {
+                #ifdef KERNEL_FIX_STATES
+                    dotProductTriple<VectorClass, double, nstates, FMA, true>(val0_ptr, val1_ptr, val2_ptr, theta, lh_ptn, df_ptn, ddf_ptn, nstates);
+                #else
+                    dotProductTriple<VectorClass, double, FMA, true>(val0_ptr, val1_ptr, val2_ptr, theta, lh_ptn, df_ptn, ddf_ptn,nstates, nstates);
+                #endif
+                    val0_ptr += nstates;
+                    val1_ptr += nstates;
+                    val2_ptr += nstates;
+                    theta += nstates;
+                }
+                lh_ptn = abs(lh_ptn) + VectorClass().load_a(&ptn_invar[ptn]);
+                if (ptn < orig_nptn) {
+                    VectorClass freq;
+                    freq.load(&weights[ptn]);
+                    VectorClass inv_lh_ptn = 1.0 / lh_ptn;
+
+                    // compute gradient (my_df)
+                    df_ptn  *= inv_lh_ptn;
+                    ddf_ptn *= inv_lh_ptn;
+                    my_df    = mul_add(df_ptn, freq, my_df);
+                    my_ddf  += nmul_add(df_ptn, df_ptn, ddf_ptn) * freq;
+                } else {
+                    vc_prob_const += lh_ptn;
+                    vc_df_const   += df_ptn;
+                    vc_ddf_const  += ddf_ptn;
+                }
+            } // FOR ptn
+            my_sums[cur_mixlen] = horizontal_add(my_df);
+            my_sums[nmixlen + cur_mixlen] = horizontal_add(my_ddf);
             if (ASC_Lewis) {
-                all_prob_const += horizontal_add(vc_prob_const);
-                all_df_const   += horizontal_add(vc_df_const);
-                all_ddf_const  += horizontal_add(vc_ddf_const);
+                my_sums[2*nmixlen + cur_mixlen] = horizontal_add(vc_prob_const);
+                my_sums[3*nmixlen + cur_mixlen] = horizontal_add(vc_df_const);
+                my_sums[4*nmixlen + cur_mixlen] = horizontal_add(vc_ddf_const);
             }
-        }
+        } // FOR class
     } // FOR packet
 
     // mark buffer as computed
     theta_computed = true;
 
-    df  = all_df;
-    ddf = all_ddf;
+    double nsites = aln->getNSite();
+    for (size_t cur_mixlen = 0; cur_mixlen < nmixlen; cur_mixlen++) {
+        if (!active[cur_mixlen])
+            continue;
+        df[cur_mixlen]  = packet_sums.total(cur_mixlen);
+        ddf[cur_mixlen] = packet_sums.total(nmixlen + cur_mixlen);
 
-    if (!SAFE_NUMERIC && !std::isfinite(df)) {
-        outError("Numerical underflow (lh-derivative-mixlen). Run again with the safe likelihood kernel via `-safe` option");
-    }
-	if (ASC_Lewis) {
-        all_prob_const = 1.0/(1.0 - all_prob_const);
-        // ascertainment bias correction
-        all_df_const  *= all_prob_const;
-        all_ddf_const *= all_prob_const;
-        double nsites = aln->getNSite();
-        df  += nsites * all_df_const;
-        ddf += nsites * (all_ddf_const + all_df_const*all_df_const);
-    }
-    if (!std::isfinite(df)) {
-        cout << "WARNING: Numerical underflow for lh-derivative-mixlen" << endl;
-        df = ddf = 0.0;
+        if (!SAFE_NUMERIC && !std::isfinite(df[cur_mixlen])) {
+            outError("Numerical underflow (lh-derivative-mixlen). Run again with the safe likelihood kernel via `-safe` option");
+        }
+        if (ASC_Lewis) {
+            double all_prob_const = 1.0/(1.0 - packet_sums.total(2*nmixlen + cur_mixlen));
+            // ascertainment bias correction
+            double all_df_const  = packet_sums.total(3*nmixlen + cur_mixlen) * all_prob_const;
+            double all_ddf_const = packet_sums.total(4*nmixlen + cur_mixlen) * all_prob_const;
+            df[cur_mixlen]  += nsites * all_df_const;
+            ddf[cur_mixlen] += nsites * (all_ddf_const + all_df_const*all_df_const);
+        }
+        if (!std::isfinite(df[cur_mixlen])) {
+            cout << "WARNING: Numerical underflow for lh-derivative-mixlen" << endl;
+            df[cur_mixlen] = ddf[cur_mixlen] = 0.0;
+        }
     }
 }
 
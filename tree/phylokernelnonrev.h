@@ -659,8 +659,8 @@ void PhyloTree::computeNonrevLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch
         }
 	}
 
-    double all_df(0.0), all_ddf(0.0);
-    double all_prob_const(0.0), all_df_const(0.0), all_ddf_const(0.0);
+    // per packet: df, ddf, prob_const, df_const, ddf_const
+    PacketSums packet_sums(num_packets, 5);
     vector<size_t> limits;
     computeBounds<VectorClass>(num_threads, num_packets, nptn, limits);
 
@@ -723,7 +723,7 @@ void PhyloTree::computeNonrevLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch
         
     	// now do the real computation
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
         for (int packet_id = 0; packet_id < num_packets; packet_id++) {
             VectorClass my_df(0.0), my_ddf(0.0), vc_prob_const(0.0), vc_df_const(0.0), vc_ddf_const(0.0);
@@ -855,17 +855,13 @@ void PhyloTree::computeNonrevLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch
                     vc_ddf_const += ddf_ptn;
                 }
             } // FOR ptn
-            {
-                //These additions do not need to be in a critical section, because the
-                //reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
-                //clause in the omp parallel for takes care of that.
-                all_df  += horizontal_add(my_df);
-                all_ddf += horizontal_add(my_ddf);
-                if (isASC) {
-                    all_prob_const += horizontal_add(vc_prob_const);
-                    all_df_const   += horizontal_add(vc_df_const);
-                    all_ddf_const  += horizontal_add(vc_ddf_const);
-                }
+            double *my_sums = packet_sums.at(packet_id);
+            my_sums[0] = horizontal_add(my_df);
+            my_sums[1] = horizontal_add(my_ddf);
+            if (isASC) {
+                my_sums[2] = horizontal_add(vc_prob_const);
+                my_sums[3] = horizontal_add(vc_df_const);
+                my_sums[4] = horizontal_add(vc_ddf_const);
             }
         } // FOR thread_id
     } else {
@@ -875,7 +871,7 @@ void PhyloTree::computeNonrevLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch
         }
     	// both dad and node are internal nodes
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
         for (int packet_id = 0; packet_id < num_packets; packet_id++) {
             VectorClass my_df(0.0), my_ddf(0.0), vc_prob_const(0.0);
@@ -1013,21 +1009,19 @@ void PhyloTree::computeNonrevLikelihoodDervGenericSIMD(PhyloNeighbor *dad_branch
                     vc_ddf_const += ddf_ptn;
                 }
             } // FOR ptn
-            {
-                //These additions do not need to be in a critical section, because the
-                //reduction(+:all_df,all_ddf,all_prob_const,all_df_const,all_ddf_const)
-                //clause in the omp parallel for takes care of that.
-                all_df  += horizontal_add(my_df);
-                all_ddf += horizontal_add(my_ddf);
-                if (isASC) {
-                    all_prob_const += horizontal_add(vc_prob_const);
-                    all_df_const   += horizontal_add(vc_df_const);
-                    all_ddf_const  += horizontal_add(vc_ddf_const);
-                }
+            double *my_sums = packet_sums.at(packet_id);
+            my_sums[0] = horizontal_add(my_df);
+            my_sums[1] = horizontal_add(my_ddf);
+            if (isASC) {
+                my_sums[2] = horizontal_add(vc_prob_const);
+                my_sums[3] = horizontal_add(vc_df_const);
+                my_sums[4] = horizontal_add(vc_ddf_const);
             }
         } // FOR thread
         aligned_free(buffer_lh);
     }
+    double all_df = packet_sums.total(0), all_ddf = packet_sums.total(1);
+    double all_prob_const = packet_sums.total(2), all_df_const = packet_sums.total(3), all_ddf_const = packet_sums.total(4);
     *df  = all_df;
     *ddf = all_ddf;
     // ASSERT(std::isfinite(*df) && "Numerical underflow for non-rev lh-derivative");
@@ -1138,8 +1132,8 @@ double PhyloTree::computeNonrevLikelihoodBranchGenericSIMD(PhyloNeighbor *dad_br
         }
     }
 
-    double all_tree_lh(0.0);
-    double all_prob_const(0.0);
+    // per packet: log-likelihood, prob_const
+    PacketSums packet_sums(num_packets, 2);
 
     if (dad->isLeaf()) {
     	// special treatment for TIP-INTERNAL NODE case
@@ -1178,7 +1172,7 @@ double PhyloTree::computeNonrevLikelihoodBranchGenericSIMD(PhyloNeighbor *dad_br
 
     	// now do the real computation
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_tree_lh,all_prob_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
         for (int packet_id = 0; packet_id < num_packets; packet_id++) {
             VectorClass vc_tree_lh(0.0), vc_prob_const(0.0);
@@ -1315,20 +1309,16 @@ double PhyloTree::computeNonrevLikelihoodBranchGenericSIMD(PhyloNeighbor *dad_br
                     vc_prob_const += lh_ptn;
                 }
             } // FOR ptn
-            {
-                //These additions need not be in a critical section. The
-                //reduction(+:all_tree_lh,all_prob_const) clause in the
-                //omp parallel for takes care of that.
-                all_tree_lh += horizontal_add(vc_tree_lh);
-                if (isASC)
-                    all_prob_const += horizontal_add(vc_prob_const);
-            }
+            double *my_sums = packet_sums.at(packet_id);
+            my_sums[0] = horizontal_add(vc_tree_lh);
+            if (isASC)
+                my_sums[1] = horizontal_add(vc_prob_const);
         } // FOR thread_id
     } else {
 
     	// both dad and node are internal nodes
 #ifdef _OPENMP
-#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads) reduction(+:all_tree_lh,all_prob_const)
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
 #endif
         for (int packet_id = 0; packet_id < num_packets; packet_id++) {
             VectorClass vc_tree_lh(0.0), vc_prob_const(0.0);
@@ -1471,18 +1461,15 @@ double PhyloTree::computeNonrevLikelihoodBranchGenericSIMD(PhyloNeighbor *dad_br
                     vc_prob_const += lh_ptn;
                 }
             } // FOR ptn
-            {
-                //These additions need not be in a critical section. The
-                //reduction(+:all_tree_lh,all_prob_const) clause in the
-                //omp parallel for takes care of that.
-                all_tree_lh += horizontal_add(vc_tree_lh);
-                if (isASC)
-                    all_prob_const += horizontal_add(vc_prob_const);
-            }
+            double *my_sums = packet_sums.at(packet_id);
+            my_sums[0] = horizontal_add(vc_tree_lh);
+            if (isASC)
+                my_sums[1] = horizontal_add(vc_prob_const);
         } // FOR thread_id
     }
     
-    tree_lh = all_tree_lh;
+    double all_prob_const = packet_sums.total(1);
+    tree_lh = packet_sums.total(0);
     if (!std::isfinite(tree_lh)) {
         outWarning("Numerical underflow for non-rev lh-branch " + aln->name);
         if (verbose_mode >= VB_MED) {
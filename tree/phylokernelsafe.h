@@ -1491,9 +1491,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
             switch ((*alnit)->seq_type) {
             case SEQ_DNA:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 4) {
                         for (int j = 0; j < freq; j++, site++) {
                             if (site == NUM_BITS) {
@@ -1534,9 +1533,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
                 break;
             case SEQ_PROTEIN:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 20) {
                         for (int j = 0; j < freq; j++, site++) {
                             if (site == NUM_BITS) {
@@ -1575,9 +1573,8 @@ void PhyloTree::computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, Phylo
                 break;
             default:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < (*alnit)->num_states) {
                         for (int j = 0; j < freq; j++, site++) {
                             if (site == NUM_BITS) {
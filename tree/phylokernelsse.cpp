@@ -27,8 +27,7 @@
 void PhyloTree::setParsimonyKernelSSE() {
     if (cost_matrix) {
         // Sankoff kernel
-        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<Vec4ui>;
-        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<Vec4ui>;
+        setParsimonyKernelSankoffSIMD<Vec4ui>();
         return;
     }
     // Fitch kernel
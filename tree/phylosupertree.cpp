@@ -721,13 +721,15 @@ double PhyloSuperTree::computeLikelihood(double *pattern_lh, bool save_log_value
 	} else {
         if (part_order.empty()) computePartitionOrder();
 		#ifdef _OPENMP
-		#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(num_threads > 1)
+		#pragma omp parallel for schedule(dynamic) if(num_threads > 1)
 		#endif
 		for (int j = 0; j < ntrees; j++) {
             int i = part_order[j];
 			part_info[i].cur_score = at(i)->computeLikelihood();
-			tree_lh += part_info[i].cur_score;
 		}
+		// add up in partition order, independent of the thread schedule
+		for (int i = 0; i < ntrees; i++)
+			tree_lh += part_info[i].cur_score;
 	}
 	return tree_lh;
 }
@@ -782,15 +784,16 @@ double PhyloSuperTree::optimizeAllBranches(int my_iterations, double tolerance,
 	int ntrees = size();
     if (part_order.empty()) computePartitionOrder();
 	#ifdef _OPENMP
-	#pragma omp parallel for reduction(+: tree_lh) schedule(dynamic) if(num_threads > 1)
+	#pragma omp parallel for schedule(dynamic) if(num_threads > 1)
 	#endif
 	for (int j = 0; j < ntrees; j++) {
         int i = part_order[j];
 		part_info[i].cur_score = at(i)->optimizeAllBranches(my_iterations, tolerance/min(ntrees,10), maxNRStep);
-		tree_lh += part_info[i].cur_score;
 		if (verbose_mode >= VB_MAX)
 			at(i)->printTree(cout, WT_BR_LEN + WT_NEWLINE);
 	}
+	for (int i = 0; i < ntrees; i++)
+		tree_lh += part_info[i].cur_score;
 
 	if (my_iterations >= 100) computeBranchLengths();
 	return tree_lh;
@@ -1227,13 +1230,10 @@ PhyloTree *PhyloSuperTree::extractSubtree(set<int> &ids) {
 	return tree;
 }
 
-uint64_t PhyloSuperTree::getMemoryRequired(size_t ncategory, bool full_mem) {
-//	uint64_t mem_size = PhyloTree::getMemoryRequired(ncategory);
+void PhyloSuperTree::getMemoryComponents(MemoryComponents &mem, size_t ncategory, bool full_mem) {
 	// supertree does not need any memory for likelihood vectors!
-	uint64_t mem_size = 0;
 	for (iterator it = begin(); it != end(); it++)
-		mem_size += (*it)->getMemoryRequired(ncategory, full_mem);
-	return mem_size;
+		(*it)->getMemoryComponents(mem, ncategory, full_mem);
 }
 
 // get memory requirement for ModelFinder
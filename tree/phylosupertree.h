@@ -377,10 +377,12 @@ public:
     PhyloTree *extractSubtree(set<int> &ids);
 
     /**
-     * compute the memory size required for storing partial likelihood vectors
-     * @return memory size required in bytes
+     * compute the memory required by each component, summed over all partitions
+     * @param[out] mem memory of each component, added to the existing values
+     * @param ncategory number of rate categories if site_rate is not yet set
+     * @param full_mem TRUE to ignore the memory saving mode
      */
-    virtual uint64_t getMemoryRequired(size_t ncategory = 1, bool full_mem = false);
+    virtual void getMemoryComponents(MemoryComponents &mem, size_t ncategory = 1, bool full_mem = false);
 
     /**
      * compute the memory size for top partitions required for storing partial likelihood vectors
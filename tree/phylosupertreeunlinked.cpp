@@ -241,14 +241,15 @@ double PhyloSuperTreeUnlinked::doTreeSearch() {
     bool saved_print_ufboot_trees = params->print_ufboot_trees;
     params->print_ufboot_trees = false;
 
-#pragma omp parallel for schedule(dynamic) num_threads(num_threads) if (num_threads > 1) reduction(+: tree_lh)
+    DoubleVector part_lh(size(), 0.0);
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads) if (num_threads > 1)
     for (int i = 0; i < size(); i++) {
         IQTree *part_tree = (IQTree*)at(part_order[i]);
         Checkpoint *ckp = new Checkpoint;
         getCheckpoint()->getSubCheckpoint(ckp, part_tree->aln->name);
         part_tree->setCheckpoint(ckp);
         double score = part_tree->doTreeSearch();
-        tree_lh += score;
+        part_lh[part_order[i]] = score;
 #pragma omp critical
         {
             getCheckpoint()->putSubCheckpoint(ckp, part_tree->aln->name);
@@ -267,6 +268,8 @@ double PhyloSuperTreeUnlinked::doTreeSearch() {
     params->suppress_output_flags= saved_flag;
     params->print_ufboot_trees = saved_print_ufboot_trees;
 
+    for (double score : part_lh)
+        tree_lh += score;
     if (tree_lh < curScore)
         cout << "BETTER TREE FOUND: " << tree_lh << endl;
     curScore = tree_lh;
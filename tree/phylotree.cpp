@@ -35,6 +35,7 @@
 #include "utils/MPIHelper.h"
 #include "utils/hammingdistance.h"
 #include "model/modelmixture.h"
+#include "model/ratefree.h"
 #include "phylonodemixlen.h"
 #include "phylotreemixlen.h"
 
@@ -85,6 +86,7 @@ void PhyloTree::init() {
     tip_partial_pars = NULL;
     tip_partial_lh_computed = 0;
     ptn_freq_computed = false;
+    ptn_freq_weights = NULL;
     central_scale_num = NULL;
     nni_scale_num = NULL;
     central_partial_pars = NULL;
@@ -829,7 +831,10 @@ size_t PhyloTree::getBitsBlockSize() {
     // reserve the last entry for parsimony score
 //    return (aln->num_states * aln->size() + UINT_BITS - 1) / UINT_BITS + 1;
     if (cost_matrix) {
-        return get_safe_upper_limit_float(aln->size() * aln->num_states);
+        // SIMD Sankoff kernels work on whole vectors of ordered_pattern, which is padded on its own;
+        // partitions pad theirs separately, so it can be longer than the padded number of patterns
+        size_t nptn = max(get_safe_upper_limit_float(aln->size()), aln->ordered_pattern.size());
+        return nptn * aln->num_states;
     }
     size_t len = aln->getMaxNumStates() * ((max(aln->size(), (size_t)aln->num_variant_sites) + SIMD_BITS - 1) / UINT_BITS) + 4;
 #ifdef __AVX512KNL
@@ -922,19 +927,30 @@ void PhyloTree::initializeAllPartialLh() {
     }
     size_t block_size = mem_size * numStates * site_rate->getNRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
     // make sure _pattern_lh size is divisible by 4 (e.g., 9->12, 14->16)
-    if (!_pattern_lh)
+    if (!_pattern_lh) {
         _pattern_lh = aligned_alloc<double>(mem_size);
-    if (!_pattern_lh_cat)
-        _pattern_lh_cat = aligned_alloc<double>(mem_size * site_rate->getNDiscreteRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures()));
+        placeLhBuffer(_pattern_lh, 1, mem_size, mem_size, 1);
+    }
+    if (!_pattern_lh_cat) {
+        size_t ncat_mix = site_rate->getNDiscreteRate() * ((model_factory->fused_mix_rate)? 1 : model->getNMixtures());
+        _pattern_lh_cat = aligned_alloc<double>(mem_size * ncat_mix);
+        placeLhBuffer(_pattern_lh_cat, 1, mem_size * ncat_mix, mem_size, ncat_mix);
+    }
     if (!_site_lh && (params->robust_phy_keep < 1.0 || params->robust_median)) {
         _site_lh = aligned_alloc<double>(getAlnNSite());
     }
-    if (!_pattern_scaling)
+    if (!_pattern_scaling) {
         _pattern_scaling = aligned_alloc<double>(mem_size);
-    if (!theta_all)
+        placeLhBuffer(_pattern_scaling, 1, mem_size, mem_size, 1);
+    }
+    if (!theta_all) {
         theta_all = aligned_alloc<double>(block_size);
-    if (!buffer_scale_all)
+        placeLhBuffer(theta_all, 1, block_size, mem_size, block_size / mem_size);
+    }
+    if (!buffer_scale_all) {
         buffer_scale_all = aligned_alloc<double>(mem_size);
+        placeLhBuffer(buffer_scale_all, 1, mem_size, mem_size, 1);
+    }
     if (!buffer_partial_lh) {
         buffer_partial_lh = aligned_alloc<double>(getBufferPartialLhSize());
     }
@@ -944,8 +960,10 @@ void PhyloTree::initializeAllPartialLh() {
     }
     if (!ptn_freq_pars)
         ptn_freq_pars = aligned_alloc<UINT>(mem_size);
-    if (!ptn_invar)
+    if (!ptn_invar) {
         ptn_invar = aligned_alloc<double>(mem_size);
+        placeLhBuffer(ptn_invar, 1, mem_size, mem_size, 1);
+    }
     initializeAllPartialLh(index, indexlh);
     if (params->lh_mem_save == LM_MEM_SAVE)
         mem_slots.init(this, max_lh_slots);
@@ -959,6 +977,33 @@ void PhyloTree::initializeAllPartialLh() {
 
 }
 
+template <class T>
+void PhyloTree::placeLhBuffer(T *mem, size_t num_blocks, size_t block_size, size_t nptn, size_t ptn_size) {
+    if (params->lh_huge_pages)
+        adviseHugePages(mem, num_blocks * block_size * sizeof(T));
+#ifdef _OPENMP
+    if (!params->numa_placement || num_threads <= 1 || nptn == 0)
+        return;
+    // patterns are split into contiguous slices of whole vectors, one per thread, like the first wave of packets
+    size_t vsize = max(vector_size, (size_t)1);
+    size_t nvec = (nptn + vsize - 1) / vsize;
+    #pragma omp parallel num_threads(num_threads)
+    {
+        size_t nthreads = omp_get_num_threads();
+        size_t thread_id = omp_get_thread_num();
+        size_t lower = min(nptn, nvec * thread_id / nthreads * vsize);
+        size_t upper = min(nptn, nvec * (thread_id + 1) / nthreads * vsize);
+        for (size_t block = 0; block < num_blocks; block++) {
+            T *block_mem = mem + block * block_size;
+            memset(block_mem + lower * ptn_size, 0, (upper - lower) * ptn_size * sizeof(T));
+            // entries beyond the pattern slices
+            if (thread_id == nthreads - 1 && upper * ptn_size < block_size)
+                memset(block_mem + upper * ptn_size, 0, (block_size - upper * ptn_size) * sizeof(T));
+        }
+    }
+#endif
+}
+
 void PhyloTree::deleteAllPartialLh() {
     //Note: aligned_free now sets the pointer to nullptr
     //      (so there's no need to do that explicitly any more)
@@ -989,7 +1034,33 @@ void PhyloTree::deleteAllPartialLh() {
     clearAllPartialLH();
 }
  
+void MemoryComponents::report(ostream &out) const {
+    ios_base::fmtflags flags = out.flags();
+    streamsize prec = out.precision();
+    out.precision(1);
+    out << fixed
+        << "  Alignment:          " << alignment / 1048576.0 << " MB" << endl
+        << "  Partial likelihood: " << partial_lh / 1048576.0 << " MB" << endl
+        << "  Partial parsimony:  " << partial_pars / 1048576.0 << " MB" << endl
+        << "  Buffers:            " << buffers / 1048576.0 << " MB" << endl
+        << "  Model:              " << model / 1048576.0 << " MB" << endl;
+    if (ufboot)
+        out << "  UFBoot:             " << ufboot / 1048576.0 << " MB" << endl;
+    if (model_finder)
+        out << "  ModelFinder trees:  " << model_finder / 1048576.0 << " MB" << endl;
+    if (rate_em)
+        out << "  FreeRate EM trees:  " << rate_em / 1048576.0 << " MB" << endl;
+    out.flags(flags);
+    out.precision(prec);
+}
+
 uint64_t PhyloTree::getMemoryRequired(size_t ncategory, bool full_mem) {
+    MemoryComponents mem;
+    getMemoryComponents(mem, ncategory, full_mem);
+    return mem.total();
+}
+
+void PhyloTree::getMemoryComponents(MemoryComponents &mem, size_t ncategory, bool full_mem) {
     // +num_states for ascertainment bias correction
     int64_t nptn = get_safe_upper_limit(aln->getNPattern()) + get_safe_upper_limit(aln->num_states);
     if (model_factory)
@@ -1004,20 +1075,44 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory, bool full_mem) {
 
     int64_t block_size = scale_block_size * aln->num_states;
 
-    int64_t mem_size;
+    MemoryComponents tree_mem;
+
+    // site patterns and the site-to-pattern map
+    tree_mem.alignment = aln->getNPattern() * (sizeof(Pattern) + aln->getNSeq() * sizeof(StateType))
+        + aln->getNSite() * sizeof(int);
+
     // memory to tip_partial_lh
-    if (model)
-        mem_size = aln->num_states * (aln->STATE_UNKNOWN+1) * model->getNMixtures() * sizeof(double);
+    if (model && model->isSiteSpecificModel())
+        tree_mem.partial_lh = get_safe_upper_limit(aln->size()) * aln->num_states * leafNum * sizeof(double);
+    else if (model)
+        tree_mem.partial_lh = aln->num_states * (aln->STATE_UNKNOWN+1) * model->getNMixtures() * sizeof(double);
     else
-        mem_size = aln->num_states * (aln->STATE_UNKNOWN+1) * sizeof(double);
-
-    // memory for UFBoot
+        tree_mem.partial_lh = aln->num_states * (aln->STATE_UNKNOWN+1) * sizeof(double);
+
+    // partial parsimony vectors of all branches and tips
+    tree_mem.partial_pars = ((leafNum - 1) * 4 * getBitsBlockSize()
+        + get_safe_upper_limit_float(aln->num_states * (aln->STATE_UNKNOWN+1))) * sizeof(UINT);
+
+    // _pattern_lh, _pattern_scaling, buffer_scale_all, ptn_freq, ptn_invar, ptn_freq_pars,
+    // G_matrix (one vector per branch), _pattern_lh_cat and theta_all
+    int64_t num_branches = (branchNum > 0) ? branchNum : 2 * leafNum - 3;
+    tree_mem.buffers = nptn * (5 * sizeof(double) + sizeof(UINT))
+        + num_branches * nptn * sizeof(double)
+        + scale_block_size * sizeof(double) + block_size * sizeof(double);
+    if (num_threads > 0 && model && site_rate)
+        tree_mem.buffers += getBufferPartialLhSize() * sizeof(double);
+    // NNI pattern log-likelihoods of the branch tests after the tree search, see testBranches
+    uint64_t branch_test_mem = getBranchTestMemory((leafNum > 3) ? leafNum - 3 : 0);
+    tree_mem.buffers += branch_test_mem;
+
+    // memory for UFBoot: bootstrap samples, log-likelihoods, support counts and the best tree per replicate
     if (params->gbo_replicates)
-        mem_size += params->gbo_replicates*nptn*sizeof(BootValType);
+        tree_mem.ufboot = params->gbo_replicates * (nptn * sizeof(BootValType) + sizeof(double) + sizeof(int)
+            + sizeof(string) + (uint64_t)(leafNum * (log10(leafNum) + 4)));
 
     // memory for model
     if (model)
-        mem_size += model->getMemoryRequired();
+        tree_mem.model = model->getMemoryRequired();
 
     int64_t lh_scale_size = block_size * sizeof(double) + scale_block_size * sizeof(UBYTE);
 
@@ -1030,7 +1125,8 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory, bool full_mem) {
         } else if (params->max_mem_size <= 1) {
             max_lh_slots = floor(params->max_mem_size*(leafNum-2));
         } else {
-            int64_t rest_mem = params->max_mem_size - mem_size;
+            // budget left after all other components
+            int64_t rest_mem = params->max_mem_size - tree_mem.total();
             
             // include 2 blocks for nni_partial_lh
             max_lh_slots = rest_mem / lh_scale_size - 2;
@@ -1040,15 +1136,22 @@ uint64_t PhyloTree::getMemoryRequired(size_t ncategory, bool full_mem) {
                 max_lh_slots = leafNum-2;
         }
         if (max_lh_slots < min_lh_slots) {
-            cout << "WARNING: Too low -mem, automatically increased to " << (mem_size + (min_lh_slots+2)*lh_scale_size)/1048576.0 << " MB" << endl;
+            cout << "WARNING: Too low -mem, automatically increased to " << (tree_mem.total() + (min_lh_slots+2)*lh_scale_size)/1048576.0 << " MB" << endl;
             max_lh_slots = min_lh_slots;
         }
     }
 
 
     // also count MEM for nni_partial_lh
-    mem_size += (max_lh_slots+2) * lh_scale_size;
-    return mem_size;
+    tree_mem.partial_lh += (max_lh_slots+2) * lh_scale_size;
+
+    // FreeRate optimized by EM: a single-category tree per worker, see RateFree::optimizeWithEM
+    if (site_rate && site_rate->isFreeRate() && site_rate->getNRate() > 1 &&
+        params->optimize_alg_freerate.find("EM") != string::npos) {
+        uint64_t worker_mem = (tree_mem.partial_lh + tree_mem.buffers - branch_test_mem) / site_rate->getNRate();
+        tree_mem.rate_em = worker_mem * RateFree::getNumEMWorkers(num_threads, site_rate->getNRate(), worker_mem);
+    }
+    mem += tree_mem;
 }
 
 uint64_t PhyloTree::getMemoryRequiredThreaded(size_t ncategory, bool full_mem) {
@@ -1098,6 +1201,8 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
             // allocate memory only once!
             nni_partial_lh = aligned_alloc<double>(IT_NUM*block_size);
             nni_scale_num = aligned_alloc<UBYTE>(IT_NUM*scale_block_size);
+            placeLhBuffer(nni_partial_lh, IT_NUM, block_size, nptn, block_size / nptn);
+            placeLhBuffer(nni_scale_num, IT_NUM, scale_block_size, nptn, safe_numeric ? scale_block_size / nptn : 1);
         }
 
         if (!central_partial_lh) {
@@ -1119,6 +1224,7 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
             }
             if (!central_partial_lh)
                 outError("Not enough memory for partial likelihood vectors");
+            placeLhBuffer(central_partial_lh, max_lh_slots, block_size, nptn, block_size / nptn);
         }
 
         // now always assign tip_partial_lh
@@ -1140,6 +1246,7 @@ void PhyloTree::initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node
             }
             if (!central_scale_num)
                 outError("Not enough memory for scale num vectors");
+            placeLhBuffer(central_scale_num, max_lh_slots, scale_block_size, nptn, safe_numeric ? scale_block_size / nptn : 1);
         }
 
         if (!central_partial_pars) {
@@ -2560,9 +2667,334 @@ void PhyloTree::computeFuncDerv(double value, double &df, double &ddf) {
     ddf = -ddf;
 }
 
+/** number of log-spaced rates scanned before the Newton refinement of a pattern rate */
+const int PATTERN_RATE_GRID = 33;
+
+/** relative tolerance of the Newton refinement, small because the likelihood is flat at high rates */
+const double TOL_PATTERN_RATE = 1e-8;
+
+/**
+    likelihood of a single pattern as a function of its rate, computed by pruning
+    in the eigen space of the substitution model together with first and second
+    derivatives, so that Newton steps need no alignment or tree copies.
+    The exponents of all branches are cached per tree and the eigen-space tip vectors
+    per pattern. A tip branch thus skips the transform into eigen space, but the
+    transform back still costs O(states^2) per branch, rate and category, as does
+    either transform of an internal branch.
+    One instance per thread, the tree is only read.
+*/
+class PatternRateOptimizer : public Optimization {
+public:
+
+    /**
+        @param tree the tree, its branch lengths and substitution model are used
+        @param rate_het true to use the rate categories of the tree, false for a single rate
+    */
+    PatternRateOptimizer(PhyloTree *tree, bool rate_het) {
+        this->tree = tree;
+        aln = tree->aln;
+        ModelSubst *model = tree->getModel();
+        RateHeterogeneity *site_rate = tree->getRate();
+        nstates = aln->num_states;
+        ncat = rate_het ? site_rate->getNRate() : 1;
+        eval = model->getEigenvalues();
+        evec = model->getEigenvectors();
+        inv_evec = model->getInverseEigenvectors();
+        state_freq.resize(nstates);
+        model->getStateFrequency(state_freq.data());
+        for (int c = 0; c < ncat; c++) {
+            cat_rate.push_back(rate_het ? site_rate->getRate(c) : 1.0);
+            cat_prop.push_back(rate_het ? site_rate->getProp(c) : 1.0);
+        }
+        block = ncat*nstates;
+        partial_lh.resize(tree->nodeNum*block*3);
+        node_scale.resize(tree->nodeNum);
+        eigen_lh.resize(nstates*3);
+        ptn_invar = 0.0;
+        addBranches((PhyloNode*)tree->root->neighbors[0]->node, (PhyloNode*)tree->root, tree->root->neighbors[0]->length);
+        branch_eval.resize(branches.size()*block);
+        for (size_t b = 0; b < branches.size(); b++)
+            for (int c = 0; c < ncat; c++) {
+                double len = branches[b].length*cat_rate[c];
+                for (int k = 0; k < nstates; k++)
+                    branch_eval[b*block + c*nstates + k] = eval[k]*len;
+            }
+    }
+
+    /**
+        set the pattern to optimize the rate for
+        @param ptn pattern index
+        @param invar likelihood contribution of invariable sites for this pattern
+    */
+    void setPattern(size_t ptn, double invar) {
+        Pattern &pat = aln->at(ptn);
+        ptn_invar = invar;
+        int nseq = aln->getNSeq();
+        leaf_lh.resize(tree->leafNum*nstates);
+        leaf_eigen.resize(tree->leafNum*nstates);
+        for (int leaf = 0; leaf < tree->leafNum; leaf++) {
+            double *vec = &leaf_lh[leaf*nstates];
+            aln->getAppearance(leaf < nseq ? pat[leaf] : aln->STATE_UNKNOWN, vec);
+            // tip vectors do not depend on the rate: transform them into eigen space once
+            for (int k = 0; k < nstates; k++) {
+                double *inv_row = inv_evec + k*nstates;
+                double x = 0.0;
+                for (int y = 0; y < nstates; y++)
+                    x += inv_row[y]*vec[y];
+                leaf_eigen[leaf*nstates + k] = x;
+            }
+        }
+    }
+
+    /**
+        the likelihood can be multimodal in the rate: scan a log-spaced grid,
+        then refine every local minimum of the grid by Newton between its grid neighbours
+        @param tolerance relative tolerance
+        @return ML rate of the current pattern
+    */
+    double optimizeRate(double min_rate, double max_rate, double tolerance) {
+        double step = pow(max_rate / min_rate, 1.0 / (PATTERN_RATE_GRID - 1));
+        double grid_rate[PATTERN_RATE_GRID], grid_f[PATTERN_RATE_GRID];
+        for (int i = 0; i < PATTERN_RATE_GRID; i++) {
+            grid_rate[i] = (i == PATTERN_RATE_GRID - 1) ? max_rate : min_rate * pow(step, i);
+            grid_f[i] = computeFunction(grid_rate[i]);
+        }
+        double best_rate = grid_rate[0], best_f = grid_f[0];
+        for (int i = 0; i < PATTERN_RATE_GRID; i++) {
+            if ((i > 0 && grid_f[i] > grid_f[i-1]) || (i < PATTERN_RATE_GRID - 1 && grid_f[i] > grid_f[i+1]))
+                continue;
+            double lower = grid_rate[max(i-1, 0)];
+            double upper = grid_rate[min(i+1, PATTERN_RATE_GRID-1)];
+            double rate = minimizeNewton(lower, grid_rate[i], upper, tolerance * grid_rate[i]);
+            double f = computeFunction(rate);
+            if (f > grid_f[i]) {
+                rate = grid_rate[i];
+                f = grid_f[i];
+            }
+            if (f < best_f) {
+                best_f = f;
+                best_rate = rate;
+            }
+        }
+        return best_rate;
+    }
+
+    virtual double computeFunction(double rate) {
+        return computeRateLikelihood(rate, nullptr, nullptr);
+    }
+
+    virtual void computeFuncDerv(double rate, double &df, double &ddf) {
+        computeRateLikelihood(rate, &df, &ddf);
+    }
+
+protected:
+
+    /** one branch of the post-order traversal, child subtree is complete when it is reached */
+    struct RateBranch {
+        PhyloNode *child;
+        PhyloNode *parent;
+        double length;
+    };
+
+    void addBranches(PhyloNode *node, PhyloNode *dad, double length) {
+        FOR_NEIGHBOR_DECLARE(node, dad, it)
+            addBranches((PhyloNode*)(*it)->node, node, (*it)->length);
+        branches.push_back({node, dad, length});
+    }
+
+    /**
+        @param rate pattern rate
+        @param[out] df, ddf first and second derivative of the negative log-likelihood, NULL if not needed
+        @return negative log-likelihood of the pattern
+    */
+    double computeRateLikelihood(double rate, double *df, double *ddf) {
+        bool derv = (df != nullptr);
+        // initialize internal nodes (and the root leaf) for the products over children
+        for (int id = 0; id < tree->nodeNum; id++) {
+            double *lh = &partial_lh[id*block*3];
+            node_scale[id] = 0;
+            if (id == tree->root->id) {
+                for (int c = 0; c < ncat; c++)
+                    memcpy(lh + c*nstates, &leaf_lh[id*nstates], nstates*sizeof(double));
+                memset(lh + block, 0, 2*block*sizeof(double));
+            } else if (id >= tree->leafNum) {
+                for (size_t i = 0; i < block; i++)
+                    lh[i] = 1.0;
+                memset(lh + block, 0, 2*block*sizeof(double));
+            }
+        }
+        for (size_t b = 0; b < branches.size(); b++) {
+            RateBranch &branch = branches[b];
+            double *child_lh = &partial_lh[branch.child->id*block*3];
+            double *child_dlh = child_lh + block, *child_ddlh = child_dlh + block;
+            double *lh = &partial_lh[branch.parent->id*block*3];
+            double *dlh = lh + block, *ddlh = dlh + block;
+            bool child_leaf = branch.child->isLeaf();
+            if (!child_leaf) {
+                // rescale the complete child subtree if it underflows
+                double max_lh = *max_element(child_lh, child_lh + block);
+                if (max_lh < SCALING_THRESHOLD && max_lh != 0.0) {
+                    for (size_t i = 0; i < block*3; i++)
+                        child_lh[i] = ldexp(child_lh[i], SCALING_THRESHOLD_EXP);
+                    node_scale[branch.child->id]++;
+                }
+            }
+            node_scale[branch.parent->id] += node_scale[branch.child->id];
+            for (int c = 0; c < ncat; c++) {
+                double *a_vec = &branch_eval[b*block + c*nstates];
+                double *w = eigen_lh.data(), *dw = w + nstates, *ddw = dw + nstates;
+                double *child_vec = child_lh + c*nstates;
+                double *child_dvec = child_dlh + c*nstates, *child_ddvec = child_ddlh + c*nstates;
+                // transform child vectors into eigen space and apply exp(eval*rate*len)
+                for (int k = 0; k < nstates; k++) {
+                    double x = 0.0, dx = 0.0, ddx = 0.0;
+                    if (child_leaf) {
+                        x = leaf_eigen[branch.child->id*nstates + k];
+                    } else {
+                        double *inv_row = inv_evec + k*nstates;
+                        for (int y = 0; y < nstates; y++) {
+                            x += inv_row[y]*child_vec[y];
+                            if (derv) {
+                                dx += inv_row[y]*child_dvec[y];
+                                ddx += inv_row[y]*child_ddvec[y];
+                            }
+                        }
+                    }
+                    double a = a_vec[k];
+                    double e = exp(a*rate);
+                    w[k] = e*x;
+                    if (derv) {
+                        dw[k] = e*(a*x + dx);
+                        ddw[k] = e*(a*a*x + 2.0*a*dx + ddx);
+                    }
+                }
+                for (int x = 0; x < nstates; x++) {
+                    double *evec_row = evec + x*nstates;
+                    double g = 0.0, dg = 0.0, ddg = 0.0;
+                    for (int k = 0; k < nstates; k++) {
+                        g += evec_row[k]*w[k];
+                        if (derv) {
+                            dg += evec_row[k]*dw[k];
+                            ddg += evec_row[k]*ddw[k];
+                        }
+                    }
+                    size_t i = c*nstates+x;
+                    if (derv) {
+                        ddlh[i] = ddlh[i]*g + 2.0*dlh[i]*dg + lh[i]*ddg;
+                        dlh[i] = dlh[i]*g + lh[i]*dg;
+                    }
+                    lh[i] *= g;
+                }
+            }
+        }
+        double *lh = &partial_lh[tree->root->id*block*3];
+        double *dlh = lh + block, *ddlh = dlh + block;
+        double ptn_lh = 0.0, ptn_df = 0.0, ptn_ddf = 0.0;
+        for (int c = 0; c < ncat; c++)
+            for (int x = 0; x < nstates; x++) {
+                double w = cat_prop[c]*state_freq[x];
+                ptn_lh += w*lh[c*nstates+x];
+                ptn_df += w*dlh[c*nstates+x];
+                ptn_ddf += w*ddlh[c*nstates+x];
+            }
+        int nscale = node_scale[tree->root->id];
+        double log_lh;
+        if (!(fabs(ptn_lh) > 0.0) && ptn_invar == 0.0) {
+            // underflow or numerical noise, let Newton bisect
+            ptn_lh = numeric_limits<double>::min();
+            ptn_df = ptn_ddf = 0.0;
+            log_lh = log(ptn_lh) + nscale*LOG_SCALING_THRESHOLD;
+        } else if (nscale == 0) {
+            ptn_lh = fabs(ptn_lh) + ptn_invar;
+            log_lh = log(ptn_lh);
+        } else if (ptn_invar > 0.0) {
+            // the rate dependent part is negligible against invariable sites
+            ptn_lh = ptn_invar;
+            ptn_df = ptn_ddf = 0.0;
+            log_lh = log(ptn_lh);
+        } else {
+            ptn_lh = fabs(ptn_lh);
+            log_lh = log(ptn_lh) + nscale*LOG_SCALING_THRESHOLD;
+        }
+        if (derv) {
+            double df_frac = ptn_df/ptn_lh;
+            *df = -df_frac;
+            *ddf = -(ptn_ddf/ptn_lh - df_frac*df_frac);
+        }
+        return -log_lh;
+    }
+
+    PhyloTree *tree;
+    Alignment *aln;
+    int nstates, ncat;
+    size_t block;
+    double *eval, *evec, *inv_evec;
+    DoubleVector state_freq, cat_rate, cat_prop;
+    vector<RateBranch> branches;
+
+    /** eval*length*category rate of every branch, block entries per branch */
+    DoubleVector branch_eval;
+
+    /** likelihood, first and second derivative vectors of all nodes, block*3 entries per node */
+    DoubleVector partial_lh;
+    IntVector node_scale;
+    DoubleVector eigen_lh;
+    DoubleVector leaf_lh;
+
+    /** leaf_lh transformed into eigen space */
+    DoubleVector leaf_eigen;
+    double ptn_invar;
+};
+
+bool PhyloTree::optimizePatternRatesEigen(DoubleVector &pattern_rates, double min_rate, double max_rate, bool rate_het) {
+    if (!model->isReversible() || model->isMixture() || model->isSiteSpecificModel() || isMixlen() ||
+        !model_factory->unobserved_ptns.empty() || aln->seq_type == SEQ_POMO || !model->getEigenvalues())
+        return false;
+    if (rate_het && (site_rate->isSiteSpecificRate() || site_rate->isHeterotachy()))
+        return false;
+    size_t nptn = aln->getNPattern();
+    pattern_rates.resize(nptn, 1.0);
+    if (rate_het) {
+        if (!central_partial_lh)
+            initializeAllPartialLh();
+        computePtnInvar();
+    }
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        PatternRateOptimizer rate_opt(this, rate_het);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+        for (size_t ptn = 0; ptn < nptn; ptn++) {
+            rate_opt.setPattern(ptn, rate_het ? ptn_invar[ptn] : 0.0);
+            pattern_rates[ptn] = rate_opt.optimizeRate(min_rate, max_rate, TOL_PATTERN_RATE);
+        }
+    }
+    return true;
+}
+
 void PhyloTree::optimizePatternRates(DoubleVector &pattern_rates) {
     size_t nptn = aln->getNPattern();
     pattern_rates.resize(nptn, 1.0);
+    // same bounds as optimizeTreeLengthScaling
+    double min_brlen = params->max_branch_length;
+    double max_brlen = params->min_branch_length;
+    NodeVector nodes1, nodes2;
+    getBranches(nodes1, nodes2);
+    for (size_t i = 0; i < nodes1.size(); i++) {
+        double len = nodes1[i]->findNeighbor(nodes2[i])->length;
+        max_brlen = max(max_brlen, len);
+        min_brlen = min(min_brlen, len);
+    }
+    if (min_brlen <= 0.0) min_brlen = params->min_branch_length;
+    double min_rate = max(MIN_SITE_RATE, 0.1*params->min_branch_length / min_brlen);
+    double max_rate = min(MAX_SITE_RATE, 10.0*params->max_branch_length / max_brlen);
+    min_rate = min(min_rate, 1.0);
+    max_rate = max(max_rate, 1.0);
+    if (optimizePatternRatesEigen(pattern_rates, min_rate, max_rate, true))
+        return;
 #pragma omp parallel for
     for (size_t ptn = 0; ptn < nptn; ptn++) {
         Alignment *paln = new Alignment;
@@ -3050,6 +3482,113 @@ void PhyloTree::moveRoot(Node *node1, Node *node2) {
     computeBranchDirection();
 }
 
+/** @return key of branch (node1,node2) in a BranchLengthMap */
+static inline pair<Node*, Node*> branchLengthKey(Node *node1, Node *node2) {
+    return (node1 < node2) ? make_pair(node1, node2) : make_pair(node2, node1);
+}
+
+void PhyloTree::getUnrootedBranchLengths(BranchLengthMap &lengths) {
+    lengths.clear();
+    Node *root_dad = root->neighbors[0]->node;
+    NodeVector root_nei;
+    double root_len = 0.0;
+    BranchVector branches;
+    getBranches(branches);
+    for (auto &br : branches) {
+        if (br.first == root || br.second == root)
+            continue;
+        double len = br.first->findNeighbor(br.second)->length;
+        if (br.first == root_dad || br.second == root_dad) {
+            root_nei.push_back((br.first == root_dad) ? br.second : br.first);
+            root_len += len;
+        } else
+            lengths[branchLengthKey(br.first, br.second)] = len;
+    }
+    ASSERT(root_nei.size() == 2);
+    lengths[branchLengthKey(root_nei[0], root_nei[1])] = root_len;
+}
+
+void PhyloTree::setUnrootedBranchLengths(BranchLengthMap &lengths) {
+    auto getLength = [&](Node *node1, Node *node2) {
+        auto it = lengths.find(branchLengthKey(node1, node2));
+        ASSERT(it != lengths.end());
+        return it->second;
+    };
+    Node *root_dad = root->neighbors[0]->node;
+    NodeVector root_nei;
+    FOR_NEIGHBOR_IT(root_dad, root, it)
+        root_nei.push_back((*it)->node);
+    ASSERT(root_nei.size() == 2);
+    double root_len = getLength(root_nei[0], root_nei[1]) / 2.0;
+
+    BranchVector branches, changed;
+    getBranches(branches);
+    for (auto &br : branches) {
+        if (br.first == root || br.second == root)
+            continue;
+        double len;
+        if (br.first == root_dad || br.second == root_dad)
+            len = root_len;
+        else
+            len = getLength(br.first, br.second);
+        Neighbor *nei = br.first->findNeighbor(br.second);
+        if (nei->length == len)
+            continue;
+        nei->length = len;
+        br.second->findNeighbor(br.first)->length = len;
+        changed.push_back(br);
+    }
+    if (changed.empty())
+        return;
+
+    // supertrees and PLL keep their own copies of the lengths
+    if (isSuperTree())
+        ((PhyloSuperTree*) this)->mapTrees();
+    if (Params::getInstance().pll)
+        pllReadNewick(getTreeString());
+    if (isSuperTree() || Params::getInstance().pll || changed.size() > 4) {
+        clearAllPartialLH();
+        return;
+    }
+    // only a few branches next to the root positions: clear what depends on them
+    for (auto &br : changed) {
+        ((PhyloNode*)br.first)->clearReversePartialLh((PhyloNode*)br.second);
+        ((PhyloNode*)br.second)->clearReversePartialLh((PhyloNode*)br.first);
+    }
+}
+
+double PhyloTree::scoreRootPosition(Node *node1, Node *node2, bool optimize_all, double logl_epsilon,
+                                    BranchLengthMap &lengths) {
+    PhyloNode *root_dad = (PhyloNode*)root->neighbors[0]->node;
+    // supertrees and PLL rebuild their own structures in moveRoot
+    bool incremental = !isSuperTree() && !Params::getInstance().pll;
+    if (incremental) {
+        // subtrees that contain the old root position, plus those whose neighbor is re-linked
+        root_dad->clearReversePartialLh(NULL);
+        FOR_NEIGHBOR_IT(root_dad, NULL, it)
+            ((PhyloNeighbor*)(*it))->clearPartialLh();
+    }
+    moveRoot(node1, node2);
+    if (incremental)
+        root_dad->clearReversePartialLh(NULL);
+    else
+        clearAllPartialLH();
+    // undo what the previous position optimized, so that the score does not depend on
+    // the order in which positions are scored
+    setUnrootedBranchLengths(lengths);
+
+    if (optimize_all)
+        return optimizeAllBranches(100, logl_epsilon);
+
+    // only the two halves of the new root branch differ from the input tree
+    optimizeOneBranch(root_dad, (PhyloNode*)node1);
+    optimizeOneBranch(root_dad, (PhyloNode*)node2);
+    return computeLikelihood();
+}
+
+/** number of root positions, best by the local score, that get all branch lengths optimized */
+const int ROOT_POSITION_FULL_OPTIMIZE = 3;
+
 double PhyloTree::optimizeRootPosition(int root_dist, bool write_info, double logl_epsilon) {
     if (!rooted) {
         return curScore;
@@ -3062,8 +3601,6 @@ double PhyloTree::optimizeRootPosition(int root_dist, bool write_info, double lo
     double best_score = curScore;
     string best_tree = getTreeString();
 
-    StrVector trees;
-
     // ignore branches directly descended from root branch
     for (i = 0; i != nodes1.size(); ) {
         if (nodes1[i] == root_dad || nodes2[i] == root_dad) {
@@ -3076,18 +3613,25 @@ double PhyloTree::optimizeRootPosition(int root_dist, bool write_info, double lo
         }
     }
 
-    // get all trees
+    // screen all positions, re-optimizing only the branches next to the old and new root;
+    // every position starts from the lengths of the input tree
+    BranchLengthMap unrooted_lengths;
+    getUnrootedBranchLengths(unrooted_lengths);
+    vector<pair<double,int> > local_scores;
     for (i = 0; i != nodes1.size(); i++) {
-        moveRoot(nodes1[i], nodes2[i]);
-        trees.push_back(getTreeString());
+        double score = scoreRootPosition(nodes1[i], nodes2[i], false, logl_epsilon, unrooted_lengths);
+        local_scores.push_back({score, i});
+        if (verbose_mode >= VB_MED)
+            cout << "Root pos " << i+1 << " (local): " << score << endl;
     }
+    sort(local_scores.begin(), local_scores.end(), greater<pair<double,int> >());
 
-    // optimize branch lengths for all trees
-    for (auto t = trees.begin(); t != trees.end(); t++) {
-        readTreeString(*t);
-        setCurScore(optimizeAllBranches(100, logl_epsilon));
+    // optimize branch lengths of the most promising trees
+    for (int k = 0; k < local_scores.size() && k < ROOT_POSITION_FULL_OPTIMIZE; k++) {
+        i = local_scores[k].second;
+        setCurScore(scoreRootPosition(nodes1[i], nodes2[i], true, logl_epsilon, unrooted_lengths));
         if (verbose_mode >= VB_MED) {
-            cout << "Root pos " << (t - trees.begin())+1 << ": " << curScore << endl;
+            cout << "Root pos " << i+1 << ": " << curScore << endl;
             if (verbose_mode >= VB_DEBUG) {
                 drawTree(cout);
             }
@@ -3137,25 +3681,18 @@ double PhyloTree::testRootPosition(bool write_info, double logl_epsilon, IntVect
         } else {
             i++;
         }
+
     branches.push_back(root_br);
-    string cur_tree = getTreeString();
-        
-    // get all trees
-    StrVector trees;
+
+    // every position starts from the lengths of the input tree, so that the log-likelihoods
+    // do not depend on the order in which positions are tested. As all branches are optimized,
+    // every length changes, so each position is scored with freshly computed partial likelihoods
+    BranchLengthMap unrooted_lengths;
+    getUnrootedBranchLengths(unrooted_lengths);
     branch_ids.clear();
     for (i = 0; i != branches.size(); i++) {
         branch_ids.push_back(branches[i].first->findNeighbor(branches[i].second)->id);
-        moveRoot(branches[i].first, branches[i].second);
-        if (branches[i] == root_br)
-            trees.push_back(cur_tree);
-        else
-            trees.push_back(getTreeString());
-    }
-
-    // optimize branch lengths for all trees
-    for (i = 0; i != trees.size(); i++) {
-        readTreeString(trees[i]);
-        setCurScore(optimizeAllBranches(100, logl_epsilon));
+        setCurScore(scoreRootPosition(branches[i].first, branches[i].second, true, logl_epsilon, unrooted_lengths));
         stringstream ss;
         printTree(ss);
         logl_trees.insert({curScore, make_pair(branch_ids[i], ss.str())});
@@ -3819,7 +4356,9 @@ void PhyloTree::computeBioNJ(Params &params) {
     bool wasDoneInMemory = false;
 #ifdef _OPENMP
     // omp_set_nested(true);
-    omp_set_max_active_levels(2);
+    // keep nesting of the caller (e.g. concurrent bootstrap replicates)
+    int saved_active_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(max(saved_active_levels, 2));
     #pragma omp parallel num_threads(2)
     {
         int thread = omp_get_thread_num();
@@ -3858,7 +4397,7 @@ void PhyloTree::computeBioNJ(Params &params) {
     #ifdef _OPENMP
         #pragma omp barrier
         // omp_set_nested(false);
-        omp_set_max_active_levels(1);
+        omp_set_max_active_levels(saved_active_levels);
     #endif
         
     if (!wasDoneInMemory) {
@@ -5141,22 +5680,6 @@ void PhyloTree::computeNNIPatternLh(double cur_lh, double &lh2, double *pattern_
         cout << "Alternative NNI shows better log-likelihood " << max(lh2,lh3) << " > " << cur_lh << endl;
 }
 
-void PhyloTree::resampleLh(double **pat_lh, double *lh_new, int *rstream) {
-    //int nsite = getAlnNSite();
-    int nptn = getAlnNPattern();
-    memset(lh_new, 0, sizeof(double) * 3);
-    int i;
-    int *boot_freq = aligned_alloc<int>(getAlnNPattern());
-    aln->createBootstrapAlignment(boot_freq, params->bootstrap_spec, rstream);
-    for (i = 0; i < nptn; i++) {
-
-        lh_new[0] += boot_freq[i] * pat_lh[0][i];
-        lh_new[1] += boot_freq[i] * pat_lh[1][i];
-        lh_new[2] += boot_freq[i] * pat_lh[2][i];
-    }
-    aligned_free(boot_freq);
-}
-
 /*********************************************************/
 /** THIS FUNCTION IS TAKEN FROM PHYML source code alrt.c
 * Convert an aLRT statistic to a none parametric support
@@ -5332,100 +5855,151 @@ double Statistics_To_Probabilities(double in)
 
 double PhyloTree::testOneBranch(double best_score, double *pattern_lh, int reps, int lbp_reps,
         PhyloNode *node1, PhyloNode *node2, double &lbp_support, double &aLRT_support, double &aBayes_support) {
-    const int NUM_NNI = 3;
-    double lh[NUM_NNI];
-    double *pat_lh[NUM_NNI];
-    lh[0] = best_score;
-    pat_lh[0] = pattern_lh;
-    int nptn = getAlnNPattern();
-    pat_lh[1] = new double[nptn];
-    pat_lh[2] = new double[nptn];
-    int tmp = save_all_trees;
-    save_all_trees = 0;
-    computeNNIPatternLh(best_score, lh[1], pat_lh[1], lh[2], pat_lh[2], node1, node2);
-    save_all_trees = tmp;
-    double aLRT;
-    if (lh[1] > lh[2])
-        aLRT = (lh[0] - lh[1]);
-    else
-        aLRT = (lh[0] - lh[2]);
-
-    // compute parametric aLRT test support
-    double aLRT_stat = 2*aLRT;
-    aLRT_support = 0.0;
-    if (aLRT_stat >= 0) {
-        aLRT_support = Statistics_To_Probabilities(aLRT_stat);
-    }
+    BranchVector branches(1);
+    branches[0].first = node1;
+    branches[0].second = node2;
+    DoubleVector SH_aLRT, lbp, aLRT, aBayes;
+    testBranches(best_score, pattern_lh, reps, lbp_reps, branches, SH_aLRT, lbp, aLRT, aBayes);
+    lbp_support = lbp[0];
+    aLRT_support = aLRT[0];
+    aBayes_support = aBayes[0];
+    return SH_aLRT[0];
+}
+
+/** fraction of the memory limit that the NNI pattern log-likelihoods of testBranches may take */
+const int BRANCH_TEST_MEMORY_FRACTION = 16;
+
+uint64_t PhyloTree::getBranchTestMemory(size_t nbranch) {
+    if (nbranch == 0 || (!params->aLRT_replicates && !params->localbp_replicates && !params->aLRT_test &&
+                         !params->aBayes_test))
+        return 0;
+    uint64_t branch_mem = 2 * (uint64_t)getAlnNPattern() * sizeof(double);
+    // -mem as a fraction (<= 1) only limits the partial likelihood vectors
+    uint64_t max_mem = (params->max_mem_size > 1) ? (uint64_t)params->max_mem_size : getMemorySize();
+    uint64_t block_size = max_mem / BRANCH_TEST_MEMORY_FRACTION / branch_mem;
+    block_size = max((uint64_t)1, min(block_size, (uint64_t)nbranch));
+    return block_size * branch_mem;
+}
+
+void PhyloTree::testBranches(double best_score, double *pattern_lh, int reps, int lbp_reps,
+        BranchVector &branches, DoubleVector &SH_aLRT_support, DoubleVector &lbp_support,
+        DoubleVector &aLRT_support, DoubleVector &aBayes_support) {
+    size_t nbranch = branches.size();
+    size_t nptn = getAlnNPattern();
+    int times = max(reps, lbp_reps);
+    SH_aLRT_support.assign(nbranch, 0.0);
+    lbp_support.assign(nbranch, 0.0);
+    aLRT_support.assign(nbranch, 0.0);
+    aBayes_support.assign(nbranch, 0.0);
+    if (nbranch == 0)
+        return;
 
-    aBayes_support = 1.0 / (1.0 + exp(lh[1]-lh[0]) + exp(lh[2]-lh[0]));
+    size_t block_size = max((uint64_t)1, getBranchTestMemory(nbranch) / (2 * nptn * sizeof(double)));
+    block_size = min(block_size, nbranch);
+    double *pat_lh = new double[2 * block_size * nptn];
+    DoubleVector lh(2 * block_size), aLRT(block_size);
+    BoolVector resample(block_size);
 
-    int SH_aLRT_support = 0;
-    int lbp_support_int = 0;
+    for (size_t start = 0; start < nbranch; start += block_size) {
+        size_t nblock = min(block_size, nbranch - start);
+        IntVector SH_aLRT_count(nblock, 0), lbp_count(nblock, 0);
 
-    int times = max(reps, lbp_reps);
+        // log-likelihoods of the two NNI trees around every branch of the block
+        for (size_t b = 0; b < nblock; b++) {
+            int tmp = save_all_trees;
+            save_all_trees = 0;
+            computeNNIPatternLh(best_score, lh[2*b], pat_lh + 2*b*nptn, lh[2*b+1], pat_lh + (2*b+1)*nptn,
+                                (PhyloNode*)branches[start+b].first, (PhyloNode*)branches[start+b].second);
+            save_all_trees = tmp;
+            double lh_nni = max(lh[2*b], lh[2*b+1]);
+            aLRT[b] = best_score - lh_nni;
+
+            // compute parametric aLRT test support
+            double aLRT_stat = 2*aLRT[b];
+            if (aLRT_stat >= 0)
+                aLRT_support[start+b] = Statistics_To_Probabilities(aLRT_stat);
+            aBayes_support[start+b] = 1.0 / (1.0 + exp(lh[2*b]-best_score) + exp(lh[2*b+1]-best_score));
+
+            resample[b] = true;
+            if (lh_nni == -DBL_MAX) {
+                SH_aLRT_count[b] = times;
+                resample[b] = false;
+                outWarning("Branch where both NNIs violate constraint tree will show 100% SH-aLRT support");
+            }
+        }
 
-    if (max(lh[1],lh[2]) == -DBL_MAX) {
-        SH_aLRT_support = times;
-        outWarning("Branch where both NNIs violate constraint tree will show 100% SH-aLRT support");
-    } else
+        // one pass over the RELL replicates serves all branches of the block
+        if (times > 0) {
 #ifdef _OPENMP
 #pragma omp parallel
-    {
+        {
         int *rstream;
         init_random(params->ran_seed + omp_get_thread_num(), false, &rstream);
-#pragma omp for reduction(+: lbp_support_int, SH_aLRT_support)
+#else
+        int *rstream = randstream;
 #endif
-    for (int i = 0; i < times; i++) {
-        double lh_new[NUM_NNI];
-        // resampling estimated log-likelihood (RELL)
+        IntVector thread_SH_aLRT_count(nblock, 0), thread_lbp_count(nblock, 0);
+        int *boot_freq = aligned_alloc<int>(nptn);
 #ifdef _OPENMP
-        resampleLh(pat_lh, lh_new, rstream);
-#else
-        resampleLh(pat_lh, lh_new, randstream);
+#pragma omp for
 #endif
-        if (lh_new[0] > lh_new[1] && lh_new[0] > lh_new[2])
-            lbp_support_int++;
-        double cs[NUM_NNI], cs_best, cs_2nd_best;
-        cs[0] = lh_new[0] - lh[0];
-        cs[1] = lh_new[1] - lh[1];
-        cs[2] = lh_new[2] - lh[2];
-        if (cs[0] >= cs[1] && cs[0] >= cs[2]) {
-            cs_best = cs[0];
-            if (cs[1] > cs[2])
-                cs_2nd_best = cs[1];
-            else
-                cs_2nd_best = cs[2];
-        } else if (cs[1] >= cs[2]) {
-            cs_best = cs[1];
-            if (cs[0] > cs[2])
-                cs_2nd_best = cs[0];
-            else
-                cs_2nd_best = cs[2];
-        } else {
-            cs_best = cs[2];
-            if (cs[0] > cs[1])
-                cs_2nd_best = cs[0];
-            else
-                cs_2nd_best = cs[1];
+        for (int i = 0; i < times; i++) {
+            // resampling estimated log-likelihood (RELL)
+            aln->createBootstrapAlignment(boot_freq, params->bootstrap_spec, rstream);
+            double lh_best = 0.0;
+            for (size_t ptn = 0; ptn < nptn; ptn++)
+                lh_best += boot_freq[ptn] * pattern_lh[ptn];
+            for (size_t b = 0; b < nblock; b++) {
+                if (!resample[b])
+                    continue;
+                double *pat_lh1 = pat_lh + 2*b*nptn;
+                double *pat_lh2 = pat_lh1 + nptn;
+                double lh_new[3] = {lh_best, 0.0, 0.0};
+                for (size_t ptn = 0; ptn < nptn; ptn++) {
+                    lh_new[1] += boot_freq[ptn] * pat_lh1[ptn];
+                    lh_new[2] += boot_freq[ptn] * pat_lh2[ptn];
+                }
+                if (lh_new[0] > lh_new[1] && lh_new[0] > lh_new[2])
+                    thread_lbp_count[b]++;
+                double cs[3], cs_best, cs_2nd_best;
+                cs[0] = lh_new[0] - best_score;
+                cs[1] = lh_new[1] - lh[2*b];
+                cs[2] = lh_new[2] - lh[2*b+1];
+                if (cs[0] >= cs[1] && cs[0] >= cs[2]) {
+                    cs_best = cs[0];
+                    cs_2nd_best = max(cs[1], cs[2]);
+                } else if (cs[1] >= cs[2]) {
+                    cs_best = cs[1];
+                    cs_2nd_best = max(cs[0], cs[2]);
+                } else {
+                    cs_best = cs[2];
+                    cs_2nd_best = max(cs[0], cs[1]);
+                }
+                if (aLRT[b] > (cs_best - cs_2nd_best) + 0.05)
+                    thread_SH_aLRT_count[b]++;
+            }
         }
-        if (aLRT > (cs_best - cs_2nd_best) + 0.05)
-            SH_aLRT_support++;
-    }
+        aligned_free(boot_freq);
 #ifdef _OPENMP
-    finish_random(rstream);
-    }
+#pragma omp critical
 #endif
-    delete[] pat_lh[2];
-    delete[] pat_lh[1];
-    
-    lbp_support = 0.0;
-    if (times > 0)
-        lbp_support = ((double)lbp_support_int) / times;
+        for (size_t b = 0; b < nblock; b++) {
+            SH_aLRT_count[b] += thread_SH_aLRT_count[b];
+            lbp_count[b] += thread_lbp_count[b];
+        }
+#ifdef _OPENMP
+        finish_random(rstream);
+        }
+#endif
+        }
 
-    if (times > 0)
-        return ((double) SH_aLRT_support) / times;
-    else
-        return 0.0;
+        for (size_t b = 0; b < nblock; b++)
+            if (times > 0) {
+                SH_aLRT_support[start+b] = ((double) SH_aLRT_count[b]) / times;
+                lbp_support[start+b] = ((double) lbp_count[b]) / times;
+            }
+    }
+    delete[] pat_lh;
 }
 
 int PhyloTree::testAllBranches(int threshold, double best_score, double *pattern_lh, int reps, int lbp_reps, bool aLRT_test, bool aBayes_test,
@@ -5444,10 +6018,22 @@ int PhyloTree::testAllBranches(int threshold, double best_score, double *pattern
             save_all_trees = tmp;
         }
     }
-    if (dad && !node->isLeaf() && !dad->isLeaf()) {
-        double lbp_support, aLRT_support, aBayes_support;
-        double SH_aLRT_support = (testOneBranch(best_score, pattern_lh, reps, lbp_reps,
-            node, dad, lbp_support, aLRT_support, aBayes_support) * 100);
+
+    // all internal branches of the subtree, each as (node, dad) towards the root
+    BranchVector branches, inner_branches;
+    if (dad && !node->isLeaf() && !dad->isLeaf())
+        branches.push_back({node, dad});
+    getInnerBranches(inner_branches, node, dad);
+    for (auto branch : inner_branches)
+        branches.push_back({branch.second, branch.first});
+
+    DoubleVector SH_aLRT, lbp, aLRT, aBayes;
+    testBranches(best_score, pattern_lh, reps, lbp_reps, branches, SH_aLRT, lbp, aLRT, aBayes);
+
+    for (size_t i = 0; i < branches.size(); i++) {
+        node = (PhyloNode*)branches[i].first;
+        dad = (PhyloNode*)branches[i].second;
+        double SH_aLRT_support = SH_aLRT[i] * 100;
         ostringstream ss;
         ss.precision(3);
         ss << node->name;
@@ -5456,22 +6042,19 @@ int PhyloTree::testAllBranches(int threshold, double best_score, double *pattern
         if (reps)
             ss << SH_aLRT_support;
         if (lbp_reps)
-            ss << "/" << lbp_support * 100;
+            ss << "/" << lbp[i] * 100;
         if (aLRT_test)
-            ss << "/" << aLRT_support;
+            ss << "/" << aLRT[i];
         if (aBayes_test)
-            ss << "/" << aBayes_support;
+            ss << "/" << aBayes[i];
         node->name = ss.str();
         if (SH_aLRT_support < threshold)
-            num_low_support = 1;
+            num_low_support++;
         if (((PhyloNeighbor*) node->findNeighbor(dad))->partial_pars) {
             ((PhyloNeighbor*) node->findNeighbor(dad))->partial_pars[0] = round(SH_aLRT_support);
             ((PhyloNeighbor*) dad->findNeighbor(node))->partial_pars[0] = round(SH_aLRT_support);
         }
     }
-    FOR_NEIGHBOR_IT(node, dad, it)
-        num_low_support += testAllBranches(threshold, best_score, pattern_lh, reps, lbp_reps, aLRT_test, aBayes_test, (PhyloNode*) (*it)->node, node);
-
     return num_low_support;
 }
 
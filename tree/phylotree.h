@@ -152,6 +152,9 @@ template <class T> T* ensure_aligned_allocated(T* & ptr, long long int size) {
 typedef std::map< string, double > StringDoubleMap;
 typedef std::map< int, PhyloNode* > IntPhyloNodeMap;
 
+/** branch lengths of an unrooted tree, keyed by the two ends of each branch, lower address first */
+typedef std::map< pair<Node*, Node*>, double > BranchLengthMap;
+
 /*
 #define MappedMat(NSTATES) Map<Matrix<double, NSTATES, NSTATES> >
 #define MappedArr2D(NSTATES) Map<Array<double, NSTATES, NSTATES> >
@@ -330,10 +333,64 @@ public:
     }
 };
 
+/** internal branch of a whole-tree Fitch parsimony pass */
+struct ParsimonyTraversalInfo {
+    PhyloNeighbor *dad_branch;
+    PhyloNeighbor *left, *right;
+    /** substitutions at this node, summed over threads */
+    UINT score;
+};
+
 // ********************************************
 // END traversal information
 // ********************************************
 
+/**
+    memory required by the main components of an analysis, in bytes
+*/
+struct MemoryComponents {
+    /** site patterns and pattern mapping of the alignment */
+    uint64_t alignment;
+    /** partial likelihood and scale number vectors, including tips and NNI vectors */
+    uint64_t partial_lh;
+    /** partial parsimony vectors */
+    uint64_t partial_pars;
+    /** per-pattern and kernel buffers */
+    uint64_t buffers;
+    /** substitution model */
+    uint64_t model;
+    /** UFBoot bootstrap samples and trees */
+    uint64_t ufboot;
+    /** tree copies that ModelFinder evaluates at the same time */
+    uint64_t model_finder;
+    /** single-category trees of the EM optimization of FreeRate models */
+    uint64_t rate_em;
+
+    MemoryComponents() {
+        alignment = partial_lh = partial_pars = buffers = model = ufboot = model_finder = rate_em = 0;
+    }
+
+    /** @return total memory in bytes */
+    uint64_t total() const {
+        return alignment + partial_lh + partial_pars + buffers + model + ufboot + model_finder + rate_em;
+    }
+
+    MemoryComponents &operator+=(const MemoryComponents &mem) {
+        alignment += mem.alignment;
+        partial_lh += mem.partial_lh;
+        partial_pars += mem.partial_pars;
+        buffers += mem.buffers;
+        model += mem.model;
+        ufboot += mem.ufboot;
+        model_finder += mem.model_finder;
+        rate_em += mem.rate_em;
+        return *this;
+    }
+
+    /** print memory of each component in MB */
+    void report(ostream &out) const;
+};
+
 
 /**
 Phylogenetic Tree class
@@ -676,7 +733,11 @@ public:
     template<class VectorClass>
     void computePartialParsimonyFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad);
 
-    template<class VectorClass>
+    /**
+            Sankoff kernel over VectorClass::size() patterns at a time
+            @tparam NSTATES number of states if known at compile time (small state counts), 0 otherwise
+     */
+    template<class VectorClass, const int NSTATES>
     void computePartialParsimonySankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad);
 
     void computeReversePartialParsimony(PhyloNode *node, PhyloNode *dad);
@@ -697,8 +758,47 @@ public:
     template<class VectorClass>
     int computeParsimonyBranchFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst = NULL);
 
+    /**
+            gather the internal branches whose Fitch bit vectors must be recomputed, children first;
+            tip bit vectors are computed on the way
+            @param traversal (OUT) pending internal branches in post-order
+     */
     template<class VectorClass>
+    void collectParsimonyTraversalFastSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, vector<ParsimonyTraversalInfo> &traversal);
+
+    /**
+            compute all pending Fitch bit vectors and the score of a branch in one parallel region,
+            each thread handling a fixed range of columns for the whole traversal
+            @param traversal internal branches from collectParsimonyTraversalFastSIMD
+            @param nsites number of bit vector columns
+            @return number of substitutions on the branch between dad_branch and node_branch
+     */
+    template<class VectorClass, const int NSTATES>
+    UINT computeParsimonyTreeFastSIMD(PhyloNeighbor *dad_branch, PhyloNeighbor *node_branch,
+                                      vector<ParsimonyTraversalInfo> &traversal, size_t nsites);
+
+    template<class VectorClass, const int NSTATES>
     int computeParsimonyBranchSankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst = NULL);
+
+    typedef UINT (PhyloTree::*ComputeParsimonyOutOfTreeType)(UINT *);
+    /** SIMD version of computeParsimonyOutOfTreeSankoff, NULL for the scalar kernel */
+    ComputeParsimonyOutOfTreeType computeParsimonyOutOfTreePointer;
+
+    template<class VectorClass, const int NSTATES>
+    UINT computeParsimonyOutOfTreeSankoffSIMD(UINT *ptn_scores);
+
+    /**
+            combine the Sankoff partial parsimony of both ends of a branch
+            @param branch_subst (OUT) if not NULL, the number of substitutions on this branch
+            @param ptn_scores (OUT) if not NULL, parsimony scores along the patterns
+            @return parsimony score of the tree
+     */
+    template<class VectorClass, const int NSTATES>
+    UINT computeParsimonyPatternSankoffSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, int *branch_subst, UINT *ptn_scores);
+
+    /** set Sankoff kernels for VectorClass, specialised for small numbers of states */
+    template<class VectorClass>
+    void setParsimonyKernelSankoffSIMD();
     
 //    void printParsimonyStates(PhyloNeighbor *dad_branch = NULL, PhyloNode *dad = NULL);
 
@@ -707,6 +807,7 @@ public:
     virtual void setParsimonyKernelAVX() {}
 #else
     virtual void setParsimonyKernelAVX();
+    void setParsimonyKernelAVX512();
 #endif
 
     virtual void setParsimonyKernelSSE();
@@ -780,6 +881,18 @@ public:
      */
     virtual void initializeAllPartialLh(int &index, int &indexlh, PhyloNode *node = NULL, PhyloNode *dad = NULL);
 
+    /**
+            place a newly allocated likelihood buffer with --huge-pages and --numa:
+            each pattern slice of every block is first touched by the thread that computes these patterns
+            @param mem buffer of num_blocks blocks, each storing the entries of nptn patterns first
+            @param num_blocks number of blocks
+            @param block_size number of entries per block
+            @param nptn number of patterns
+            @param ptn_size number of entries per pattern
+     */
+    template <class T>
+    void placeLhBuffer(T *mem, size_t num_blocks, size_t block_size, size_t nptn, size_t ptn_size);
+
 
     /**
             clear all partial likelihood for a clean computation again
@@ -1105,29 +1218,14 @@ public:
     virtual void endMarginalAncestralState(bool orig_kernel_nonrev, double* &ptn_ancestral_prob, int* &ptn_ancestral_seq);
 
     /**
-     	 compute the joint ancestral states at a pattern (Pupko et al. 2000)
-     */
+        compute the joint ancestral states of all internal nodes (Pupko et al. 2000),
+        each pattern conditioned on its most likely rate/mixture category.
+        Patterns are reconstructed in parallel blocks.
+        @param[out] ancestral_seqs array of size nptn*(nodeNum-leafNum),
+            states of internal node id start at (id-leafNum)*nptn
+    */
     void computeJointAncestralSequences(int *ancestral_seqs);
 
-    /**
-     * compute max ancestral likelihood according to
-     *  step 1-3 of the dynamic programming algorithm of Pupko et al. 2000, MBE 17:890-896
-     *  @param dad_branch branch leading to an internal node where to obtain ancestral sequence
-     *  @param dad dad of the target internal node
-     *  @param[out] C array storing all information about max ancestral states
-     */
-    void computeAncestralLikelihood(PhyloNeighbor *dad_branch, PhyloNode *dad, int *C);
-
-    /**
-     * compute max ancestral states according to
-     *  step 4-5 of the dynamic programming algorithm of Pupko et al. 2000, MBE 17:890-896
-     *  @param dad_branch branch leading to an internal node where to obtain ancestral sequence
-     *  @param dad dad of the target internal node
-     *  @param C array storing all information about max ancestral states
-     *  @param[out] ancestral_seqs array of size nptn*nnode for ancestral sequences at all internal nodes
-     */
-    void computeAncestralState(PhyloNeighbor *dad_branch, PhyloNode *dad, int *C, int *ancestral_seqs);
-
     /**
             compute pattern likelihoods only if the accumulated scaling factor is non-zero.
             Otherwise, copy the pattern_lh attribute
@@ -1314,11 +1412,18 @@ public:
     /** For Mixlen stuffs */
     virtual int getCurMixture() { return 0; }
 
+    /**
+        derivatives of the heterotachy EM M-step for all classes in one pass over theta_all
+        @param ptn_weights pattern weights of each class, class by class with get_safe_upper_limit(#patterns) entries each
+        @param active classes to compute, the others are skipped
+        @param df (OUT) first derivative of each class
+        @param ddf (OUT) second derivative of each class
+    */
     template <class VectorClass, const bool SAFE_NUMERIC, const int nstates, const bool FMA = false, const bool SITE_MODEL = false>
-    void computeLikelihoodDervMixlenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf);
+    void computeLikelihoodDervMixlenSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double *ptn_weights, bool *active, double *df, double *ddf);
 
     template <class VectorClass, const bool SAFE_NUMERIC, const bool FMA = false, const bool SITE_MODEL = false>
-    void computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double &df, double &ddf);
+    void computeLikelihoodDervMixlenGenericSIMD(PhyloNeighbor *dad_branch, PhyloNode *dad, double *ptn_weights, bool *active, double *df, double *ddf);
 
 
     /*
@@ -1345,7 +1450,7 @@ public:
     typedef void (PhyloTree::*ComputeLikelihoodDervType)(PhyloNeighbor *, PhyloNode *, double *, double *);
     ComputeLikelihoodDervType computeLikelihoodDervPointer;
 
-    typedef void (PhyloTree::*ComputeLikelihoodDervMixlenType)(PhyloNeighbor *, PhyloNode *, double &, double &);
+    typedef void (PhyloTree::*ComputeLikelihoodDervMixlenType)(PhyloNeighbor *, PhyloNode *, double *, bool *, double *, double *);
     ComputeLikelihoodDervMixlenType computeLikelihoodDervMixlenPointer;
 
     /****************************************************************************
@@ -1456,6 +1561,35 @@ public:
 
     void moveRoot(Node *node1, Node *node2);
 
+    /**
+        save the branch lengths of the rooted tree as those of the unrooted tree,
+        the two branches at the root merged as in moveRoot
+        @param[out] lengths branch lengths of the unrooted tree
+    */
+    void getUnrootedBranchLengths(BranchLengthMap &lengths);
+
+    /**
+        set the branch lengths back to those of getUnrootedBranchLengths for the current root
+        position, the root branch split in half. Only partial likelihoods that depend on a
+        changed branch are cleared.
+        @param lengths branch lengths of the unrooted tree
+    */
+    void setUnrootedBranchLengths(BranchLengthMap &lengths);
+
+    /**
+        move the root to branch (node1,node2) and score the rerooted tree, starting from the
+        branch lengths of the unrooted tree. Only partial likelihoods whose subtree contains the
+        old or the new root position, or a branch whose length is reset, are recomputed.
+        @param node1 one end of the new root branch
+        @param node2 other end of the new root branch
+        @param optimize_all true to optimize all branch lengths, false to optimize only the two
+               new root branches
+        @param logl_epsilon log-likelihood tolerance for optimize_all
+        @param lengths branch lengths of the unrooted tree, see getUnrootedBranchLengths
+        @return log-likelihood of the rerooted tree
+    */
+    double scoreRootPosition(Node *node1, Node *node2, bool optimize_all, double logl_epsilon, BranchLengthMap &lengths);
+
     virtual double computeFundiLikelihood();
 
     /**
@@ -1518,6 +1652,17 @@ public:
      */
     void optimizePatternRates(DoubleVector &pattern_rates);
 
+    /**
+        optimize pattern-specific rates by pruning in the eigen space of a reversible model,
+        without the alignment and tree copies of optimizePatternRates
+        @param[out] pattern_rates ML rate of every pattern
+        @param min_rate, max_rate bounds of the rates
+        @param rate_het true to keep the rate categories and invariable sites of the tree,
+               false to let every pattern evolve at its own rate only
+        @return false if the model is not supported, pattern_rates is then unchanged
+     */
+    bool optimizePatternRatesEigen(DoubleVector &pattern_rates, double min_rate, double max_rate, bool rate_het);
+
      /****************************************************************************
             Branch length optimization by Least Squares
      ****************************************************************************/
@@ -1553,6 +1698,12 @@ public:
      * frequencies of alignment patterns, used as buffer for likelihood computation
      */
     double *ptn_freq;
+
+    /**
+     * if not NULL, weights of the alignment patterns that computePtnFreq() uses instead of
+     * their frequencies, e.g. of a UFBoot replicate evaluated on the original alignment
+     */
+    BootValType *ptn_freq_weights;
     
     /**
      * frequencies of aln->ordered_pattern, used as buffer for parsimony computation
@@ -1924,11 +2075,6 @@ public:
             double &lh3, double *pattern_lh3,
             PhyloNode *node1, PhyloNode *node2);
 
-    /**
-            Resampling estimated log-likelihood (RELL)
-     */
-    void resampleLh(double **pat_lh, double *lh_new, int *rstream);
-
     /**
             Test one branch of the tree with aLRT SH-like interpretation
      */
@@ -1937,6 +2083,25 @@ public:
             PhyloNode *node1, PhyloNode *node2, 
             double &lbp_support, double &aLRT_support, double &aBayes_support);
 
+    /**
+            Test a set of branches with aLRT SH-like interpretation, parametric aLRT and aBayes.
+            Branches are processed in blocks that share one pass over the RELL replicates.
+            @param branches (node1, node2) of every branch, each must be an internal branch
+            @param[out] SH_aLRT_support, lbp_support, aLRT_support, aBayes_support supports of every branch
+     */
+    void testBranches(double best_score, double *pattern_lh, int reps, int lbp_reps,
+            BranchVector &branches, DoubleVector &SH_aLRT_support, DoubleVector &lbp_support,
+            DoubleVector &aLRT_support, DoubleVector &aBayes_support);
+
+    /**
+            memory for the NNI pattern log-likelihoods that testBranches keeps for one block of branches:
+            all branches if they fit into 1/16 of the -mem limit (or of the RAM without -mem), otherwise
+            as many as fit, at least one
+            @param nbranch number of branches to test
+            @return memory in bytes, 0 if no branch test is requested
+     */
+    uint64_t getBranchTestMemory(size_t nbranch);
+
     /**
             Test all branches of the tree with aLRT SH-like interpretation
      */
@@ -2195,6 +2360,15 @@ public:
      */
     virtual uint64_t getMemoryRequired(size_t ncategory = 1, bool full_mem = false);
 
+    /**
+     * compute the memory required by each component of the analysis. With -mem, the number
+     * of partial likelihood slots is planned from the budget left by the other components
+     * @param[out] mem memory of each component, added to the existing values
+     * @param ncategory number of rate categories if site_rate is not yet set
+     * @param full_mem TRUE to ignore the memory saving mode
+     */
+    virtual void getMemoryComponents(MemoryComponents &mem, size_t ncategory = 1, bool full_mem = false);
+
     /**
      * compute the memory size for top partitions required for storing partial likelihood vectors
      * @return memory size required in bytes
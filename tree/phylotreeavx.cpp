@@ -29,8 +29,7 @@
 void PhyloTree::setParsimonyKernelAVX() {
     if (cost_matrix) {
         // Sankoff kernel
-        computeParsimonyBranchPointer = &PhyloTree::computeParsimonyBranchSankoffSIMD<Vec8ui>;
-        computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoffSIMD<Vec8ui>;
+        setParsimonyKernelSankoffSIMD<Vec8ui>();
         return;
     }
     // Fitch kernel
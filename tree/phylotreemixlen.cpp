@@ -447,6 +447,8 @@ void PhyloTreeMixlen::optimizeOneBranch(PhyloNode *node1, PhyloNode *node2, bool
 
             // E-step
             // decoupled weights (prop) from _pattern_lh_cat to obtain L_ci and compute pattern likelihood L_i
+            size_t weight_stride = get_safe_upper_limit(nptn);
+            class_ptn_weights.assign(weight_stride*nmix, 0.0);
             for (size_t ptn = 0; ptn < nptn; ptn++) {
                 double *this_lk_cat = _pattern_lh_cat + ptn*nmix;
                 double lk_ptn = ptn_invar[ptn];
@@ -455,37 +457,15 @@ void PhyloTreeMixlen::optimizeOneBranch(PhyloNode *node1, PhyloNode *node2, bool
                 }
                 ASSERT(lk_ptn != 0.0);
                 lk_ptn = ptn_freq[ptn] / lk_ptn;
-                // transform _pattern_lh_cat into posterior probabilities of each category
+                // posterior weights of each category, stored category by category for the kernel
                 for (size_t c = 0; c < nmix; c++) {
-                    this_lk_cat[c] *= lk_ptn;
+                    class_ptn_weights[c*weight_stride + ptn] = this_lk_cat[c] * lk_ptn;
                 }
                 
             } 
          
-            double negative_lh;
-            double optx;
             theta_computed = false;
-            computePtnFreq();
-            
-            for (cur_mixture = 0; cur_mixture < mixlen; cur_mixture++) {
-                double *this_lk_cat = _pattern_lh_cat+cur_mixture;
-                for (size_t ptn = 0; ptn < nptn; ptn++) {
-                    ptn_freq[ptn] = this_lk_cat[ptn*nmix];
-                }                
-                double current_len = current_it->getLength(cur_mixture);
-                ASSERT(current_len >= 0.0);
-                // Newton-Raphson method
-                optx = minimizeNewton(params->min_branch_length, current_len, params->max_branch_length, params->min_branch_length, negative_lh, maxNRStep);
-
-                current_it->setLength(cur_mixture, optx);
-                current_it_back->setLength(cur_mixture, optx);
-            
-            }
-            
-            cur_mixture = -1;
-            // reset ptn_freq
-            ptn_freq_computed = false;
-            computePtnFreq();
+            optimizeMixlenNewton(maxNRStep);
         } // for EM_step
     }
 
@@ -731,164 +711,86 @@ void PhyloTreeMixlen::clear_relative_treelen() {
     relative_treelen.clear();
 }
 
-// defining log-likelihood derivative function for EM algorithm
-void PhyloTreeMixlen::computeFuncDerv(double value, double &df, double &ddf) {
-
-    if (cur_mixture < 0)
-        return PhyloTree::computeFuncDerv(value, df, ddf);
-
-    current_it->setLength(cur_mixture, value);
-    current_it_back->setLength(cur_mixture, value);
-
-    (this->*computeLikelihoodDervMixlenPointer)(current_it, (PhyloNode*) current_it_back->node, df, ddf);
-
-	df = -df;
-    ddf = -ddf;
-    return;
+void PhyloTreeMixlen::optimizeMixlenNewton(int maxNRStep) {
+    double xacc = params->min_branch_length;
+    double x1 = params->min_branch_length, x2 = params->max_branch_length;
+    double f[mixlen], df[mixlen], rts[mixlen], rts_old[mixlen], xl[mixlen], xh[mixlen];
+    bool active[mixlen];
+    int i, num_active = 0;
 
-
-    PhyloNeighbor* dad_branch = current_it;
-    PhyloNode *dad = (PhyloNode*) current_it_back->node;
-
-    PhyloNode *node = (PhyloNode*) dad_branch->node;
-    PhyloNeighbor *node_branch = (PhyloNeighbor*) node->findNeighbor(dad);
-    if (!central_partial_lh)
-        initializeAllPartialLh();
-    if (node->isLeaf()) {
-    	PhyloNode *tmp_node = dad;
-    	dad = node;
-    	node = tmp_node;
-    	PhyloNeighbor *tmp_nei = dad_branch;
-    	dad_branch = node_branch;
-    	node_branch = tmp_nei;
-    }
-    
-    ASSERT((dad_branch->partial_lh_computed & 1) || node->isLeaf());
-    ASSERT((node_branch->partial_lh_computed & 1) || dad->isLeaf());
-
-    size_t nstates = aln->num_states;
-    size_t ncat = site_rate->getNRate();
-    size_t nmixture = model->getNMixtures();
-
-    size_t block = ncat * nstates * nmixture;
-    size_t statemix = nstates * nmixture;
-    size_t statecat = nstates * ncat;
-    size_t orig_nptn = aln->size();
-    size_t nptn = aln->size()+model_factory->unobserved_ptns.size();
-    size_t maxptn = get_safe_upper_limit(nptn);
-    double *eval = model->getEigenvalues();
-    ASSERT(eval);
-
-	ASSERT(theta_all);
-	if (!theta_computed) {
-		// precompute theta for fast branch length optimization
-
-	    if (dad->isLeaf()) {
-	    	// special treatment for TIP-INTERNAL NODE case
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-            for (size_t ptn = 0; ptn < nptn; ptn++) {
-                double *partial_lh_dad = dad_branch->partial_lh + ptn*block;
-                double *theta = theta_all + ptn*block;
-                
-                // TODO: check with vectorclass!
-                double *lh_tip = tip_partial_lh +
-                ((int)((ptn < orig_nptn) ? (aln->at(ptn))[dad->id] :  model_factory->unobserved_ptns[ptn-orig_nptn][dad->id]))*statemix;
-                for (size_t m = 0; m < nmixture; m++) {
-                    for (size_t i = 0; i < statecat; i++) {
-                        theta[m*statecat+i] = lh_tip[m*nstates + i%nstates] * partial_lh_dad[m*statecat+i];
-                    }
-                }
-            }
-			// ascertainment bias correction
-	    } else {
-	    	// both dad and node are internal nodes
-		    double *partial_lh_node = node_branch->partial_lh;
-		    double *partial_lh_dad = dad_branch->partial_lh;
-
-            size_t all_entries = nptn*block;
-#ifdef _OPENMP
-#pragma omp parallel for
-#endif
-            for (size_t i = 0; i < all_entries; i++) {
-                theta_all[i] = partial_lh_node[i] * partial_lh_dad[i];
-            }
-        }
-        if (nptn < maxptn) {
-            // copy dummy values
-            for (size_t ptn = nptn; ptn < maxptn; ptn++)
-                memcpy(&theta_all[ptn*block], &theta_all[(ptn-1)*block], block*sizeof(double));
-        }
-        theta_computed = true;
+    // the same safeguarded Newton-Raphson as minimizeNewton, run for all classes in lockstep
+    for (i = 0; i < mixlen; i++) {
+        rts[i] = max(x1, min(x2, current_it->getLength(i)));
+        current_it->setLength(i, rts[i]);
+        current_it_back->setLength(i, rts[i]);
+        active[i] = true;
     }
-
-    double *val0 = new double[statecat];
-    double *val1 = new double[statecat];
-    double *val2 = new double[statecat];
-    for (size_t c = 0; c < ncat; c++) {
-        double prop = site_rate->getProp(c);
-        for (size_t i = 0; i < nstates; i++) {
-            double cof = eval[cur_mixture*nstates+i]*site_rate->getRate(c);
-            // length for heterotachy model
-            double val = exp(cof*dad_branch->getLength(cur_mixture)) * prop * model->getMixtureWeight(cur_mixture);
-            double val1_ = cof*val;
-            val0[(c)*nstates+i] = val;
-            val1[(c)*nstates+i] = val1_;
-            val2[(c)*nstates+i] = cof*val1_;
+    computeMixlenDerv(active, f, df);
+    for (i = 0; i < mixlen; i++) {
+        active[i] = !(df[i] >= 0.0 && fabs(f[i]) < xacc);
+        if (!active[i])
+            continue;
+        num_active++;
+        if (f[i] < 0.0) {
+            xl[i] = rts[i];
+            xh[i] = x2;
+        } else {
+            xh[i] = rts[i];
+            xl[i] = x1;
         }
     }
 
-    double my_df = 0.0, my_ddf = 0.0, prob_const = 0.0, df_const = 0.0, ddf_const = 0.0;
-
-#ifdef _OPENMP
-#pragma omp parallel for reduction(+:my_df,my_ddf,prob_const,df_const,ddf_const)
-#endif
-    for (size_t ptn = 0; ptn < nptn; ptn++) {
-        double lh_ptn = ptn_invar[ptn], df_ptn = 0.0, ddf_ptn = 0.0;
-        double *theta = theta_all + ptn*block + cur_mixture*statecat;
-        for (size_t i = 0; i < statecat; i++) {
-            lh_ptn += val0[i] * theta[i];
-            df_ptn += val1[i] * theta[i];
-            ddf_ptn += val2[i] * theta[i];
+    for (int step = 1; step <= maxNRStep && num_active > 0; step++) {
+        for (i = 0; i < mixlen; i++) {
+            if (!active[i])
+                continue;
+            rts_old[i] = rts[i];
+            double dx;
+            if (df[i] <= 0.0 || (((rts[i]-xh[i])*df[i]-f[i])*((rts[i]-xl[i])*df[i]-f[i]) >= 0.0)) {
+                // concave or out of bound: bisection
+                dx = 0.5*(xh[i]-xl[i]);
+                rts[i] = xl[i]+dx;
+                if (xl[i] == rts[i])
+                    active[i] = false;
+            } else {
+                dx = f[i]/df[i];
+                rts[i] -= dx;
+                if (rts[i] == rts_old[i])
+                    active[i] = false;
+            }
+            if (active[i] && (fabs(dx) < xacc || step == maxNRStep)) {
+                rts[i] = rts_old[i];
+                active[i] = false;
+            }
+            if (!active[i])
+                num_active--;
+            current_it->setLength(i, rts[i]);
+            current_it_back->setLength(i, rts[i]);
         }
-        lh_ptn = fabs(lh_ptn);
-        if (ptn < orig_nptn) {
-            double df_frac = df_ptn / lh_ptn;
-            double ddf_frac = ddf_ptn / lh_ptn;
-            double freq = ptn_freq[ptn];
-            double tmp1 = df_frac * freq;
-            double tmp2 = ddf_frac * freq;
-            my_df += tmp1;
-            my_ddf += tmp2 - tmp1 * df_frac;
-        } else {
-            // ascertainment bias correction
-            prob_const += lh_ptn;
-            df_const += df_ptn;
-            ddf_const += ddf_ptn;
+        if (num_active == 0)
+            break;
+        // classes are independent in the M-step, finished ones are skipped
+        computeMixlenDerv(active, f, df);
+        for (i = 0; i < mixlen; i++) {
+            if (!active[i])
+                continue;
+            if (df[i] > 0.0 && fabs(f[i]) < xacc) {
+                active[i] = false;
+                num_active--;
+            } else if (f[i] < 0.0)
+                xl[i] = rts[i];
+            else if (f[i] > 0.0)
+                xh[i] = rts[i];
         }
     }
-    df = my_df;
-    ddf = my_ddf;
-    if (std::isnan(df) || std::isinf(df)) {
-        df = 0.0;
-        ddf = 0.0;
-    }
-    if (orig_nptn < nptn) {
-        // ascertainment bias correction
-        prob_const = 1.0 - prob_const;
-        double df_frac = df_const / prob_const;
-        double ddf_frac = ddf_const / prob_const;
-        size_t nsites = aln->getNSite();
-        df += nsites * df_frac;
-        ddf += nsites *(ddf_frac + df_frac*df_frac);
-    }
-
-    delete [] val2;
-    delete [] val1;
-    delete [] val0;
+}
 
-    df = -df;
-    ddf = -ddf;
+void PhyloTreeMixlen::computeMixlenDerv(bool *active, double *df, double *ddf) {
+    (this->*computeLikelihoodDervMixlenPointer)(current_it, (PhyloNode*) current_it_back->node, class_ptn_weights.data(), active, df, ddf);
+    for (int i = 0; i < mixlen; i++)
+        if (active[i]) {
+            df[i] = -df[i];
+            ddf[i] = -ddf[i];
+        }
 }
 
@@ -183,15 +183,19 @@ public:
 	virtual void computeFuncDervMulti(double *value, double *df, double *ddf);
 
     /**
-            Inherited from Optimization class.
-            This function calculate f(value), first derivative f'(value) and 2nd derivative f''(value).
-            used by Newton raphson method to minimize the function.
-            @param value current branch length
-            @param df (OUT) first derivative
-            @param ddf (OUT) second derivative
-            @return negative of likelihood (for minimization)
-     */
-    virtual void computeFuncDerv(double value, double &df, double &ddf);
+        M-step of the EM algorithm for the current branch: optimize the lengths of all classes
+        together by Newton-Raphson, the derivatives of all classes come from one kernel pass
+        @param maxNRStep maximum number of Newton-Raphson steps
+    */
+    void optimizeMixlenNewton(int maxNRStep);
+
+    /**
+        derivatives of the negative M-step objective of the classes at the current branch lengths
+        @param active classes to compute
+        @param df (OUT) first derivative of each class
+        @param ddf (OUT) second derivative of each class
+    */
+    void computeMixlenDerv(bool *active, double *df, double *ddf);
 
 	/**
 		return the number of dimensions
@@ -274,6 +278,9 @@ protected:
     /** relative rate, used to initialize branch lengths */
     DoubleVector relative_treelen;
 
+    /** EM posterior weights of patterns, category by category, for the M-step kernel */
+    DoubleVector class_ptn_weights;
+
     /** true if during initialization phase */
     bool initializing_mixlen;
 
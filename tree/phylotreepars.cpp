@@ -67,9 +67,8 @@ void PhyloTree::computePartialParsimonyFast(PhyloNeighbor *dad_branch, PhyloNode
             switch ((*alnit)->seq_type) {
             case SEQ_DNA:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 4) {
                         for (int j = 0; j < freq; j++, site++) {
                             dad_branch->partial_pars[(site/UINT_BITS)*nstates+state] |= (1 << (site % UINT_BITS));
@@ -102,9 +101,8 @@ void PhyloTree::computePartialParsimonyFast(PhyloNeighbor *dad_branch, PhyloNode
                 break;
             case SEQ_PROTEIN:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (state < 20) {
                         for (int j = 0; j < freq; j++, site++) {
                             dad_branch->partial_pars[(site/UINT_BITS)*nstates+state] |= (1 << (site % UINT_BITS));
@@ -134,9 +132,8 @@ void PhyloTree::computePartialParsimonyFast(PhyloNeighbor *dad_branch, PhyloNode
                 break;
             default:
                 for (int patid = start_pos; patid != end_pos; patid++) {
-                    Alignment::iterator pat = aln->ordered_pattern.begin()+ patid;
-                    int state = pat->at(leafid);
-                    int freq = pat->frequency;
+                    int state = aln->getOrderedTipState(leafid, patid);
+                    int freq = aln->ordered_pattern[patid].frequency;
                     if (aln->seq_type == SEQ_POMO && state >= (*alnit)->num_states && state < (*alnit)->STATE_UNKNOWN) {
                         state = (*alnit)->convertPomoState(state);
                     }
@@ -688,7 +685,7 @@ void PhyloTree::computePartialParsimonySankoff(PhyloNeighbor *dad_branch, PhyloN
             FOR_NEIGHBOR_IT(node, dad, it) if ((*it)->node->name != ROOT_NAME) {
                 if ((*it)->node->isLeaf()) {
                     // leaf node
-                    UINT *partial_pars_child_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][(*it)->node->id]*nstates];
+                    UINT *partial_pars_child_ptr = &tip_partial_pars[aln->getOrderedTipState((*it)->node->id, ptn)*nstates];
                 
                     for(i = 0; i < nstates; i++){
                         partial_pars_ptr[i] += partial_pars_child_ptr[i];
@@ -718,8 +715,8 @@ void PhyloTree::computePartialParsimonySankoff(PhyloNeighbor *dad_branch, PhyloN
             //if (aln->at(ptn).isConst()) continue;
             int ptn_start_index = ptn*nstates;
             
-            UINT *left_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][left->node->id]*nstates];
-            UINT *right_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][right->node->id]*nstates];
+            UINT *left_ptr = &tip_partial_pars[aln->getOrderedTipState(left->node->id, ptn)*nstates];
+            UINT *right_ptr = &tip_partial_pars[aln->getOrderedTipState(right->node->id, ptn)*nstates];
             UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
             
             for (i = 0; i < nstates; i++){
@@ -734,7 +731,7 @@ void PhyloTree::computePartialParsimonySankoff(PhyloNeighbor *dad_branch, PhyloN
             //if (aln->at(ptn).isConst()) continue;
             int ptn_start_index = ptn*nstates;
             
-            UINT *left_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][left->node->id]*nstates];
+            UINT *left_ptr = &tip_partial_pars[aln->getOrderedTipState(left->node->id, ptn)*nstates];
             UINT *right_ptr = &right->partial_pars[ptn_start_index];
             UINT *partial_pars_ptr = &partial_pars[ptn_start_index];
             UINT *cost_matrix_ptr = cost_matrix;
@@ -831,7 +828,7 @@ int PhyloTree::computeParsimonyBranchSankoff(PhyloNeighbor *dad_branch, PhyloNod
         // external node
         for (ptn = 0; ptn < aln->ordered_pattern.size(); ptn++){
             int ptn_start_index = ptn * nstates;
-            UINT *node_branch_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][dad->id]*nstates];
+            UINT *node_branch_ptr = &tip_partial_pars[aln->getOrderedTipState(dad->id, ptn)*nstates];
             UINT *dad_branch_ptr = &dad_branch->partial_pars[ptn_start_index];
             UINT min_ptn_pars = node_branch_ptr[0] + dad_branch_ptr[0];
             UINT br_ptn_pars = node_branch_ptr[0];
@@ -893,6 +890,9 @@ int PhyloTree::computeParsimonyBranchSankoff(PhyloNeighbor *dad_branch, PhyloNod
  */
 UINT PhyloTree::computeParsimonyOutOfTreeSankoff(UINT* ptn_scores) {
 
+    if (computeParsimonyOutOfTreePointer)
+        return (this->*computeParsimonyOutOfTreePointer)(ptn_scores);
+
     PhyloNeighbor *dad_branch = (PhyloNeighbor*) root->neighbors[0];
     PhyloNode *dad = (PhyloNode*) root;
     int *branch_subst = NULL;
@@ -905,6 +905,9 @@ UINT PhyloTree::computeParsimonyOutOfTreeSankoff(UINT* ptn_scores) {
 
     if (!central_partial_pars)
         initializeAllPartialPars();
+    // weights come from ptn_freq_pars as in the SIMD kernel
+    if ((tip_partial_lh_computed & 2) == 0)
+        computeTipPartialParsimony();
     
     // swap node and dad if dad is a leaf
     if (node->isLeaf()) {
@@ -930,7 +933,7 @@ UINT PhyloTree::computeParsimonyOutOfTreeSankoff(UINT* ptn_scores) {
         // external node
         for (ptn = 0; ptn < aln->ordered_pattern.size(); ptn++){
             int ptn_start_index = ptn * nstates;
-            UINT *node_branch_ptr = &tip_partial_pars[aln->ordered_pattern[ptn][dad->id]*nstates];
+            UINT *node_branch_ptr = &tip_partial_pars[aln->getOrderedTipState(dad->id, ptn)*nstates];
             UINT *dad_branch_ptr = &dad_branch->partial_pars[ptn_start_index];
             UINT min_ptn_pars = node_branch_ptr[0] + dad_branch_ptr[0];
             UINT br_ptn_pars = node_branch_ptr[0];
@@ -943,7 +946,7 @@ UINT PhyloTree::computeParsimonyOutOfTreeSankoff(UINT* ptn_scores) {
                 }
             }
             ptn_scores[ptn] = min_ptn_pars;
-            tree_pars += min_ptn_pars * aln->ordered_pattern[ptn].frequency;
+            tree_pars += min_ptn_pars * ptn_freq_pars[ptn];
         }
     }  else {
         // internal node
@@ -974,7 +977,7 @@ UINT PhyloTree::computeParsimonyOutOfTreeSankoff(UINT* ptn_scores) {
                 cost_matrix_ptr += nstates;
             }
             ptn_scores[ptn] = min_ptn_pars;
-            tree_pars += min_ptn_pars * aln->ordered_pattern[ptn].frequency;
+            tree_pars += min_ptn_pars * ptn_freq_pars[ptn];
         }
     }
     return tree_pars;
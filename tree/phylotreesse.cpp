@@ -41,6 +41,8 @@
 //#define USING_SSE
 
 #define PACKETS_PER_THREAD 2
+/* number of packets with --deterministic, independent of the number of threads */
+#define DETERMINISTIC_PACKETS 64
 void PhyloTree::setNumThreads(int threadCount) {
     if (!isSuperTree() && aln!=nullptr && threadCount > 1 && threadCount > aln->getNPattern()/8) {
         outWarning(convertIntToString(threadCount) + " threads for alignment length " +
@@ -49,10 +51,13 @@ void PhyloTree::setNumThreads(int threadCount) {
     }
     this->num_threads = threadCount;
     this->num_packets = (num_threads==1) ? 1 : (num_threads*PACKETS_PER_THREAD);
+    if (Params::getInstance().deterministic_reduction)
+        this->num_packets = DETERMINISTIC_PACKETS;
 }
 
 void PhyloTree::setParsimonyKernel(LikelihoodKernel lk) {
     
+    computeParsimonyOutOfTreePointer = NULL;
     if (cost_matrix) {
         // Sankoff parsimony kernel
         if (lk < LK_SSE2) {
@@ -60,6 +65,12 @@ void PhyloTree::setParsimonyKernel(LikelihoodKernel lk) {
             computePartialParsimonyPointer = &PhyloTree::computePartialParsimonySankoff;
             return;
         }
+#ifdef __AVX512KNL
+        if (lk >= LK_AVX512) {
+            setParsimonyKernelAVX512();
+            return;
+        }
+#endif
         if (lk >= LK_AVX) {
             setParsimonyKernelAVX();
             return;
@@ -77,6 +88,12 @@ void PhyloTree::setParsimonyKernel(LikelihoodKernel lk) {
         computePartialParsimonyPointer = &PhyloTree::computePartialParsimonyFast;
     	return;
     }
+#ifdef __AVX512KNL
+    if (lk >= LK_AVX512) {
+        setParsimonyKernelAVX512();
+        return;
+    }
+#endif
     if (lk >= LK_AVX) {
         setParsimonyKernelAVX();
         return;
@@ -540,8 +557,13 @@ void PhyloTree::computePtnFreq() {
 	size_t nptn = aln->getNPattern();
 	size_t maxptn = get_safe_upper_limit(nptn)+get_safe_upper_limit(model_factory->unobserved_ptns.size());
 	int ptn;
-	for (ptn = 0; ptn < nptn; ptn++)
-		ptn_freq[ptn] = (*aln)[ptn].frequency;
+	if (ptn_freq_weights) {
+		for (ptn = 0; ptn < nptn; ptn++)
+			ptn_freq[ptn] = ptn_freq_weights[ptn];
+	} else {
+		for (ptn = 0; ptn < nptn; ptn++)
+			ptn_freq[ptn] = (*aln)[ptn].frequency;
+	}
 	for (ptn = nptn; ptn < maxptn; ptn++)
 		ptn_freq[ptn] = 0.0;
 }
@@ -1683,223 +1705,179 @@ void PhyloTree::computeMarginalAncestralProbability(PhyloNeighbor *dad_branch, P
 }
 */
 
+/** number of patterns reconstructed together by one thread in computeJointAncestralSequences */
+const size_t JOINT_ASR_PATTERN_BLOCK = 64;
+
 void PhyloTree::computeJointAncestralSequences(int *ancestral_seqs) {
 
-    // step 1-3 of the dynamic programming algorithm of Pupko et al. 2000, MBE 17:890-896
+    // dynamic programming algorithm of Pupko et al. 2000, MBE 17:890-896,
+    // done for each rate/mixture category, every pattern takes the category with
+    // the highest joint likelihood of ancestral states and category
     ASSERT(root->isLeaf());
-    int *C = new int[(size_t)getAlnNPattern()*model->num_states*leafNum];
-    computeAncestralLikelihood((PhyloNeighbor*)root->neighbors[0], NULL, C);
-    
-    // step 4-5 of the dynamic programming algorithm of Pupko et al. 2000, MBE 17:890-896
-    computeAncestralState((PhyloNeighbor*)root->neighbors[0], NULL, C, ancestral_seqs);
-    
-    clearAllPartialLH();
-    
-    delete[] C;
-}
-
-void PhyloTree::computeAncestralLikelihood(PhyloNeighbor *dad_branch, PhyloNode *dad, int *C) {
-    PhyloNode *node = (PhyloNode*)dad_branch->node;
-    if (node->isLeaf())
-        return;
-    
-    int num_leaves = 0;
-    
-    // recursive into subtree
-    FOR_NEIGHBOR_DECLARE(node, dad, it) {
-        if ((*it)->node->isLeaf()) {
-            num_leaves++;
-        } else {
-            computeAncestralLikelihood((PhyloNeighbor*)(*it), node, C);
-        }
-    }
-
-    // TODO mem save
-    if (params->lh_mem_save == LM_PER_NODE && !dad_branch->partial_lh) {
-        // re-orient partial_lh
-        bool done = false;
-        FOR_NEIGHBOR_IT(node, dad, it2) {
-            PhyloNeighbor *backnei = ((PhyloNeighbor*)(*it2)->node->findNeighbor(node));
-            if (backnei->partial_lh) {
-                dad_branch->partial_lh = backnei->partial_lh;
-                dad_branch->scale_num = backnei->scale_num;
-                backnei->partial_lh = NULL;
-                backnei->scale_num = NULL;
-                backnei->partial_lh_computed &= ~1; // clear bit
-                done = true;
-                break;
-            }
-        }
-        ASSERT(done && "partial_lh is not re-oriented");
-    }
-    
     size_t nptn = aln->getNPattern();
-    size_t nstates = model->num_states;
+    size_t nseq = aln->getNSeq();
+    size_t nstates = aln->num_states;
     size_t nstatesqr = nstates*nstates;
-    size_t parent, child;
-    double *trans_mat = new double[nstatesqr];
-    double *lh_leaves = NULL;
-    if (num_leaves > 0) {
-        lh_leaves = new double[(aln->STATE_UNKNOWN+1)*nstates*num_leaves];
+    size_t nleafstates = aln->STATE_UNKNOWN+1;
+    size_t ncat = site_rate->getNRate();
+    size_t nmixture = model->getNMixtures();
+    size_t ncat_mix = (model_factory->fused_mix_rate) ? ncat : ncat*nmixture;
+    size_t denom = (model_factory->fused_mix_rate) ? 1 : ncat;
+    size_t ninternal = nodeNum - leafNum;
+
+    // internal nodes in pre-order, starting from the neighbor of the root leaf
+    PhyloNode *top = (PhyloNode*)root->neighbors[0]->node;
+    vector<PhyloNode*> pre_order(1, top), node_dad(nodeNum, NULL);
+    for (size_t i = 0; i < pre_order.size(); i++) {
+        PhyloNode *node = pre_order[i];
+        FOR_NEIGHBOR_IT(node, node_dad[node->id], it)
+            if (!(*it)->node->isLeaf()) {
+                node_dad[(*it)->node->id] = node;
+                pre_order.push_back((PhyloNode*)(*it)->node);
+            }
     }
-    if (dad) {
-        model->computeTransMatrix(dad_branch->length, trans_mat);
-        for (parent = 0; parent < nstatesqr; parent++)
-            trans_mat[parent] = log(trans_mat[parent]);
-    } else {
-        model->getStateFrequency(trans_mat);
-        for (parent = 0; parent < nstates; parent++)
-            trans_mat[parent] = log(trans_mat[parent]);
-        for (parent = 1; parent < nstates; parent++)
-            memcpy(trans_mat+parent*nstates, trans_mat, sizeof(double)*nstates);
+    ASSERT(pre_order.size() == ninternal);
+
+    // log transition tables of the branch above every node except top:
+    // [parent state][child state] for internal nodes, [leaf state][parent state] for leaves
+    size_t table_rows = max(nstates, nleafstates);
+    size_t table_size = ncat_mix*table_rows*nstates;
+    DoubleVector log_trans(nodeNum*table_size, 0.0);
+    DoubleVector log_freq(ncat_mix*nstates), log_prop(ncat_mix);
+    double trans_mat[nstatesqr], state_app[nstates];
+    for (size_t c = 0; c < ncat_mix; c++) {
+        size_t m = c/denom;
+        size_t mycat = c%ncat;
+        log_prop[c] = log(site_rate->getProp(mycat) * model->getMixtureWeight(m));
+        model->getStateFrequency(&log_freq[c*nstates], m);
+        for (size_t x = 0; x < nstates; x++)
+            log_freq[c*nstates+x] = log(log_freq[c*nstates+x]);
     }
-    
-    // compute information buffer for leaves
-	int ambi_aa[] = {
-        4+8, // B = N or D
-        32+64, // Z = Q or E
-        512+1024 // U = I or L
-    };
-    int leafid = 0; 
-    FOR_NEIGHBOR(node, dad, it) {
-        if ((*it)->node->isLeaf()) {
-            double trans_leaf[nstatesqr];
-            model->computeTransMatrix((*it)->length, trans_leaf);
-            double *lh_leaf = lh_leaves+leafid*nstates*(aln->STATE_UNKNOWN+1);
-            
-            // assign lh_leaf for normal states
-            for (parent = 0; parent < nstates; parent++)
-                for (child = 0; child < nstates; child++)
-                    lh_leaf[child*nstates+parent] = log(trans_leaf[parent*nstates+child]);
-            
-            // for unknown state
-            double *this_lh_leaf = lh_leaf + (aln->STATE_UNKNOWN*nstates);
-            for (parent = 0; parent < nstates; parent++)
-                this_lh_leaf[parent] = 0.0;
-            
-            // special treatment for ambiguous characters
-            switch (aln->seq_type) {
-            case SEQ_DNA:
-                for (int state = 4; state < 18; state++) {
-                    this_lh_leaf = lh_leaf + (state*nstates);
-                    int cstate = state-nstates+1;
-                    for (parent = 0; parent < nstates; parent++) {
-                        double sumlh = 0.0;
-                        for (child = 0; child < nstates; child++) {
-                            if ((cstate) & (1 << child))
-                                sumlh += trans_leaf[parent*nstates+child];
-                        }
-                        this_lh_leaf[parent] = log(sumlh);
-                    }
+    for (PhyloNode *node : pre_order) {
+        FOR_NEIGHBOR_IT(node, node_dad[node->id], it) {
+            PhyloNeighbor *nei = (PhyloNeighbor*)(*it);
+            bool is_leaf = nei->node->isLeaf();
+            for (size_t c = 0; c < ncat_mix; c++) {
+                size_t mycat = c%ncat;
+                double *table = &log_trans[nei->node->id*table_size + c*table_rows*nstates];
+                model->computeTransMatrix(nei->getLength(mycat)*site_rate->getRate(mycat), trans_mat, c/denom);
+                if (!is_leaf) {
+                    for (size_t i = 0; i < nstatesqr; i++)
+                        table[i] = log(trans_mat[i]);
+                    continue;
                 }
-                break;
-            case SEQ_PROTEIN:
-                for (int state = 0; state < sizeof(ambi_aa)/sizeof(int); state++) {
-                    this_lh_leaf = lh_leaf + ((state+20)*nstates);
-                    for (parent = 0; parent < nstates; parent++) {
-                        double sumlh = 0.0;                
-                        for (child = 0; child < nstates; child++) {
-                            if (ambi_aa[state] & (1 << child))
-                                sumlh += trans_leaf[parent*nstates+child];
-                        }
-                        this_lh_leaf[parent] = log(sumlh);
+                for (size_t state = 0; state < nleafstates; state++) {
+                    aln->getAppearance(state, state_app);
+                    for (size_t parent = 0; parent < nstates; parent++) {
+                        double lh = 0.0;
+                        for (size_t child = 0; child < nstates; child++)
+                            lh += trans_mat[parent*nstates+child] * state_app[child];
+                        table[state*nstates+parent] = log(lh);
                     }
                 }
-                break;
-            default:
-                break;
             }
-            leafid++;
         }
     }
 
-    // initialize L_y(i) and C_y(i)
-//    memset(dad_branch->partial_lh, 0, nptn*nstates*sizeof(double));
+    // invariable sites keep the constant state at all nodes
+    double p_invar = site_rate->getPInvar();
+    DoubleVector state_freq(nstates);
+    model->getStateFrequency(state_freq.data(), -1);
 
-    int *C_node = C + (node->id-leafNum)*nptn*nstates;
-
-    for (size_t ptn = 0; ptn < nptn; ptn++) {
-        double *lh_dad = dad_branch->partial_lh+ptn*nstates;
-        int *this_C_node = C_node + (ptn*nstates);
-        leafid = 0;
-        double sumlh[nstates];
-        memset(sumlh, 0, sizeof(double)*nstates);
-        FOR_NEIGHBOR(node, dad, it) {
-            PhyloNeighbor *childnei = (PhyloNeighbor*)(*it);
-            if ((*it)->node->isLeaf()) {
-                double *lh_leaf = lh_leaves+leafid*nstates*(aln->STATE_UNKNOWN+1); 
-                // external node
-                int state_child;
-                state_child = (aln->at(ptn))[(*it)->node->id];
-                double *child_lh = lh_leaf + state_child*nstates;
-                for (child = 0; child < nstates; child++)
-                    sumlh[child] += child_lh[child];
-                leafid++;
-            } else {
-                double *child_lh = childnei->partial_lh + ptn*nstates;
-                for (child = 0; child < nstates; child++)
-                    sumlh[child] += child_lh[child];
-            }
-        }
-        
-        
-        if (dad) {
-            // internal node
-            for (parent = 0; parent < nstates; parent++) {
-                lh_dad[parent] = trans_mat[parent*nstates] + sumlh[0];
-                this_C_node[parent] = 0;
-                for (child = 1; child < nstates; child++) {
-                    double lh = trans_mat[parent*nstates+child] + sumlh[child];
-                    if (lh > lh_dad[parent]) {
-                        lh_dad[parent] = lh;
-                        this_C_node[parent] = child;
+    size_t nblock = (nptn + JOINT_ASR_PATTERN_BLOCK - 1) / JOINT_ASR_PATTERN_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(max(num_threads, 1)) if (nblock > 1)
+#endif
+    {
+        size_t B = JOINT_ASR_PATTERN_BLOCK;
+        // best log-likelihood of the subtree below each internal node given the state of its dad,
+        // and the state of the node attaining it
+        DoubleVector node_lh(ninternal*B*nstates);
+        vector<int> node_state(ninternal*B*nstates);
+        DoubleVector best_lh(B), sumlh(nstates);
+        vector<int> block_seqs(ninternal*B), top_state(B);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (size_t b = 0; b < nblock; b++) {
+            size_t ptn_start = b*B;
+            size_t nblock_ptn = min(B, nptn-ptn_start);
+            for (size_t c = 0; c < ncat_mix; c++) {
+                // step 1-3: post-order traversal
+                for (auto it = pre_order.rbegin(); it != pre_order.rend(); it++) {
+                    PhyloNode *node = *it, *dad = node_dad[node->id];
+                    size_t idx = node->id-leafNum;
+                    for (size_t i = 0; i < nblock_ptn; i++) {
+                        Pattern &pat = aln->at(ptn_start+i);
+                        for (size_t x = 0; x < nstates; x++)
+                            sumlh[x] = 0.0;
+                        FOR_NEIGHBOR_DECLARE(node, dad, nit) {
+                            Node *child = (*nit)->node;
+                            if (child->isLeaf()) {
+                                int state = (child->id < nseq) ? pat[child->id] : aln->STATE_UNKNOWN;
+                                double *child_lh = &log_trans[child->id*table_size + (c*table_rows+state)*nstates];
+                                for (size_t x = 0; x < nstates; x++)
+                                    sumlh[x] += child_lh[x];
+                            } else {
+                                double *child_lh = &node_lh[((child->id-leafNum)*B+i)*nstates];
+                                for (size_t x = 0; x < nstates; x++)
+                                    sumlh[x] += child_lh[x];
+                            }
+                        }
+                        if (node == top) {
+                            double *freq = &log_freq[c*nstates];
+                            double lh = freq[0] + sumlh[0];
+                            int best = 0;
+                            for (size_t x = 1; x < nstates; x++)
+                                if (freq[x] + sumlh[x] > lh) {
+                                    lh = freq[x] + sumlh[x];
+                                    best = x;
+                                }
+                            lh += log_prop[c];
+                            if (c == 0 || lh > best_lh[i]) {
+                                best_lh[i] = lh;
+                                top_state[i] = best;
+                            } else
+                                top_state[i] = -1;
+                            continue;
+                        }
+                        double *trans = &log_trans[node->id*table_size + c*table_rows*nstates];
+                        double *lh_dad = &node_lh[(idx*B+i)*nstates];
+                        int *state_dad = &node_state[(idx*B+i)*nstates];
+                        for (size_t parent = 0; parent < nstates; parent++) {
+                            double *trans_parent = trans + parent*nstates;
+                            lh_dad[parent] = trans_parent[0] + sumlh[0];
+                            state_dad[parent] = 0;
+                            for (size_t x = 1; x < nstates; x++)
+                                if (trans_parent[x] + sumlh[x] > lh_dad[parent]) {
+                                    lh_dad[parent] = trans_parent[x] + sumlh[x];
+                                    state_dad[parent] = x;
+                                }
+                        }
                     }
                 }
-            }
-        } else {
-            // at the root
-            lh_dad[0] = trans_mat[0] + sumlh[0];
-            this_C_node[0] = 0;
-            for (parent = 1; parent < nstates; parent++) {
-                double lh = trans_mat[parent] + sumlh[parent];
-                if (lh > lh_dad[0]) {
-                    lh_dad[0] = lh;
-                    this_C_node[0] = parent;
+                // step 4-5: pre-order traversal for the patterns where this category is the best so far
+                for (size_t i = 0; i < nblock_ptn; i++) {
+                    if (top_state[i] < 0)
+                        continue;
+                    block_seqs[(top->id-leafNum)*B+i] = top_state[i];
+                    for (size_t j = 1; j < ninternal; j++) {
+                        PhyloNode *node = pre_order[j];
+                        size_t idx = node->id-leafNum;
+                        int dad_state = block_seqs[(node_dad[node->id]->id-leafNum)*B+i];
+                        block_seqs[idx*B+i] = node_state[(idx*B+i)*nstates+dad_state];
+                    }
                 }
             }
+            for (size_t i = 0; i < nblock_ptn; i++) {
+                Pattern &pat = aln->at(ptn_start+i);
+                bool invar = p_invar > 0.0 && pat.const_char < nstates &&
+                    log(p_invar*state_freq[pat.const_char]) > best_lh[i];
+                for (size_t idx = 0; idx < ninternal; idx++)
+                    ancestral_seqs[idx*nptn+ptn_start+i] = invar ? pat.const_char : block_seqs[idx*B+i];
+            }
         }
     }
-    
-
-    if (lh_leaves)
-        delete[] lh_leaves;
-    delete[] trans_mat;
-}
-
-
-void PhyloTree::computeAncestralState(PhyloNeighbor *dad_branch, PhyloNode *dad, int *C, int *ancestral_seqs) {
-    PhyloNode *node = (PhyloNode*)dad_branch->node;
-    if (node->isLeaf())
-        return;
-
-    size_t nptn = aln->getNPattern();
-    size_t nstates = model->num_states;
-
-    int *C_node = C + (node->id-leafNum)*nptn*nstates;
-    int *ancestral_seqs_node = ancestral_seqs + (node->id-leafNum)*nptn; 
-    if (dad) {
-        // at an internal node
-        int *ancestral_seqs_dad = ancestral_seqs + (dad->id-leafNum)*nptn;
-        for (size_t ptn = 0; ptn < nptn; ptn++)
-            ancestral_seqs_node[ptn] = C_node[ptn*nstates+ancestral_seqs_dad[ptn]];
-        
-    } else {
-        // at the root
-        for (size_t ptn = 0; ptn < nptn; ptn++)
-            ancestral_seqs_node[ptn] = C_node[ptn*nstates];
-    }
-    FOR_NEIGHBOR_IT(node, dad, it)
-        computeAncestralState((PhyloNeighbor*)(*it), node, C, ancestral_seqs);
 }
 
 
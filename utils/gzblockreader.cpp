@@ -0,0 +1,362 @@
+//
+//  gzblockreader.cpp
+//  utils
+//
+
+#include "gzblockreader.h"
+#include <zlib.h>
+#include <string.h>
+#include <ios>
+#include <deque>
+
+#ifdef _OPENMP
+#include <omp.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+using namespace std;
+
+/** BGZF blocks hold at most 64KB, headers are at least 18 bytes */
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_MIN_BLOCK_SIZE 26
+
+/** blocks inflated per thread and per call of nextChunk */
+#define BGZF_BLOCKS_PER_THREAD 32
+
+/** uncompressed size of one chunk of the pipelined reader */
+#define GZ_PIPELINE_CHUNK (1L << 20)
+
+/** number of inflated chunks the producer may run ahead */
+#define GZ_PIPELINE_DEPTH 4
+
+static inline uint32_t readLE16(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static inline uint32_t readLE32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t readLE64(const unsigned char *p) {
+    return (uint64_t)readLE32(p) | ((uint64_t)readLE32(p+4) << 32);
+}
+
+/**
+    find the BSIZE field in a BGZF header
+    @return total block size, or 0 if this is not a BGZF header
+*/
+static size_t getBgzfBlockSize(const unsigned char *header, size_t len) {
+    if (len < 18 || header[0] != 31 || header[1] != 139 || header[2] != 8 || !(header[3] & 4))
+        return 0;
+    size_t xlen = readLE16(header+10);
+    if (12 + xlen > len)
+        return 0;
+    const unsigned char *extra = header + 12;
+    for (size_t pos = 0; pos + 4 <= xlen; ) {
+        size_t slen = readLE16(extra+pos+2);
+        if (extra[pos] == 'B' && extra[pos+1] == 'C' && slen == 2 && pos + 6 <= xlen)
+            return readLE16(extra+pos+4) + 1;
+        pos += 4 + slen;
+    }
+    return 0;
+}
+
+GzBlockReader *GzBlockReader::create(const char *name, size_t file_length) {
+    FILE *fp = fopen(name, "rb");
+    if (!fp)
+        return nullptr;
+    unsigned char header[18];
+    size_t len = fread(header, 1, sizeof(header), fp);
+    if (BgzfBlockReader::isBgzfHeader(header, len)) {
+        rewind(fp);
+        try {
+            return new BgzfBlockReader(fp, name, file_length);
+        } catch (ios_base::failure &) {
+            // broken block chain: let gzread deal with (and report) it
+            fclose(fp);
+            return nullptr;
+        }
+    }
+    fclose(fp);
+#ifdef _OPENMP
+    // plain text and small files are not worth a second thread
+    if (len < 2 || header[0] != 31 || header[1] != 139 || file_length < GZ_PIPELINE_MIN_SIZE)
+        return nullptr;
+    GzPipelineReader *reader = new GzPipelineReader(name);
+    if (reader->isOpen())
+        return reader;
+    delete reader;
+#endif
+    return nullptr;
+}
+
+// --------------------------------------
+// class BgzfBlockReader
+// --------------------------------------
+
+bool BgzfBlockReader::isBgzfHeader(const unsigned char *header, size_t len) {
+    return getBgzfBlockSize(header, len) > 0;
+}
+
+BgzfBlockReader::BgzfBlockReader(FILE *fp, const char *name, size_t file_length) {
+    this->fp = fp;
+    next_block = 0;
+    compressed_position = 0;
+    if (!readIndexFile(name, file_length)) {
+        blocks.clear();
+        scanBlocks(0, file_length);
+    }
+}
+
+BgzfBlockReader::~BgzfBlockReader() {
+    if (fp)
+        fclose(fp);
+}
+
+bool BgzfBlockReader::readIndexFile(const char *name, size_t file_length) {
+    string index_name = string(name) + ".gzi";
+    FILE *idx = fopen(index_name.c_str(), "rb");
+    if (!idx)
+        return false;
+    unsigned char buf[16];
+    bool ok = (fread(buf, 1, 8, idx) == 8);
+    uint64_t num_entries = ok ? readLE64(buf) : 0;
+    // the index omits the first block at offset 0
+    vector<uint64_t> offsets;
+    offsets.push_back(0);
+    for (uint64_t i = 0; ok && i < num_entries; i++) {
+        ok = (fread(buf, 1, 16, idx) == 16);
+        if (ok)
+            offsets.push_back(readLE64(buf));
+    }
+    fclose(idx);
+    if (!ok)
+        return false;
+    blocks.clear();
+    for (size_t i = 0; i < offsets.size(); i++) {
+        // every indexed offset must hold a block header whose BSIZE reaches the next offset,
+        // otherwise the index is stale (e.g. file was recompressed): fall back to scanning
+        size_t block_size = readBlockSize(offsets[i], file_length);
+        if (block_size == 0 || (i+1 < offsets.size() && offsets[i+1] != offsets[i] + block_size)) {
+            blocks.clear();
+            return false;
+        }
+        if (i+1 < offsets.size())
+            blocks.push_back({offsets[i], (uint32_t)block_size});
+    }
+    // the last indexed block is followed by unindexed ones (at least the EOF marker)
+    scanBlocks(offsets.back(), file_length);
+    return true;
+}
+
+size_t BgzfBlockReader::readBlockSize(uint64_t offset, size_t file_length) {
+    unsigned char header[BGZF_MIN_BLOCK_SIZE];
+    if (offset >= file_length || fseeko(fp, offset, SEEK_SET) != 0)
+        return 0;
+    size_t len = fread(header, 1, 18, fp);
+    size_t block_size = getBgzfBlockSize(header, len);
+    if (block_size < BGZF_MIN_BLOCK_SIZE || offset + block_size > file_length)
+        return 0;
+    return block_size;
+}
+
+void BgzfBlockReader::scanBlocks(uint64_t offset, size_t file_length) {
+    while (offset < file_length) {
+        size_t block_size = readBlockSize(offset, file_length);
+        if (block_size == 0)
+            throw ios_base::failure("Corrupt BGZF block header");
+        blocks.push_back({offset, (uint32_t)block_size});
+        offset += block_size;
+    }
+    rewind(fp);
+}
+
+/**
+    inflate one BGZF block into out
+    @return number of uncompressed bytes, or -1 on error
+*/
+static int inflateBgzfBlock(const unsigned char *block, size_t block_size, char *out) {
+    size_t header_size = 12 + readLE16(block+10);
+    if (header_size + 8 > block_size)
+        return -1;
+    uint32_t crc = readLE32(block + block_size - 8);
+    uint32_t isize = readLE32(block + block_size - 4);
+    if (isize > BGZF_MAX_BLOCK_SIZE)
+        return -1;
+    if (isize == 0)
+        return 0;
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -15) != Z_OK)
+        return -1;
+    strm.next_in = (Bytef*)(block + header_size);
+    strm.avail_in = (uInt)(block_size - header_size - 8);
+    strm.next_out = (Bytef*)out;
+    strm.avail_out = isize;
+    int ret = inflate(&strm, Z_FINISH);
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END || strm.total_out != isize)
+        return -1;
+    if (crc32(crc32(0L, Z_NULL, 0), (const Bytef*)out, isize) != crc)
+        return -1;
+    return (int)isize;
+}
+
+bool BgzfBlockReader::nextChunk(vector<char> &chunk) {
+    if (next_block >= blocks.size())
+        return false;
+    size_t num_threads = 1;
+#ifdef _OPENMP
+    num_threads = omp_get_max_threads();
+#endif
+    size_t first = next_block;
+    size_t last = min(blocks.size(), first + num_threads * BGZF_BLOCKS_PER_THREAD);
+
+    // blocks are contiguous in the file, so one read covers the whole batch
+    uint64_t start = blocks[first].coffset;
+    uint64_t end = blocks[last-1].coffset + blocks[last-1].csize;
+    compressed.resize(end - start);
+    if (fseeko(fp, start, SEEK_SET) != 0 || fread(compressed.data(), 1, end - start, fp) != end - start)
+        throw ios_base::failure("Cannot read BGZF block");
+
+    // ISIZE in each trailer gives the output offset of every block up front
+    vector<size_t> out_offset(last - first + 1);
+    out_offset[0] = GZ_PUTBACK;
+    for (size_t i = first; i < last; i++) {
+        const unsigned char *block = compressed.data() + (blocks[i].coffset - start);
+        if (getBgzfBlockSize(block, blocks[i].csize) != blocks[i].csize)
+            throw ios_base::failure("Corrupt BGZF block header");
+        out_offset[i-first+1] = out_offset[i-first] + readLE32(block + blocks[i].csize - 4);
+    }
+    chunk.resize(out_offset.back());
+
+    int num_errors = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:num_errors) if(last - first > 1)
+#endif
+    for (int64_t i = first; i < (int64_t)last; i++) {
+        const unsigned char *block = compressed.data() + (blocks[i].coffset - start);
+        int size = inflateBgzfBlock(block, blocks[i].csize, chunk.data() + out_offset[i-first]);
+        if (size < 0 || (size_t)size != out_offset[i-first+1] - out_offset[i-first])
+            num_errors++;
+    }
+    if (num_errors)
+        throw ios_base::failure("Corrupt BGZF block");
+
+    next_block = last;
+    compressed_position = end;
+    // an empty batch (e.g. only the EOF marker block) is not the end of the stream unless nothing is left
+    if (chunk.size() == GZ_PUTBACK)
+        return nextChunk(chunk);
+    return true;
+}
+
+size_t BgzfBlockReader::getCompressedPosition() {
+    return compressed_position;
+}
+
+// --------------------------------------
+// class GzPipelineReader
+// --------------------------------------
+
+#ifdef _OPENMP
+
+struct GzPipelineReader::Impl {
+    gzFile file;
+    thread producer;
+    mutex lock;
+    condition_variable cond;
+    /** inflated chunks with the compressed offset reached after each */
+    deque<pair<vector<char>, size_t> > queue;
+    bool finished;
+    bool failed;
+    bool stopped;
+
+    void produce() {
+        while (true) {
+            vector<char> chunk(GZ_PUTBACK + GZ_PIPELINE_CHUNK);
+            int num = gzread(file, chunk.data() + GZ_PUTBACK, GZ_PIPELINE_CHUNK);
+            size_t position = gzoffset(file);
+            unique_lock<mutex> guard(lock);
+            if (num <= 0) {
+                int errnum;
+                gzerror(file, &errnum);
+                failed = (num < 0 || (errnum != Z_OK && errnum != Z_BUF_ERROR));
+                finished = true;
+                cond.notify_all();
+                return;
+            }
+            chunk.resize(GZ_PUTBACK + num);
+            cond.wait(guard, [this] { return stopped || queue.size() < GZ_PIPELINE_DEPTH; });
+            if (stopped)
+                return;
+            queue.emplace_back(std::move(chunk), position);
+            cond.notify_all();
+        }
+    }
+};
+
+GzPipelineReader::GzPipelineReader(const char *name) {
+    impl = new Impl;
+    impl->finished = impl->failed = impl->stopped = false;
+    compressed_position = 0;
+    impl->file = gzopen(name, "rb");
+    opened = (impl->file != 0);
+    if (opened) {
+        gzbuffer(impl->file, 1 << 17);
+        impl->producer = thread(&Impl::produce, impl);
+    }
+}
+
+GzPipelineReader::~GzPipelineReader() {
+    if (opened) {
+        {
+            lock_guard<mutex> guard(impl->lock);
+            impl->stopped = true;
+        }
+        impl->cond.notify_all();
+        impl->producer.join();
+        gzclose(impl->file);
+    }
+    delete impl;
+}
+
+bool GzPipelineReader::nextChunk(vector<char> &chunk) {
+    unique_lock<mutex> guard(impl->lock);
+    impl->cond.wait(guard, [this] { return impl->finished || !impl->queue.empty(); });
+    if (impl->queue.empty()) {
+        if (impl->failed)
+            throw ios_base::failure("Cannot decompress gzip stream");
+        return false;
+    }
+    chunk.swap(impl->queue.front().first);
+    compressed_position = impl->queue.front().second;
+    impl->queue.pop_front();
+    impl->cond.notify_all();
+    return true;
+}
+
+#else
+
+struct GzPipelineReader::Impl {};
+
+GzPipelineReader::GzPipelineReader(const char *name) {
+    impl = nullptr;
+    opened = false;
+    compressed_position = 0;
+}
+
+GzPipelineReader::~GzPipelineReader() {
+}
+
+bool GzPipelineReader::nextChunk(vector<char> &chunk) {
+    return false;
+}
+
+#endif
+
+size_t GzPipelineReader::getCompressedPosition() {
+    return compressed_position;
+}
@@ -0,0 +1,106 @@
+//
+//  gzblockreader.h
+//  utils
+//
+//  Chunked readers that sit behind igzstream for large compressed inputs:
+//  BGZF files (as written by bgzip) are inflated block-parallel using the
+//  block index, ordinary gzip files are inflated by a producer thread while
+//  the caller parses the previous chunk.
+//
+
+#ifndef gzblockreader_h
+#define gzblockreader_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** number of bytes kept free at the front of every chunk for stream putback */
+#define GZ_PUTBACK 4
+
+/** compressed files below this size are read through plain gzread */
+#define GZ_PIPELINE_MIN_SIZE (1L << 20)
+
+class GzBlockReader {
+public:
+    virtual ~GzBlockReader() {}
+
+    /**
+        inflate the next piece of the file
+        @param chunk (OUT) resized to GZ_PUTBACK + n, uncompressed bytes start at GZ_PUTBACK
+        @return false at end of file
+        @throw std::ios_base::failure on corrupt input
+    */
+    virtual bool nextChunk(std::vector<char> &chunk) = 0;
+
+    /** @return offset in the compressed file that has been consumed so far */
+    virtual size_t getCompressedPosition() = 0;
+
+    /**
+        inspect the header of a file and pick a suitable reader
+        @param name file name
+        @param file_length length of the (compressed) file
+        @return a BGZF or pipelined reader, or nullptr if gzread should be used directly
+    */
+    static GzBlockReader *create(const char *name, size_t file_length);
+};
+
+/** one BGZF block as recorded in the index */
+struct BgzfBlock {
+    uint64_t coffset;  // offset of the block in the compressed file
+    uint32_t csize;    // size of the whole block including header and trailer
+};
+
+/**
+    BGZF reader: blocks are independent deflate streams of at most 64KB
+    uncompressed, so a batch of them can be inflated concurrently.
+*/
+class BgzfBlockReader : public GzBlockReader {
+public:
+    BgzfBlockReader(FILE *fp, const char *name, size_t file_length);
+    virtual ~BgzfBlockReader();
+    virtual bool nextChunk(std::vector<char> &chunk);
+    virtual size_t getCompressedPosition();
+
+    /** @return true if the buffer holds a gzip member header with the BGZF 'BC' extra field */
+    static bool isBgzfHeader(const unsigned char *header, size_t len);
+
+protected:
+    /** load block offsets from <name>.gzi (bgzip -i), @return false if absent or unusable */
+    bool readIndexFile(const char *name, size_t file_length);
+
+    /** @return size of the block whose header starts at offset, 0 if there is no valid block header */
+    size_t readBlockSize(uint64_t offset, size_t file_length);
+
+    /** append block offsets from offset onwards by walking the BSIZE field of every block header */
+    void scanBlocks(uint64_t offset, size_t file_length);
+
+    FILE *fp;
+    std::vector<BgzfBlock> blocks;
+    size_t next_block;
+    size_t compressed_position;
+    std::vector<unsigned char> compressed;
+};
+
+/**
+    pipelined reader for ordinary gzip: one thread runs gzread ahead of
+    the consumer into a bounded queue of chunks.
+*/
+class GzPipelineReader : public GzBlockReader {
+public:
+    GzPipelineReader(const char *name);
+    virtual ~GzPipelineReader();
+    virtual bool nextChunk(std::vector<char> &chunk);
+    virtual size_t getCompressedPosition();
+
+    bool isOpen() { return opened; }
+
+protected:
+    struct Impl;
+    Impl *impl;
+    bool opened;
+    size_t compressed_position;
+};
+
+#endif /* gzblockreader_h */
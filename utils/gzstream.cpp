@@ -82,6 +82,17 @@ gzstreambuf* gzstreambuf::open( const char* name, int open_mode, int compression
         }
     }
     //FINISH - Determining compressed_length
+
+    // BGZF or large gzip inputs are inflated in parallel/in the background
+    if ( mode & std::ios::in) {
+        raw_position = 0;
+        block_reader = GzBlockReader::create(name, compressed_length);
+        if (block_reader) {
+            file = 0;
+            opened = 1;
+            return this;
+        }
+    }
     
     file = gzopen( name, fmode);
     if (file == 0) {
@@ -100,6 +111,12 @@ gzstreambuf * gzstreambuf::close() {
     if ( is_open()) {
         sync();
         opened = 0;
+        if (block_reader) {
+            delete block_reader;
+            block_reader = nullptr;
+            std::vector<char>().swap(chunk);
+            return this;
+        }
         if ( gzclose( file) == Z_OK)
             return this;
     }
@@ -112,6 +129,8 @@ int gzstreambuf::underflow() { // used for input buffer only
 
     if ( ! (mode & std::ios::in) || ! opened)
         return EOF;
+    if (block_reader)
+        return underflow_chunk();
     // Josuttis' implementation of inbuf
     long n_putback = gptr() - eback();
     if ( n_putback > 4)
@@ -133,6 +152,27 @@ int gzstreambuf::underflow() { // used for input buffer only
     return * reinterpret_cast<unsigned char *>( gptr());    
 }
 
+int gzstreambuf::underflow_chunk() {
+    // keep up to GZ_PUTBACK characters of the previous chunk for putback
+    long n_putback = gptr() - eback();
+    if ( n_putback > GZ_PUTBACK)
+        n_putback = GZ_PUTBACK;
+    char putback[GZ_PUTBACK];
+    memcpy( putback, gptr() - n_putback, n_putback);
+
+    // corrupt input throws ios_base::failure, which sets badbit on the stream
+    if ( ! block_reader->nextChunk(chunk))
+        return EOF;
+    memcpy( chunk.data() + (GZ_PUTBACK - n_putback), putback, n_putback);
+    compressed_position = block_reader->getCompressedPosition();
+    raw_position += chunk.size() - GZ_PUTBACK;
+
+    setg( chunk.data() + (GZ_PUTBACK - n_putback),
+          chunk.data() + GZ_PUTBACK,
+          chunk.data() + chunk.size());
+    return * reinterpret_cast<unsigned char *>( gptr());
+}
+
 int gzstreambuf::flush_buffer() {
     // Separate the writing of the buffer from overflow() and
     // sync() operation.
@@ -175,6 +215,12 @@ size_t gzstreambuf::getCompressedPosition() {
     return compressed_position;
 }
 
+z_off_t gzstreambuf::getRawPosition() {
+    if (block_reader)
+        return raw_position;
+    return gztell(file);
+}
+
 
 // --------------------------------------
 // class gzstreambase:
@@ -201,7 +247,7 @@ void gzstreambase::close() {
 }
 
 z_off_t gzstreambase::get_raw_bytes() {
-	return gztell(buf.file);
+	return buf.getRawPosition();
 }
 
 #ifdef GZSTREAM_NAMESPACE
@@ -34,6 +34,8 @@
 #include <fstream>
 //#include "zlib-1.2.7/zlib.h"
 #include <zlib.h>
+#include <vector>
+#include "gzblockreader.h"
 
 #define GZ_NO_COMPRESSION (1L << 11)
 
@@ -58,10 +60,16 @@ private:
 
     size_t           compressed_length;
     size_t           compressed_position; //only tracked for read (input) streams
+
+    GzBlockReader   *block_reader;       // parallel/pipelined inflater for large inputs
+    std::vector<char> chunk;             // data buffer of block_reader
+    z_off_t          raw_position;       // uncompressed bytes delivered by block_reader
     
     int flush_buffer();
+    int underflow_chunk();
 public:
-    gzstreambuf() : opened(0), compressed_length(0), compressed_position(0) {
+    gzstreambuf() : opened(0), compressed_length(0), compressed_position(0),
+        block_reader(nullptr), raw_position(0) {
         setp( buffer, buffer + (bufferSize-1));
         setg( buffer + 4,     // beginning of putback area
               buffer + 4,     // read position
@@ -79,6 +87,7 @@ public:
 
     size_t getCompressedLength();
     size_t getCompressedPosition();
+    z_off_t getRawPosition();
 };
 
 class gzstreambase : virtual public std::ios {
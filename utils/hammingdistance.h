@@ -24,6 +24,7 @@
 #define HAMMING_VECTOR (1)
 #define VECTOR_MAD     (0)
 #include <vectorclass/vectorclass.h> //For Vec32c and Vec32cb classes
+#include <stdint.h>
 
 //
 //Note 1: L is a template parameter so that, when the state range
@@ -117,5 +118,38 @@ inline double hammingDistance
 }
 #endif
 
+/** largest number of states for which bit-sliced pair counting beats a scan over the columns */
+#define PAIR_COUNT_BITSLICE_STATES 8
+
+//
+//Counts the state pairs of two sequences stored bit-sliced: for each
+//state a vector of numWords 64-bit words with bit i set if column i
+//holds that state. pairCount (numStates*numStates, row = state of
+//sequence A) is incremented, not cleared.
+//Note: used by the symmetry tests, which count sites. hammingDistance
+//      above works on frequency-weighted patterns instead; a popcount
+//      counts each column once, so it would need the patterns expanded
+//      back to sites (and the constant sites put back) to give the
+//      same distances.
+//
+inline void countStatePairs
+        ( const uint64_t* sequenceA, const uint64_t* sequenceB
+         , int numStates, size_t numWords, double* pairCount ) {
+    for (int stateA = 0; stateA < numStates; ++stateA) {
+        const uint64_t* a = sequenceA + stateA*numWords;
+        for (int stateB = 0; stateB < numStates; ++stateB) {
+            const uint64_t* b = sequenceB + stateB*numWords;
+            uint64_t count = 0;
+            for (size_t w = 0; w < numWords; ++w) {
+                uint64_t both = a[w] & b[w];
+                //vml_popcnt (vectorclass) works on 32 bits, but
+                //falls back to plain C where popcnt is unavailable
+                count += vml_popcnt(static_cast<uint32_t>(both))
+                       + vml_popcnt(static_cast<uint32_t>(both >> 32));
+            }
+            pairCount[stateA*numStates+stateB] += count;
+        }
+    }
+}
 
 #endif /* hammingdistance_h */
@@ -21,6 +21,12 @@
 #include "timeutil.h"
 #include "MPIHelper.h"
 
+/** maximal fraction of recent iterations changing the candidate set for convergence */
+#define CONV_MAX_TURNOVER 0.1
+
+/** minimal fraction of stable splits among candidate trees for convergence */
+#define CONV_MIN_SPLIT_STABILITY 0.95
+
 StopRule::StopRule() : CheckpointFactory()
 {
 //	nTime_ = 0;
@@ -37,6 +43,9 @@ StopRule::StopRule() : CheckpointFactory()
 	max_run_time = -1.0;
 	curIteration = 0;
     should_stop = false;
+    min_gain_rate = 0.0;
+    conv_window = 20;
+    split_stability = -1.0;
 }
 
 void StopRule::initialize(Params &params) {
@@ -49,6 +58,8 @@ void StopRule::initialize(Params &params) {
 	step_iteration = params.step_iterations;
 	start_real_time = getRealTime();
 	max_run_time = params.maxtime * 60; // maxtime is in minutes
+	min_gain_rate = params.stop_gain_rate;
+	conv_window = max(10, unsuccess_iteration/5);
 }
 
 void StopRule::getUFBootCountCheck(int &ufboot_count, int &ufboot_count_check) {
@@ -68,6 +79,12 @@ void StopRule::saveCheckpoint() {
     CKP_SAVE(curIteration);
     CKP_SAVE(start_real_time);
     CKP_VECTOR_SAVE(time_vec);
+    if (isConvergenceMonitored() && !conv_cpu_time.empty()) {
+        CKP_VECTOR_SAVE(conv_cpu_time);
+        CKP_VECTOR_SAVE(conv_best_score);
+        CKP_VECTOR_SAVE(conv_changed);
+        CKP_SAVE(split_stability);
+    }
     checkpoint->endStruct();
     CheckpointFactory::saveCheckpoint();
 }
@@ -78,6 +95,16 @@ void StopRule::restoreCheckpoint() {
     CKP_RESTORE(curIteration);
     CKP_RESTORE(start_real_time);
     CKP_VECTOR_RESTORE(time_vec);
+    // restored whenever saved: initialize(), which switches the monitor on, runs after the restore
+    if (CKP_VECTOR_RESTORE(conv_cpu_time) && !conv_cpu_time.empty()) {
+        CKP_VECTOR_RESTORE(conv_best_score);
+        CKP_VECTOR_RESTORE(conv_changed);
+        CKP_RESTORE(split_stability);
+        // CPU time starts from zero again in the restarted process
+        double offset = getCPUTime() * MPIHelper::getInstance().getNumProcesses() - conv_cpu_time.back();
+        for (auto &t : conv_cpu_time)
+            t += offset;
+    }
     checkpoint->endStruct();
 }
 
@@ -115,6 +142,8 @@ bool StopRule::meetStopCondition(int cur_iteration, double cur_correlation) {
 	if (should_stop) {
 		return true;
 	}
+	if (isConvergenceMonitored() && hasConverged(cur_iteration, cur_correlation))
+		return true;
 	switch (stop_condition) {
 		case SC_FIXED_ITERATION:
 			return cur_iteration >= min_iteration;
@@ -134,6 +163,55 @@ bool StopRule::meetStopCondition(int cur_iteration, double cur_correlation) {
 	return false;
 }
 
+void StopRule::updateConvergence(double best_score, bool candidate_changed, double split_stability) {
+    // CPU time of this process covers all its threads; processes are assumed to run alike
+    conv_cpu_time.push_back(getCPUTime() * MPIHelper::getInstance().getNumProcesses());
+    conv_best_score.push_back(best_score);
+    conv_changed.push_back(candidate_changed);
+    if (split_stability >= 0.0)
+        this->split_stability = split_stability;
+    if (conv_cpu_time.size() > conv_window) {
+        conv_cpu_time.erase(conv_cpu_time.begin());
+        conv_best_score.erase(conv_best_score.begin());
+        conv_changed.erase(conv_changed.begin());
+    }
+}
+
+double StopRule::getGainRate() {
+    if (conv_cpu_time.size() < conv_window)
+        return -1.0;
+    double cpu_hours = (conv_cpu_time.back() - conv_cpu_time.front()) / 3600.0;
+    if (cpu_hours <= 0.0)
+        return -1.0;
+    return (conv_best_score.back() - conv_best_score.front()) / cpu_hours;
+}
+
+bool StopRule::hasConverged(int cur_iteration, double cur_correlation) {
+    // the window must be filled; min_iteration is not waited for, it is only the usual budget
+    double gain_rate = getGainRate();
+    if (gain_rate < 0.0 || gain_rate >= min_gain_rate)
+        return false;
+    // candidate set still taking in new topologies: search is exploring
+    int num_changed = 0;
+    for (int changed : conv_changed)
+        num_changed += changed;
+    if (num_changed > conv_changed.size() * CONV_MAX_TURNOVER)
+        return false;
+    if (split_stability >= 0.0 && split_stability < CONV_MIN_SPLIT_STABILITY)
+        return false;
+    if (stop_condition == SC_BOOTSTRAP_CORRELATION && !meetCorrelation(cur_correlation))
+        return false;
+    if (!should_stop) {
+        cout << "NOTE: Search converged with log-likelihood gain " << gain_rate << " per CPU-hour (--stop-gain "
+             << min_gain_rate << ")";
+        if (split_stability >= 0.0)
+            cout << ", " << split_stability * 100 << "% stable splits";
+        cout << endl;
+        should_stop = true;
+    }
+    return true;
+}
+
 double StopRule::getRemainingTime(int cur_iteration) {
 	double realtime_secs = getRealTime() - start_real_time;
 	int niterations;
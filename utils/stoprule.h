@@ -114,6 +114,32 @@ public:
         should_stop = true;
     }
 
+    /**
+        record the outcome of one search iteration for the convergence monitor (--stop-gain)
+        @param best_score best log-likelihood in the candidate set (gathered from all threads/processes)
+        @param candidate_changed TRUE if the iteration brought a new topology into the candidate set
+        @param split_stability fraction of stable splits among the candidate trees, -1 if not computed
+    */
+    void updateConvergence(double best_score, bool candidate_changed, double split_stability);
+
+    /**
+        @return log-likelihood improvement per CPU-hour over the recent window of iterations,
+        or -1 if there are not enough iterations yet
+    */
+    double getGainRate();
+
+    /**
+        combine gain rate, candidate set turnover, split stability and UFBoot correlation
+        @param cur_correlation current bootstrap correlation coefficient
+        @return TRUE if further search is not expected to pay off
+    */
+    bool hasConverged(int cur_iteration, double cur_correlation);
+
+    /** @return TRUE if the convergence monitor is switched on */
+    bool isConvergenceMonitored() {
+        return min_gain_rate > 0.0;
+    }
+
 private:
 
     /**
@@ -166,6 +192,24 @@ private:
     /** TRUE to override stop condition */
     bool should_stop;
 
+    /** stop if the log-likelihood gain per CPU-hour drops below this value, 0 to switch off */
+    double min_gain_rate;
+
+    /** number of recent iterations the convergence monitor looks at */
+    int conv_window;
+
+    /** CPU time (all threads and processes) at each of the recent iterations */
+    DoubleVector conv_cpu_time;
+
+    /** best log-likelihood at each of the recent iterations */
+    DoubleVector conv_best_score;
+
+    /** 1 if the candidate set changed at each of the recent iterations, 0 otherwise */
+    IntVector conv_changed;
+
+    /** last computed fraction of stable splits, -1 if unknown */
+    double split_stability;
+
 	/* FOLLOWING CODES ARE FROM IQPNNI version 3 */	
 
 //	int nTime_;
@@ -291,6 +291,25 @@ __inline uint64_t getMemorySize( )
 }
 
 
+/**
+ * @return peak resident memory (RSS) of this process in bytes, 0 if unknown
+ */
+__inline uint64_t getPeakMemoryUsage() {
+#ifdef HAVE_GETRUSAGE
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__) && defined(__MACH__)
+	return (uint64_t)usage.ru_maxrss;
+#else
+	/* kilobytes on Linux and BSD */
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
+
 #define HOW_LONG(x) \
 { std::cout.precision(6); double startTime = getRealTime(); \
 x; \
@@ -39,6 +39,10 @@
 #endif
 #include <thread>
 
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#endif
 
 #if defined(Backtrace_FOUND)
 #include <execinfo.h>
@@ -1186,6 +1190,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.gurobi_format = true;
     params.gurobi_threads = 1;
     params.num_bootstrap_samples = 0;
+    params.num_bootstrap_jobs = 1;
     params.bootstrap_spec = NULL;
     params.transfer_bootstrap = 0;
 
@@ -1250,6 +1255,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.stop_condition = SC_UNSUCCESS_ITERATION;
     params.stop_confidence = 0.95;
     params.num_runs = 1;
+    params.num_run_jobs = 1;
     params.model_name = "";
     params.contain_nonrev = false;
     params.model_name_init = NULL;
@@ -1433,6 +1439,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.snni = true; // turn on sNNI default now
 //    params.autostop = true; // turn on auto stopping rule by default now
     params.unsuccess_iteration = 100;
+    params.stop_gain_rate = 0.0;
     params.speednni = true; // turn on reduced hill-climbing NNI by default now
     params.numInitTrees = 100;
     params.fixStableSplits = false;
@@ -1453,6 +1460,9 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.tree_freq_file = NULL;
     params.num_threads = 1;
     params.num_threads_max = 10000;
+    params.numa_placement = false;
+    params.lh_huge_pages = false;
+    params.deterministic_reduction = false;
     params.openmp_by_model = false;
     params.model_test_criterion = MTC_BIC;
 //    params.model_test_stop_rule = MTC_ALL;
@@ -1479,6 +1489,7 @@ void parseArg(int argc, char *argv[], Params &params) {
     params.print_splits_file = false;
     params.print_splits_nex_file = true;
     params.ignore_identical_seqs = true;
+    params.remove_near_identical_seqs = false;
     params.write_init_tree = false;
     params.write_candidate_trees = false;
     params.write_branches = false;
@@ -2069,6 +2080,10 @@ void parseArg(int argc, char *argv[], Params &params) {
             if (strcmp(argv[cnt], "--keep-ident") == 0 || strcmp(argv[cnt], "-keep-ident") == 0) {
                 params.ignore_identical_seqs = false;
                 continue;
+            }
+            if (strcmp(argv[cnt], "--near-ident") == 0) {
+                params.remove_near_identical_seqs = true;
+                continue;
             }
 			if (strcmp(argv[cnt], "-rcsg") == 0) {
 				cnt++;
@@ -3960,6 +3975,15 @@ void parseArg(int argc, char *argv[], Params &params) {
                 if (params.num_runs < 1)
                     throw "Positive --runs please";
                 continue;
+            }
+            if (strcmp(argv[cnt], "--run-jobs") == 0) {
+                cnt++;
+                if (cnt >= argc)
+                    throw "Use --run-jobs <number_of_runs>";
+                params.num_run_jobs = convert_int(argv[cnt]);
+                if (params.num_run_jobs < 1)
+                    throw "Positive --run-jobs please";
+                continue;
             }
 			if (strcmp(argv[cnt], "-gurobi") == 0) {
 				params.gurobi_format = true;
@@ -3997,6 +4021,15 @@ void parseArg(int argc, char *argv[], Params &params) {
 					params.consensus_type = CT_NONE;
 				continue;
 			}
+			if (strcmp(argv[cnt], "--boot-jobs") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use --boot-jobs <num_replicates>";
+				params.num_bootstrap_jobs = convert_int(argv[cnt]);
+				if (params.num_bootstrap_jobs < 1)
+					throw "Number of concurrent bootstrap replicates must be positive";
+				continue;
+			}
 			if (strcmp(argv[cnt], "--bsam") == 0 || strcmp(argv[cnt], "-bsam") == 0 || strcmp(argv[cnt], "--sampling") == 0) {
 				cnt++;
 				if (cnt >= argc)
@@ -4247,7 +4280,7 @@ void parseArg(int argc, char *argv[], Params &params) {
                 continue;
             }
 
-			if (strcmp(argv[cnt], "-asr-joint") == 0) {
+			if (strcmp(argv[cnt], "-asr-joint") == 0 || strcmp(argv[cnt], "--asr-joint") == 0) {
 				params.print_ancestral_sequence = AST_JOINT;
                 params.ignore_identical_seqs = false;
 				continue;
@@ -4898,6 +4931,15 @@ void parseArg(int argc, char *argv[], Params &params) {
                 params.max_iterations = max(params.max_iterations, params.unsuccess_iteration*10);
 				continue;
 			}
+			if (strcmp(argv[cnt], "--stop-gain") == 0) {
+				cnt++;
+				if (cnt >= argc)
+					throw "Use --stop-gain <log-likelihood gain per CPU-hour>";
+				params.stop_gain_rate = convert_double(argv[cnt]);
+				if (params.stop_gain_rate <= 0)
+					throw "--stop-gain must be positive";
+				continue;
+			}
 			if (strcmp(argv[cnt], "-lsbran") == 0) {
 				params.leastSquareBranch = true;
 				continue;
@@ -5088,6 +5130,21 @@ void parseArg(int argc, char *argv[], Params &params) {
                     throw "At least 1 thread please";
                 continue;
             }
+
+            if (strcmp(argv[cnt], "--numa") == 0) {
+                params.numa_placement = true;
+                continue;
+            }
+
+            if (strcmp(argv[cnt], "--huge-pages") == 0) {
+                params.lh_huge_pages = true;
+                continue;
+            }
+
+            if (strcmp(argv[cnt], "--deterministic") == 0) {
+                params.deterministic_reduction = true;
+                continue;
+            }
             
             if (strcmp(argv[cnt], "--thread-model") == 0) {
                 params.openmp_by_model = true;
@@ -6296,6 +6353,7 @@ void usage_iqtree(char* argv[], bool full_command) {
     << "  --safe               Safe likelihood kernel to avoid numerical underflow" << endl
     << "  --mem NUM[G|M|%]     Maximal RAM usage in GB | MB | %" << endl
     << "  --runs NUM           Number of indepedent runs (default: 1)" << endl
+    << "  --run-jobs NUM       Independent runs done at the same time (default: 1)" << endl
     << "  -v, --verbose        Verbose mode, printing more messages to screen" << endl
     << "  -V, --version        Display version number" << endl
     << "  --quiet              Quiet mode, suppress printing to screen (stdout)" << endl
@@ -6304,7 +6362,10 @@ void usage_iqtree(char* argv[], bool full_command) {
 #ifdef _OPENMP
     << "  -T NUM|AUTO          No. cores/threads or AUTO-detect (default: 1)" << endl
     << "  --threads-max NUM    Max number of threads for -T AUTO (default: all cores)" << endl
+    << "  --numa               Pin threads, place likelihood vectors per NUMA node" << endl
+    << "  --deterministic      Same likelihoods for any number of threads" << endl
 #endif
+    << "  --huge-pages         Use huge pages for likelihood vectors (Linux)" << endl
     << endl << "CHECKPOINT:" << endl
     << "  --redo               Redo both ModelFinder and tree search" << endl
     << "  --redo-tree          Restore ModelFinder and only redo tree search" << endl
@@ -6329,6 +6390,8 @@ void usage_iqtree(char* argv[], bool full_command) {
     << "  --nbest NUM          Number of best trees retained during search (default: 5)" << endl
     << "  -n NUM               Fix number of iterations to stop (default: OFF)" << endl
     << "  --nstop NUM          Number of unsuccessful iterations to stop (default: 100)" << endl
+    << "  --stop-gain NUM      Also stop once log-likelihood gain per CPU-hour < NUM" << endl
+    << "                       and candidate trees/splits are stable" << endl
     << "  --perturb NUM        Perturbation strength for randomized NNI (default: 0.5)" << endl
     << "  --radius NUM         Radius for parsimony SPR search (default: 6)" << endl
     << "  --allnni             Perform more thorough NNI search (default: OFF)" << endl
@@ -6362,6 +6425,7 @@ void usage_iqtree(char* argv[], bool full_command) {
     << "  --jack-prop NUM      Subsampling proportion for jackknife (default: 0.5)" << endl
     << "  --bcon NUM           Replicates for bootstrap + consensus tree" << endl
     << "  --bonly NUM          Replicates for bootstrap only" << endl
+    << "  --boot-jobs NUM      Replicates reconstructed at the same time (default: 1)" << endl
 #ifdef USE_BOOSTER
     << "  --tbe                Transfer bootstrap expectation" << endl
 #endif
@@ -6502,6 +6566,7 @@ void usage_iqtree(char* argv[], bool full_command) {
     << endl << "ANCESTRAL STATE RECONSTRUCTION:" << endl
     << "  --ancestral          Ancestral state reconstruction by empirical Bayes" << endl
     << "  --asr-min NUM        Min probability of ancestral state (default: equil freq)" << endl
+    << "  --asr-joint          Joint ancestral sequence reconstruction" << endl
 
     << endl << "TEST OF SYMMETRY:" << endl
     << "  --symtest               Perform three tests of symmetry" << endl
@@ -6609,6 +6674,7 @@ void usage_iqtree(char* argv[], bool full_command) {
 
         << endl << "MISCELLANEOUS:" << endl
         << "  --keep-ident         Keep identical sequences (default: remove & finally add)" << endl
+        << "  --near-ident         Also remove & finally add sequences identical up to gaps/ambiguity" << endl
         << "  -blfix               Fix branch lengths of user tree passed via -te" << endl
         << "  -blscale             Scale branch lengths of user tree passed via -t" << endl
         << "  -blmin               Min branch length for optimization (default 0.000001)" << endl
@@ -6770,6 +6836,39 @@ inline T quantile(const vector<T>& v, const double q) {
     std::copy(v, v.begin() + size, w.begin());
 }
 
+/********************************************************
+        Concurrent jobs (--boot-jobs, --run-jobs)
+ ********************************************************/
+
+/** state of a concurrent job, looked up by the threads of its inner parallel regions */
+struct ConcurrentJob {
+    Params *params;
+    int seed;
+    int *saved_randstream;
+    /** random streams of the threads of the inner parallel regions, created on first use */
+    vector<int*> team_randstreams;
+};
+
+/** concurrent jobs indexed by the thread number in the outer parallel region, empty if none are running */
+static vector<ConcurrentJob> concurrent_jobs;
+
+/** @return concurrent job of the calling thread, NULL if it does not run one */
+static ConcurrentJob *getConcurrentJob() {
+#ifdef _OPENMP
+    if (concurrent_jobs.empty() || omp_get_level() < 1)
+        return NULL;
+    size_t job = omp_get_ancestor_thread_num(1);
+    if (job < concurrent_jobs.size() && concurrent_jobs[job].params)
+        return &concurrent_jobs[job];
+#endif
+    return NULL;
+}
+
+void init_concurrent_jobs(int num_jobs) {
+    ConcurrentJob job = {NULL, 0, NULL};
+    concurrent_jobs.assign(num_jobs, job);
+}
+
 #define RAN_STANDARD 1
 #define RAN_SPRNG    2
 #define RAN_RAND4    3
@@ -6909,7 +7008,34 @@ int finish_random() {
 
 /******************/
 
-int *randstream;
+thread_local int *randstream;
+/**
+   randstream of the main thread (the first one calling init_random), used by threads without their own stream
+ **/
+static int **main_randstream = NULL;
+
+/** @return random stream of the calling thread */
+static inline int *getRandStream() {
+    if (randstream)
+        return randstream;
+#ifdef _OPENMP
+    // inner threads of a concurrent job must not share the stream of the job
+    ConcurrentJob *job = getConcurrentJob();
+    if (job && omp_get_level() >= 2) {
+        int thread = omp_get_ancestor_thread_num(2);
+        ASSERT(thread < job->team_randstreams.size() && "more threads than the concurrent job was started with");
+        int *&stream = job->team_randstreams[thread];
+        if (!stream) {
+#pragma omp critical (random_streams)
+            stream = init_sprng(thread, job->team_randstreams.size(), job->seed, SPRNG_DEFAULT);
+        }
+        return stream;
+    }
+#endif
+    if (!main_randstream)
+        return randstream;
+    return *main_randstream;
+}
 /**
    vector of random streams for multiple threads
  **/
@@ -6932,6 +7058,8 @@ int init_random(int seed, bool write_info, int** rstream) {
         *rstream = init_sprng(0, 1, seed, SPRNG_DEFAULT); /*init stream*/
     } else {
         randstream = init_sprng(0, 1, seed, SPRNG_DEFAULT); /*init stream*/
+        if (!main_randstream)
+            main_randstream = &randstream;
         if (verbose_mode >= VB_MED) {
             print_sprng(randstream);
         }
@@ -6945,6 +7073,8 @@ int init_random(int seed, bool write_info, int** rstream) {
         *rstream = init_sprng(PP_Myid, PP_NumProcs, seed, SPRNG_DEFAULT); /*initialize stream*/
     } else {
         randstream = init_sprng(PP_Myid, PP_NumProcs, seed, SPRNG_DEFAULT); /*initialize stream*/
+        if (!main_randstream)
+            main_randstream = &randstream;
         if (verbose_mode >= VB_MED) {
             cout << "(" << PP_Myid << ") !!! random seed set to " << seed << " !!!" << endl;
             print_sprng(randstream);
@@ -6958,7 +7088,36 @@ int finish_random(int *rstream) {
     if (rstream)
         return free_sprng(rstream);
     else
-        return free_sprng(randstream);
+        return free_sprng(getRandStream());
+}
+
+void begin_concurrent_job(Params &params, int seed, int num_threads) {
+#ifdef _OPENMP
+    ConcurrentJob &job = concurrent_jobs[omp_get_thread_num()];
+    job.seed = seed;
+    job.saved_randstream = randstream;
+    job.team_randstreams.assign(max(num_threads, 1), NULL);
+#pragma omp critical (random_streams)
+    init_random(seed);
+    // from now on the job and its inner threads see their own parameters
+    job.params = &params;
+#endif
+}
+
+void end_concurrent_job() {
+#ifdef _OPENMP
+    ConcurrentJob &job = concurrent_jobs[omp_get_thread_num()];
+    job.params = NULL;
+#pragma omp critical (random_streams)
+    {
+        for (int *stream : job.team_randstreams)
+            if (stream)
+                finish_random(stream);
+        finish_random();
+    }
+    job.team_randstreams.clear();
+    randstream = job.saved_randstream;
+#endif
 }
 
 int init_multi_rstreams()
@@ -7045,7 +7204,7 @@ double random_double(int *rstream) {
     if (rstream)
         return sprng(rstream);
     else
-        return sprng(randstream);
+        return sprng(getRandStream());
 #else /* NO_SPRNG */
     return randomunitintervall();
 #endif /* NO_SPRNG */
@@ -7054,7 +7213,7 @@ double random_double(int *rstream) {
     if (rstream)
         return sprng(rstream);
     else
-        return sprng(randstream);
+        return sprng(getRandStream());
 #else /* NO_SPRNG */
     int m;
     for (m = 1; m < PP_NumProcs; m++)
@@ -7514,6 +7673,12 @@ void trimString(string &str) {
 
 Params& Params::getInstance() {
     static Params instance;
+    // a concurrent job and its inner threads have their own parameters
+    if (!concurrent_jobs.empty()) {
+        ConcurrentJob *job = getConcurrentJob();
+        if (job)
+            return *job->params;
+    }
     return instance;
 }
 
@@ -7608,6 +7773,7 @@ void Params::setDefault() {
     gurobi_format = true;
     gurobi_threads = 1;
     num_bootstrap_samples = 0;
+    num_bootstrap_jobs = 1;
     bootstrap_spec = NULL;
     transfer_bootstrap = 0;
     
@@ -7672,6 +7838,7 @@ void Params::setDefault() {
     stop_condition = SC_UNSUCCESS_ITERATION;
     stop_confidence = 0.95;
     num_runs = 1;
+    num_run_jobs = 1;
     model_name = "";
     contain_nonrev = false;
     model_name_init = NULL;
@@ -7855,6 +8022,7 @@ void Params::setDefault() {
     snni = true; // turn on sNNI default now
     //    autostop = true; // turn on auto stopping rule by default now
     unsuccess_iteration = 100;
+    stop_gain_rate = 0.0;
     speednni = true; // turn on reduced hill-climbing NNI by default now
     numInitTrees = 100;
     fixStableSplits = false;
@@ -7875,6 +8043,9 @@ void Params::setDefault() {
     tree_freq_file = NULL;
     num_threads = 1;
     num_threads_max = 10000;
+    numa_placement = false;
+    lh_huge_pages = false;
+    deterministic_reduction = false;
     openmp_by_model = false;
     model_test_criterion = MTC_BIC;
     //    model_test_stop_rule = MTC_ALL;
@@ -8088,6 +8259,83 @@ int countPhysicalCPUCores() {
      */
 }
 
+#if defined(_OPENMP) && defined(__linux__)
+/**
+    read a list of CPU or node numbers in the format of /sys/devices/system, e.g. "0-3,8-11"
+    @param file_name file holding the list
+    @param[out] ids the numbers in the list
+    @return false if the file cannot be read
+*/
+static bool readSystemIdList(string file_name, vector<int> &ids) {
+    ifstream in(file_name.c_str());
+    string list;
+    if (!in.is_open() || !getline(in, list))
+        return false;
+    ids.clear();
+    stringstream ss(list);
+    string range;
+    while (getline(ss, range, ',')) {
+        int first, last;
+        if (sscanf(range.c_str(), "%d-%d", &first, &last) == 2) {
+            for (int id = first; id <= last; id++)
+                ids.push_back(id);
+        } else if (sscanf(range.c_str(), "%d", &first) == 1)
+            ids.push_back(first);
+    }
+    return true;
+}
+#endif
+
+void pinThreadsToNodes() {
+#if defined(_OPENMP) && defined(__linux__)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    // allowed cores of every NUMA node
+    vector<int> node_ids, cpus;
+    if (!readSystemIdList("/sys/devices/system/node/online", node_ids))
+        return;
+    vector<cpu_set_t> nodes;
+    for (int node : node_ids) {
+        if (!readSystemIdList("/sys/devices/system/node/node" + convertIntToString(node) + "/cpulist", cpus))
+            continue;
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (int cpu : cpus)
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                CPU_SET(cpu, &mask);
+        if (CPU_COUNT(&mask) > 0)
+            nodes.push_back(mask);
+    }
+    // nothing to place on a single node
+    if (nodes.size() < 2)
+        return;
+    int failed = 0;
+    // threads are spread evenly over the nodes, consecutive threads share a node. A thread may
+    // run on any core of its node, so nested teams (concurrent runs, BIONJ, tree mixtures)
+    // started by a thread use the whole node
+#pragma omp parallel reduction(+:failed)
+    {
+        size_t node = (size_t)omp_get_thread_num() * nodes.size() / omp_get_num_threads();
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &nodes[node]) != 0)
+            failed++;
+    }
+    if (failed > 0)
+        outWarning("Could not pin " + convertIntToString(failed) + " threads to NUMA nodes");
+#endif
+}
+
+void adviseHugePages(void *mem, size_t size) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    const uintptr_t HUGE_PAGE_SIZE = 2*1024*1024;
+    // only whole huge pages inside the region can be advised
+    uintptr_t start = ((uintptr_t)mem + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    uintptr_t end = ((uintptr_t)mem + size) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    if (end > start)
+        madvise((void*)start, end - start, MADV_HUGEPAGE);
+#endif
+}
+
 // stacktrace.h (c) 2008, Timo Bingmann from http://idlebox.net/
 // published under the WTFPL v2.0
 
@@ -8758,7 +9006,8 @@ int nFreqParams(StateFreqType freq_type) {
 }
  
 double binomial_coefficient_log(unsigned int N, unsigned int n) {
-  static DoubleVector logv;
+  // per thread: concurrent jobs (--run-jobs, --boot-jobs) grow the table at the same time
+  static thread_local DoubleVector logv;
   if (logv.size() <= 0) {
     logv.push_back(0.0);
     logv.push_back(0.0);
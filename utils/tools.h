@@ -898,6 +898,12 @@ public:
      */
     int unsuccess_iteration;
 
+    /**
+     *  Stop the tree search when the log-likelihood gain per CPU-hour drops below this value
+     *  and candidate trees have stabilised (--stop-gain option), 0 to switch off
+     */
+    double stop_gain_rate;
+
     char *binary_aln_file;
 
     /**
@@ -1598,6 +1604,9 @@ public:
 
     /** number of independent runs (-nrun option) */
     int num_runs;
+
+    /** number of independent runs done at the same time, each with num_threads/num_run_jobs threads (default: 1) */
+    int num_run_jobs;
     
     /**
             name of the substitution model (e.g., HKY, GTR, TN+I+G, JC+G, etc.)
@@ -1891,6 +1900,12 @@ public:
      */
     int num_bootstrap_samples;
 
+    /**
+            number of standard bootstrap replicates reconstructed at the same time,
+            each with num_threads/num_bootstrap_jobs threads (default: 1)
+     */
+    int num_bootstrap_jobs;
+
     /** bootstrap specification of the form "l1:b1,l2:b2,...,lk:bk"
         to randomly draw b1 sites from the first l1 sites, etc. Note that l1+l2+...+lk
         must equal m, where m is the alignment length. Otherwise, an error will occur.
@@ -2356,6 +2371,15 @@ public:
     
     /** maximum number of threads, default: #CPU scores  */
     int num_threads_max;
+
+    /** TRUE to pin threads to NUMA nodes and let each thread first touch the patterns it computes (--numa) */
+    bool numa_placement;
+
+    /** TRUE to back large likelihood vectors with transparent huge pages (--huge-pages) */
+    bool lh_huge_pages;
+
+    /** TRUE to split patterns into a fixed number of packets, so that likelihood sums do not depend on the number of threads */
+    bool deterministic_reduction;
     
     /** true to parallel ModelFinder by models instead of sites */
     bool openmp_by_model;
@@ -2431,6 +2455,9 @@ public:
     /** TRUE (default) to ignore identical sequences and add them back at the end */
     bool ignore_identical_seqs;
 
+    /** TRUE to also ignore sequences that are identical to another one up to gaps/ambiguity, and add them back at the end */
+    bool remove_near_identical_seqs;
+
     /** TRUE to write initial tree to a file (default: false) */
     bool write_init_tree;
 
@@ -3458,7 +3485,12 @@ double computePValueChiSquare(double x, int df);
 /* random number generator */
 /*--------------------------------------------------------------*/
 
-extern int *randstream;
+/**
+    random stream of the calling thread, set by init_random().
+    Threads that never called init_random() draw from the stream of the main thread,
+    or from a stream of their own inside a concurrent job (begin_concurrent_job()).
+ */
+extern thread_local int *randstream;
 extern vector<int*> rstream_vec;
 extern vector<default_random_engine> generator_vec;
 
@@ -3474,6 +3506,30 @@ int init_random(int seed, bool write_info = false, int** rstream = NULL);
  */
 int finish_random(int *rstream = NULL);
 
+/**
+    reserve the slots of concurrent jobs (--boot-jobs, --run-jobs) before their
+    outer parallel region starts, 0 to remove them after it ended
+    @param num_jobs number of threads of the outer parallel region
+ */
+void init_concurrent_jobs(int num_jobs);
+
+/**
+    start a concurrent job on the calling thread of the outer parallel region.
+    The thread gets its own random stream seeded with seed, the other threads of the
+    inner parallel regions of the job get streams of their own, and Params::getInstance()
+    returns params on all of them.
+    @param params parameters of the job, must live until end_concurrent_job()
+    @param seed random seed of the job
+    @param num_threads number of threads of the job
+ */
+void begin_concurrent_job(Params &params, int seed, int num_threads);
+
+/**
+    finish the concurrent job of the calling thread: free its random streams and
+    restore the previous stream of the thread
+ */
+void end_concurrent_job();
+
 /**
  * initialize multiple random streams
  * @return the number of streams
@@ -3645,6 +3701,19 @@ void trimString(string &str);
 */
 int countPhysicalCPUCores();
 
+/**
+    pin the OpenMP threads to the NUMA nodes, spread evenly over the nodes (Linux only).
+    A thread may run on every allowed core of its node, nothing is pinned on a single node
+*/
+void pinThreadsToNodes();
+
+/**
+    advise the kernel to back a memory region with transparent huge pages (Linux only)
+    @param mem start of the region
+    @param size size of the region in bytes
+*/
+void adviseHugePages(void *mem, size_t size);
+
 void print_stacktrace(ostream &out, unsigned int max_frames = 63);
 
 /**